@@ -0,0 +1,47 @@
+#include "cdk.h"
+
+static void _send(cdk_channel_t* channel, int num) {
+    char buffer[64];
+    int  len = snprintf(buffer, sizeof(buffer), "message %d", num);
+    cdk_net_send(channel, buffer, len);
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    printf("dtls handshake done\n");
+    _send(channel, 0);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    static int num;
+
+    printf("recv %.*s\n", (int)len, (char*)buf);
+    if (++num < 10) {
+        _send(channel, num);
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    printf("channel closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_tls_conf_t conf = {
+        .cafile = "certs/ca.crt",
+        .capath = NULL,
+        .crtfile = NULL,
+        .keyfile = NULL,
+        .verifypeer = true,
+        .side = SIDE_CLIENT};
+
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .tlsconfig = &conf,
+    };
+    cdk_net_dial("udp", "127.0.0.1", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include "cdk.h"
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_address_t addrinfo;
+    cdk_net_ntop(&channel->udp.peer.ss, &addrinfo);
+    printf("dtls session with %s:%d\n", addrinfo.addr, addrinfo.port);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    printf("recv %.*s\n", (int)len, (char*)buf);
+    cdk_net_send(channel, buf, len);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    printf("session closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_tls_conf_t conf = {
+        .cafile = NULL,
+        .capath = NULL,
+        .crtfile = "certs/cert.crt",
+        .keyfile = "certs/cert.key",
+        .verifypeer = false,
+        .side = SIDE_SERVER};
+
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 10000,
+        .tlsconfig = &conf,
+    };
+    cdk_net_listen("udp", "0.0.0.0", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    return 0;
+}
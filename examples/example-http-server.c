@@ -0,0 +1,56 @@
+#include "cdk.h"
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_logi(
+        "tid[%d], [%d]new connection coming...\n", (int)cdk_utils_systemtid(),
+        (int)channel->fd);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_http1_message_t* msg = buf;
+    char                 rsp[256];
+    const char*          body = "hello from cdk\n";
+
+    cdk_logi(
+        "%.*s %.*s, %d headers, %d bytes body.\n", (int)msg->method.len,
+        (char*)msg->method.buf, (int)msg->target.len, (char*)msg->target.buf,
+        (int)msg->nheaders, (int)msg->body.len);
+
+    for (size_t i = 0; i < msg->nheaders; i++) {
+        cdk_logi(
+            "  %.*s: %.*s\n", (int)msg->headers[i].name.len,
+            (char*)msg->headers[i].name.buf, (int)msg->headers[i].value.len,
+            (char*)msg->headers[i].value.buf);
+    }
+    int n = snprintf(
+        rsp, sizeof(rsp),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: %d\r\n"
+        "Connection: %s\r\n\r\n%s",
+        (int)strlen(body), msg->keepalive ? "keep-alive" : "close", body);
+    cdk_net_send(channel, rsp, n);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_HTTP1};
+
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 10000,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_listen("tcp", "0.0.0.0", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
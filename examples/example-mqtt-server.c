@@ -0,0 +1,104 @@
+#include "cdk.h"
+
+#define MQTT_CONNECT 0x1
+#define MQTT_CONNACK 0x2
+#define MQTT_PUBLISH 0x3
+#define MQTT_PUBACK 0x4
+#define MQTT_SUBSCRIBE 0x8
+#define MQTT_SUBACK 0x9
+#define MQTT_PINGREQ 0xC
+#define MQTT_PINGRESP 0xD
+#define MQTT_DISCONNECT 0xE
+
+static void _reply(cdk_channel_t* channel, uint8_t type, char* body, int len) {
+    char packet[MQTT_MAX_HEADER + 64];
+    int  hlen = cdk_mqtt_header_encode(type, len, packet);
+
+    memcpy(packet + hlen, body, len);
+    cdk_net_send(channel, packet, hlen + len);
+}
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_logi(
+        "tid[%d], [%d]new connection coming...\n", (int)cdk_utils_systemtid(),
+        (int)channel->fd);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    uint8_t  type;
+    uint32_t remaining;
+    int      hlen = cdk_mqtt_header_decode(buf, len, &type, &remaining);
+    char*    p = (char*)buf + hlen;
+    char     body[64];
+
+    switch (type >> 4) {
+    case MQTT_CONNECT: {
+        /* session present 0, connection accepted */
+        body[0] = 0;
+        body[1] = 0;
+        _reply(channel, MQTT_CONNACK << 4, body, 2);
+        break;
+    }
+    case MQTT_PUBLISH: {
+        uint16_t tlen = (uint8_t)p[0] << 8 | (uint8_t)p[1];
+        int      qos = (type >> 1) & 0x3;
+        char*    payload = p + 2 + tlen + (qos ? 2 : 0);
+
+        cdk_logi(
+            "publish %.*s: %.*s\n", (int)tlen, p + 2,
+            (int)(p + remaining - payload), payload);
+        if (qos == 1) {
+            memcpy(body, p + 2 + tlen, 2);
+            _reply(channel, MQTT_PUBACK << 4, body, 2);
+        }
+        break;
+    }
+    case MQTT_SUBSCRIBE: {
+        /* packet id, then one granted QoS 0 per topic filter */
+        char* end = p + remaining;
+        int   n = 2;
+
+        memcpy(body, p, 2);
+        for (p += 2; p < end && n < (int)sizeof(body); n++) {
+            uint16_t flen = (uint8_t)p[0] << 8 | (uint8_t)p[1];
+
+            cdk_logi("subscribe %.*s\n", (int)flen, p + 2);
+            body[n] = 0;
+            p += 2 + flen + 1;
+        }
+        _reply(channel, MQTT_SUBACK << 4, body, n);
+        break;
+    }
+    case MQTT_PINGREQ:
+        _reply(channel, MQTT_PINGRESP << 4, body, 0);
+        break;
+    case MQTT_DISCONNECT:
+        cdk_net_close(channel);
+        break;
+    default:
+        break;
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_MQTT};
+
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 60000,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_listen("tcp", "0.0.0.0", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "cdk.h"
+
+static void _reply_cb(
+    cdk_channel_t*   channel,
+    cdk_rpc_status_t status,
+    void*            buf,
+    size_t           len,
+    void*            arg) {
+    int num = (int)(intptr_t)arg;
+
+    if (status == RPC_STATUS_OK) {
+        cdk_logi(
+            "lease %d on [%d] replied %.*s\n", num, (int)channel->fd, (int)len,
+            (char*)buf);
+    } else {
+        cdk_loge("lease %d failed, status: %d\n", num, (int)status);
+    }
+    cdk_net_pool_release(channel);
+}
+
+static void _acquire_cb(cdk_channel_t* channel, void* arg) {
+    char buffer[64];
+    int  num = (int)(intptr_t)arg;
+
+    if (!channel) {
+        cdk_loge("lease %d failed\n", num);
+        return;
+    }
+    int len = snprintf(buffer, sizeof(buffer), "lease %d", num);
+    if (!cdk_net_rpc_call(channel, buffer, len, 1000, _reply_cb, arg)) {
+        cdk_net_pool_release(channel);
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RPC};
+
+    cdk_handler_t handler = {
+        .on_close = _close_cb,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    /* works against example-rpc-server */
+    cdk_pool_t* pool = cdk_net_pool_create("127.0.0.1", "9999", &handler, 2, 4);
+    for (int i = 0; i < 10; i++) {
+        cdk_net_pool_acquire(pool, _acquire_cb, (void*)(intptr_t)i);
+    }
+    getchar();
+    cdk_net_pool_destroy(pool);
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
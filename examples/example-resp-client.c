@@ -0,0 +1,86 @@
+#include "cdk.h"
+
+static void _command(cdk_channel_t* channel, int argc, const char** argv) {
+    size_t argvlen[8];
+
+    for (int i = 0; i < argc; i++) {
+        argvlen[i] = strlen(argv[i]);
+    }
+    cdk_net_resp_send(channel, argc, argv, argvlen);
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    const char* set[] = {"SET", "cdk", "hello"};
+    const char* get[] = {"GET", "cdk"};
+    const char* del[] = {"DEL", "cdk"};
+    const char* list[] = {"RPUSH", "cdk:list", "a", "b", "c"};
+    const char* range[] = {"LRANGE", "cdk:list", "0", "-1"};
+
+    /* pipelined, the replies come back in the same order */
+    _command(channel, 3, set);
+    _command(channel, 2, get);
+    _command(channel, 2, del);
+    _command(channel, 5, list);
+    _command(channel, 4, range);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_resp_t value;
+    size_t     off = 0;
+
+    /* an aggregate is followed by its elements, walk them all */
+    while (off < len) {
+        int n = cdk_resp_decode((char*)buf + off, len - off, &value);
+        if (n <= 0) {
+            cdk_loge("malformed reply\n");
+            cdk_net_close(channel);
+            return;
+        }
+        off += n;
+        switch (value.type) {
+        case RESP_TYPE_SIMPLE_STRING:
+        case RESP_TYPE_BULK_STRING:
+            cdk_logi(
+                "string: %.*s\n", (int)value.str.len, (char*)value.str.buf);
+            break;
+        case RESP_TYPE_ERROR:
+        case RESP_TYPE_BULK_ERROR:
+            cdk_logi("error: %.*s\n", (int)value.str.len, (char*)value.str.buf);
+            break;
+        case RESP_TYPE_INTEGER:
+            cdk_logi("integer: %lld\n", (long long)value.integer);
+            break;
+        case RESP_TYPE_NULL:
+            cdk_logi("null\n");
+            break;
+        case RESP_TYPE_ARRAY:
+            cdk_logi("array of %d\n", (int)value.count);
+            break;
+        default:
+            cdk_logi("type %d\n", (int)value.type);
+            break;
+        }
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RESP};
+
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_dial("tcp", "127.0.0.1", "6379", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "cdk.h"
+
+static void _reply_cb(
+    cdk_channel_t*   channel,
+    cdk_rpc_status_t status,
+    void*            buf,
+    size_t           len,
+    void*            arg) {
+    int num = (int)(intptr_t)arg;
+
+    if (status != RPC_STATUS_OK) {
+        cdk_loge("call %d failed, status: %d\n", num, (int)status);
+        return;
+    }
+    cdk_logi("call %d replied %.*s\n", num, (int)len, (char*)buf);
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    char buffer[64];
+
+    /* calls are multiplexed, they don't wait for each other */
+    for (int i = 0; i < 10; i++) {
+        int len = snprintf(buffer, sizeof(buffer), "call %d", i);
+        cdk_net_rpc_call(
+            channel, buffer, len, 1000, _reply_cb, (void*)(intptr_t)i);
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RPC};
+
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_close = _close_cb,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_dial("tcp", "127.0.0.1", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
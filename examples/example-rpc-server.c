@@ -0,0 +1,40 @@
+#include "cdk.h"
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_logi(
+        "tid[%d], [%d]new connection coming...\n", (int)cdk_utils_systemtid(),
+        (int)channel->fd);
+}
+
+static void _request_cb(
+    cdk_channel_t* channel, uint64_t id, void* buf, size_t len) {
+    char reply[128];
+    int  n = snprintf(reply, sizeof(reply), "echo %.*s", (int)len, (char*)buf);
+
+    cdk_logi(
+        "request %llu: %.*s\n", (unsigned long long)id, (int)len, (char*)buf);
+    cdk_net_rpc_reply(channel, id, reply, n);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RPC};
+
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_rpc_request = _request_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 10000,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_listen("tcp", "0.0.0.0", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include "cdk.h"
+
+#define SEGMENT 1200
+#define NSEGS   16
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_address_t addrinfo;
+    cdk_net_ntop(&channel->udp.peer.ss, &addrinfo);
+    printf(
+        "recv %d bytes, segment %d, from %s:%d\n",
+        (int)len,
+        ((char*)buf)[0],
+        addrinfo.addr,
+        addrinfo.port);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    printf("channel closed, reason: %s\n", error.codestr);
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    static char buffer[SEGMENT * NSEGS];
+
+    printf("udp connected\n");
+    /* one send, NSEGS datagrams of SEGMENT bytes on the wire. */
+    for (int i = 0; i < NSEGS; i++) {
+        memset(buffer + i * SEGMENT, i, SEGMENT);
+    }
+    cdk_net_send(channel, buffer, sizeof(buffer));
+}
+
+int main(void) {
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .gso_segment = SEGMENT,
+        .gro = true,
+    };
+    cdk_net_dial("udp", "127.0.0.1", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    return 0;
+}
@@ -0,0 +1,37 @@
+#include "cdk.h"
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_address_t addrinfo;
+    cdk_net_ntop(&channel->udp.peer.ss, &addrinfo);
+    printf(
+        "[%d]\tnew session for %s:%d\n",
+        (int)cdk_utils_systemtid(),
+        addrinfo.addr,
+        addrinfo.port);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    /* the channel is the peer's session, the reply goes back to it. */
+    cdk_net_send(channel, buf, len);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    printf("session closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 10000,
+        .sessions = true,
+        .max_sessions = 1024,
+    };
+    cdk_net_concurrency_configure(4);
+    cdk_net_listen("udp", "0.0.0.0", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "cdk.h"
+
+static void _send(cdk_channel_t* channel, int num) {
+    char buffer[64];
+    int  len = snprintf(buffer, sizeof(buffer), "message %d\n", num);
+    cdk_net_send(channel, buffer, len);
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    cdk_logi("connected\n");
+    _send(channel, 0);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    static int num;
+
+    cdk_logi("recv %.*s", (int)len, (char*)buf);
+    if (++num < 10) {
+        _send(channel, num);
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_DELIMITER, .delimiter.delimiter = "\n"};
+
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_dial("unix", "/tmp/cdk-example.sock", NULL, &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
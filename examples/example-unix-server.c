@@ -0,0 +1,37 @@
+#include "cdk.h"
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_logi(
+        "tid[%d], [%d]new connection coming...\n", (int)cdk_utils_systemtid(),
+        (int)channel->fd);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_logi("recv %.*s", (int)len, (char*)buf);
+    cdk_net_send(channel, buf, len);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_DELIMITER, .delimiter.delimiter = "\n"};
+
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 10000,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    /* the path is unlinked before it is bound, '@' would make it abstract */
+    cdk_net_listen("unix", "/tmp/cdk-example.sock", NULL, &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "cdk.h"
+
+static void _reply_cb(
+    cdk_channel_t*   channel,
+    cdk_rpc_status_t status,
+    void*            buf,
+    size_t           len,
+    void*            arg) {
+    if (status == RPC_STATUS_OK) {
+        cdk_logi("[%d] replied %.*s\n", (int)channel->fd, (int)len, (char*)buf);
+    } else {
+        cdk_loge("call failed, status: %d\n", (int)status);
+    }
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    cdk_address_t addrinfo;
+    cdk_net_address_retrieve(channel->fd, &addrinfo, true);
+    cdk_logi("endpoint %s:%d up\n", addrinfo.addr, addrinfo.port);
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("endpoint down, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    /* works against one or more example-rpc-server */
+    const char* endpoints[] = {"127.0.0.1:9999", "127.0.0.1:9998"};
+
+    cdk_upstream_conf_t conf = {
+        .endpoints = endpoints,
+        .count = 2,
+        .balancer = BALANCER_LEASTOUTSTANDING,
+        .ejectafter = 3,
+        .ejecttime = 1000,
+    };
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RPC};
+
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_close = _close_cb,
+        .conn_timeout = 1000,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_upstream_t* upstream = cdk_net_upstream_create(&conf, &handler);
+
+    for (int i = 0; i < 10; i++) {
+        char buffer[64];
+
+        cdk_time_sleep(500);
+        /* NULL until an endpoint is connected, or if all of them are down */
+        cdk_channel_t* channel = cdk_net_upstream_select(upstream, NULL, 0);
+        if (!channel) {
+            cdk_logw("no endpoint available\n");
+            continue;
+        }
+        int len = snprintf(buffer, sizeof(buffer), "call %d", i);
+        cdk_net_rpc_call(channel, buffer, len, 1000, _reply_cb, NULL);
+    }
+    getchar();
+    cdk_net_upstream_destroy(upstream);
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
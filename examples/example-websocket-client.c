@@ -0,0 +1,50 @@
+#include "cdk.h"
+
+static void _send(cdk_channel_t* channel, int num) {
+    char buffer[64];
+    int  len = snprintf(buffer, sizeof(buffer), "message %d", num);
+    cdk_net_websocket_send(channel, WEBSOCKET_OPCODE_TEXT, buffer, len);
+}
+
+static void _connect_cb(cdk_channel_t* channel) {
+    cdk_logi("websocket upgraded\n");
+    _send(channel, 0);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    static int               num;
+    cdk_websocket_message_t* msg = buf;
+
+    if (msg->opcode != WEBSOCKET_OPCODE_TEXT) {
+        return;
+    }
+    cdk_logi("recv %.*s\n", (int)msg->payload.len, (char*)msg->payload.buf);
+    if (++num < 10) {
+        _send(channel, num);
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_WEBSOCKET,
+        .websocket.host = "127.0.0.1:9999",
+        .websocket.path = "/echo"};
+
+    cdk_handler_t handler = {
+        .on_connect = _connect_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_dial("tcp", "127.0.0.1", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
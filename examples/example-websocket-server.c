@@ -0,0 +1,42 @@
+#include "cdk.h"
+
+static void _accept_cb(cdk_channel_t* channel) {
+    cdk_logi(
+        "tid[%d], [%d]websocket upgraded...\n", (int)cdk_utils_systemtid(),
+        (int)channel->fd);
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_websocket_message_t* msg = buf;
+
+    if (msg->opcode == WEBSOCKET_OPCODE_TEXT ||
+        msg->opcode == WEBSOCKET_OPCODE_BINARY) {
+        cdk_logi(
+            "recv %.*s\n", (int)msg->payload.len, (char*)msg->payload.buf);
+        cdk_net_websocket_send(
+            channel, msg->opcode, msg->payload.buf, msg->payload.len);
+    }
+}
+
+static void _close_cb(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_loge("connection closed, reason: %s\n", error.codestr);
+}
+
+int main(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_WEBSOCKET};
+
+    cdk_handler_t handler = {
+        .on_accept = _accept_cb,
+        .on_read = _read_cb,
+        .on_close = _close_cb,
+        .rd_timeout = 10000,
+        .unpacker = &unpacker,
+    };
+    cdk_logger_create(NULL);
+    cdk_net_listen("tcp", "0.0.0.0", "9999", &handler);
+
+    getchar();
+    cdk_net_exit();
+    cdk_logger_destroy();
+    return 0;
+}
@@ -55,6 +55,7 @@ _Pragma("once")
 #include <netdb.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -107,7 +108,24 @@ typedef struct cdk_waitgroup_s     cdk_waitgroup_t;
 typedef struct cdk_logger_config_s cdk_logger_config_t;
 typedef enum cdk_logger_level_e    cdk_logger_level_t;
 typedef struct cdk_channel_error_s cdk_channel_error_t;
+typedef struct cdk_txlist_s        cdk_txlist_t;
+typedef struct cdk_channel_memory_s cdk_channel_memory_t;
+typedef struct cdk_frame_s          cdk_frame_t;
+typedef struct cdk_http1_header_s   cdk_http1_header_t;
+typedef struct cdk_http1_message_s  cdk_http1_message_t;
+typedef enum cdk_websocket_opcode_e cdk_websocket_opcode_t;
+typedef struct cdk_websocket_message_s cdk_websocket_message_t;
+typedef enum cdk_resp_type_e        cdk_resp_type_t;
+typedef struct cdk_resp_s           cdk_resp_t;
+typedef enum cdk_rpc_status_e       cdk_rpc_status_t;
+typedef struct cdk_pool_s           cdk_pool_t;
+typedef enum cdk_balancer_e         cdk_balancer_t;
+typedef struct cdk_endpoint_s       cdk_endpoint_t;
+typedef struct cdk_upstream_s       cdk_upstream_t;
+typedef struct cdk_upstream_conf_s  cdk_upstream_conf_t;
 typedef void (*cdk_logger_cb_t)(cdk_logger_level_t level, char* msg);
+typedef void (*cdk_pool_cb_t)(cdk_channel_t* channel, void* arg);
+typedef void (*cdk_rpc_cb_t)(cdk_channel_t* channel, cdk_rpc_status_t status, void* buf, size_t len, void* arg);
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -234,6 +252,11 @@ enum cdk_unpacker_type_e {
     UNPACKER_TYPE_DELIMITER,
     UNPACKER_TYPE_LENGTHFIELD,
     UNPACKER_TYPE_USERDEFINED,
+    UNPACKER_TYPE_HTTP1,
+    UNPACKER_TYPE_WEBSOCKET,
+    UNPACKER_TYPE_RESP,
+    UNPACKER_TYPE_MQTT,
+    UNPACKER_TYPE_RPC,
     UNPACKER_TYPE_END,
 };
 
@@ -270,6 +293,11 @@ struct cdk_unpacker_s {
         struct {
             bool (*unpack)(cdk_channel_t* channel);
         } userdefined;
+
+        struct {
+            const char* host; /* client only, Host of the upgrade request */
+            const char* path; /* client only, "/" if not set            */
+        } websocket;
     };
 };
 
@@ -289,6 +317,11 @@ struct cdk_poller_s {
     cdk_list_t      chlist;
     cdk_timermgr_t* timermgr;
     cdk_list_node_t node;
+    atomic_int      offloads; /* handshakes and lookups run by workers */
+    cdk_list_t      rxpool;
+    size_t          rxpoolsize;
+    cdk_list_t      dgrampool;
+    size_t          dgrampoolsize;
 };
 
 struct cdk_net_engine_s {
@@ -300,6 +333,7 @@ struct cdk_net_engine_s {
     mtx_t            poller_mtx;
     cnd_t            poller_cnd;
     cdk_poller_t*    (*poller_roundrobin)(void);
+    cdk_thrdpool_t   thrdpool;
 };
 
 struct cdk_async_event_s {
@@ -308,6 +342,24 @@ struct cdk_async_event_s {
     cdk_list_node_t node;
 };
 
+enum cdk_rpc_status_e {
+    RPC_STATUS_BGN,
+    RPC_STATUS_OK,
+    RPC_STATUS_TIMEOUT,
+    RPC_STATUS_CLOSED,
+    RPC_STATUS_FAIL,
+    RPC_STATUS_END,
+};
+
+enum cdk_balancer_e {
+    BALANCER_BGN,
+    BALANCER_ROUNDROBIN,
+    BALANCER_LEASTOUTSTANDING,
+    BALANCER_P2C,
+    BALANCER_CONSISTENTHASH,
+    BALANCER_END,
+};
+
 enum cdk_side_e {
     SIDE_BGN,
     SIDE_CLIENT,
@@ -358,6 +410,51 @@ struct cdk_tls_conf_s {
      */
     bool       verifypeer;
     cdk_side_t side;
+    /**
+     * A boolean flag enabling kernel TLS. Once the handshake is done,
+     * record encryption moves into the kernel (TLS_TX/TLS_RX) and the
+     * channel writes plaintext straight to the socket, exactly like a
+     * plain TCP channel. It silently falls back to userspace TLS when
+     * OpenSSL is built without KTLS, the kernel lacks the tls module or
+     * the negotiated cipher cannot be offloaded.
+     */
+    bool ktls;
+    /**
+     * A boolean flag letting a server accept TLS 1.3 early data (0-RTT)
+     * from resuming clients. Early data is handed to the unpacker right
+     * after on_accept, it may be replayed by an attacker, so only enable
+     * it for requests that are safe to process twice.
+     */
+    bool earlydata;
+    /**
+     * A boolean flag moving the handshakes off the pollers. Each handshake
+     * step, with its public key operations, runs on a worker thread of the
+     * network engine, so a burst of new connections does not stall the
+     * traffic of the established ones sharing the same poller.
+     */
+    bool offload;
+    /**
+     * A boolean flag decoupling OpenSSL from the socket. OpenSSL works on
+     * memory buffers only: the channel reads ciphertext in large chunks and
+     * feeds it in, and the records OpenSSL produces are queued and written
+     * with a single gathered send, so a TLS channel costs as many syscalls
+     * as a plain one. It takes precedence over ktls, which needs the socket.
+     */
+    bool membio;
+    /**
+     * A boolean flag trimming idle channels. OpenSSL releases its record
+     * buffers whenever they are empty, and the channel hands its receive
+     * buffer back to a pool of its poller as soon as no partial frame is
+     * left in it, both are reacquired on the next readiness. Meant for
+     * large numbers of mostly idle connections, see cdk_net_memory.
+     */
+    bool lowmem;
+};
+
+struct cdk_channel_memory_s {
+    size_t rxbuf;
+    size_t txbuf;
+    size_t tls;
 };
 
 struct cdk_channel_error_s {
@@ -371,11 +468,18 @@ struct cdk_channel_error_s {
         CHANNEL_ERROR_SYSCALL_FAIL,
         CHANNEL_ERROR_TLS_FAIL,
         CHANNEL_ERROR_BUFFER_OVERFLOW,
+        CHANNEL_ERROR_RESOLVE_FAIL,
+        CHANNEL_ERROR_PROTOCOL_FAIL,
         CHANNEL_ERROR_END,
     } code;
     char* codestr;
 };
 
+struct cdk_txlist_s {
+    cdk_list_t    list;
+    atomic_size_t depth; /* nodes queued, read by other threads */
+};
+
 struct cdk_channel_s {
     cdk_poller_t*       poller;
     cdk_sock_t          fd;
@@ -383,7 +487,7 @@ struct cdk_channel_s {
     cdk_handler_t*      handler;
     int                 type;
     atomic_bool         closing;
-    cdk_list_t          txlist;
+    cdk_txlist_t        txlist;
     cdk_channel_mode_t  mode;
     cdk_side_t          side;
     cdk_channel_error_t error;
@@ -398,26 +502,156 @@ struct cdk_channel_s {
         ssize_t len;
         ssize_t off;
     } rxbuf;
+    struct {
+        size_t   dlen;    /* delimiter length                     */
+        size_t   scanned; /* bytes searched in vain for delimiter  */
+        uint32_t fs;      /* size of the frame whose header is read */
+        uint32_t left;    /* bytes of a streamed frame still due   */
+        struct {
+            uint32_t hlen;     /* head length, once its end is found */
+            uint32_t blen;     /* body length, decoded so far if chunked */
+            uint32_t rpos;     /* next byte of a chunked body to decode */
+            uint32_t chunk;    /* bytes of the current chunk and its CRLF */
+            bool     chunked;
+            bool     trailers;
+        } http1;
+        uint32_t resp;    /* values still due to complete a RESP reply */
+        struct {
+            bool     upgraded;
+            bool     closesent; /* a close frame went out already */
+            uint8_t  opcode;    /* of the fragmented message being assembled */
+            uint32_t mlen;      /* bytes of it assembled so far */
+            uint32_t rpos;      /* next frame behind them */
+            char     accept[32]; /* client only, Sec-WebSocket-Accept due */
+        } websocket;
+    } unpacker;
     cdk_list_node_t node;
     union {
         struct {
             bool           connecting;
+            bool           handshaking;
+            bool           offload;
+            bool           offloading;
+            bool           membio;
+            bool           lowmem;
+            bool           ktls_tx;
+            bool           earlydata;
             cdk_timer_t*   conn_timer;
             cdk_tls_ssl_t* tls_ssl;
             cdk_tls_ctx_t* tls_ctx;
+            struct {
+                cdk_rbtree_t  calls; /* in flight, by request id */
+                atomic_size_t inflight;
+                uint64_t      nextid;
+            } rpc;
+            struct {
+                cdk_list_node_t node; /* in the free list of its poller */
+                bool            idle;
+                bool            connected;
+            } pool;
         } tcp;
         struct {
             struct {
                 struct sockaddr_storage ss;
                 socklen_t               sslen;
             } peer;
+            bool nogso; /* UDP_SEGMENT refused, segment in userspace */
+            /**
+             * Per-peer sessions. On the server channel, buckets index the
+             * live sessions by peer address and wrlist holds the sessions
+             * waiting for the shared socket to become writable. On a
+             * session, parent points back to the server channel.
+             */
+            struct {
+                cdk_list_t*     buckets;
+                size_t          nbuckets;
+                size_t          count;
+                uint32_t        seed;
+                cdk_list_t      wrlist;
+                cdk_channel_t*  parent;
+                cdk_list_node_t bnode;
+                cdk_list_node_t wrnode;
+            } sessions;
+            /**
+             * DTLS state. On the server channel, ssl is the listening SSL
+             * that runs the cookie exchange for peers without a session yet,
+             * it is handed over to the session created once a peer proves
+             * its address. timer drives the handshake retransmissions.
+             */
+            struct {
+                cdk_tls_ssl_t* ssl;
+                cdk_tls_ctx_t* ctx;
+                cdk_timer_t*   timer;
+                bool           handshaking;
+            } dtls;
         } udp;
     };
 };
 
+struct cdk_frame_s {
+    void*  buf;
+    size_t len;
+};
+
+#define HTTP1_MAX_HEADERS 64
+
+struct cdk_http1_header_s {
+    cdk_frame_t name;
+    cdk_frame_t value;
+};
+
+/**
+ * What UNPACKER_TYPE_HTTP1 hands to on_read, with len set to its size. All
+ * the slices point into the receive buffer and are only valid during the
+ * call. A chunked body is decoded in place, so body is always contiguous.
+ */
+struct cdk_http1_message_s {
+    bool               request;
+    cdk_frame_t        method;  /* request only  */
+    cdk_frame_t        target;  /* request only  */
+    cdk_frame_t        version;
+    int                status;  /* response only */
+    cdk_frame_t        reason;  /* response only */
+    cdk_http1_header_t headers[HTTP1_MAX_HEADERS];
+    size_t             nheaders;
+    cdk_frame_t        body;
+    bool               keepalive;
+};
+
+enum cdk_websocket_opcode_e {
+    WEBSOCKET_OPCODE_CONTINUATION = 0x0,
+    WEBSOCKET_OPCODE_TEXT = 0x1,
+    WEBSOCKET_OPCODE_BINARY = 0x2,
+    WEBSOCKET_OPCODE_CLOSE = 0x8,
+    WEBSOCKET_OPCODE_PING = 0x9,
+    WEBSOCKET_OPCODE_PONG = 0xA,
+};
+
+/**
+ * What UNPACKER_TYPE_WEBSOCKET hands to on_read, with len set to its size.
+ * A fragmented message is reassembled in place before it is handed over,
+ * control frames come as they arrive. The payload is unmasked already and
+ * points into the receive buffer, only valid during the call. Pings are
+ * answered and a close is echoed by the library itself. on_accept and
+ * on_connect only fire once the upgrade handshake is through. A bad upgrade
+ * request is answered with 400 Bad Request, it and any frame breaking RFC
+ * 6455 close the channel with CHANNEL_ERROR_PROTOCOL_FAIL.
+ */
+struct cdk_websocket_message_s {
+    cdk_websocket_opcode_t opcode;
+    cdk_frame_t            payload;
+};
+
 struct cdk_handler_s {
     void (*on_connect)(cdk_channel_t* channel);
     void (*on_read)(cdk_channel_t* channel, void* buf, size_t len);
+    /**
+     * on_read_batch: optional, replaces on_read for the fixed-length,
+     * delimiter, length-field, RESP and MQTT unpackers. The frames parsed out of one
+     * read are handed over together, up to 64 per call. They point into the
+     * receive buffer and are only valid during the call.
+     */
+    void (*on_read_batch)(cdk_channel_t* channel, cdk_frame_t* frames, size_t count);
     void (*on_write)(cdk_channel_t* channel);
     void (*on_close)(cdk_channel_t* channel, cdk_channel_error_t error);
     void (*on_heartbeat)(cdk_channel_t* channel);
@@ -431,6 +665,120 @@ struct cdk_handler_s {
     int             conn_timeout;
     cdk_unpacker_t* unpacker;
     cdk_tls_conf_t* tlsconfig;
+    /**
+     * on_stream_begin/chunk/end: length-field unpacker only. A frame larger
+     * than the receive buffer, which would otherwise close the channel with
+     * CHANNEL_ERROR_BUFFER_OVERFLOW, is streamed once on_stream_chunk is
+     * set: on_stream_begin gets its header and total size, on_stream_chunk
+     * the rest of it piece by piece as it arrives, and on_stream_end marks
+     * its end. Frames that fit still go to on_read.
+     */
+    void (*on_stream_begin)(cdk_channel_t* channel, void* header, size_t hlen, size_t flen);
+    void (*on_stream_chunk)(cdk_channel_t* channel, void* buf, size_t len);
+    void (*on_stream_end)(cdk_channel_t* channel);
+    /**
+     * on_rpc_request: RPC unpacker only, a request sent by the peer with
+     * cdk_net_rpc_call. It is answered with cdk_net_rpc_reply and its id,
+     * at any time and from any thread.
+     */
+    void (*on_rpc_request)(cdk_channel_t* channel, uint64_t id, void* buf, size_t len);
+    /**
+     * Below are UDP-specific.
+     *
+     * gso_segment: when non-zero, a buffer larger than gso_segment passed to
+     * cdk_net_send is sent as a train of datagrams of gso_segment bytes each
+     * (the last one may be shorter), using UDP_SEGMENT offload if available.
+     * It can't be more than the 65507 bytes of a UDP payload, a listen or a
+     * dial with a larger one fails.
+     *
+     * gro: ask the kernel to coalesce incoming datagrams (UDP_GRO). The
+     * coalesced buffer is split back into the original datagrams before
+     * on_read is invoked, so it stays transparent to the user.
+     *
+     * sessions: server side only. Every remote endpoint gets its own
+     * channel (announced by on_accept), with its own txlist and timers, so
+     * rd_timeout acts as a per-peer idle timeout and cdk_net_send always
+     * replies to the right peer. Without rd_timeout a session still expires
+     * after 60 seconds without a datagram.
+     *
+     * max_sessions: the most sessions a server channel keeps at once, 4096
+     * if 0. Datagrams from new peers past it are dropped.
+     *
+     * tlsconfig: also honored for UDP, where it turns the channel into a
+     * DTLS 1.2 one. Servers answer new peers with a stateless cookie
+     * exchange and always run with sessions. Records are produced through
+     * memory BIOs and written in batches, equally sized datagrams going out
+     * as a single UDP_SEGMENT train when possible.
+     */
+    int  gso_segment;
+    bool gro;
+    bool sessions;
+    int  max_sessions;
+};
+
+/**
+ * Connections to one destination dialed with one handler. The channels
+ * run with handler, a copy of the user's one whose callbacks are wrapped,
+ * which is how a channel finds its way back to the pool.
+ */
+struct cdk_pool_s {
+    char           host[NI_MAXHOST];
+    char           port[6];
+    cdk_handler_t* user;
+    cdk_handler_t  handler;
+    size_t         minidle;
+    size_t         maxidle;
+    mtx_t          mtx;
+    cdk_list_t     slots;   /* per-poller free lists  */
+    cdk_list_t     waiters; /* leases no channel yet */
+    size_t         nwaiters;
+    size_t         nidle;
+    size_t         pending; /* dials not connected yet */
+    size_t         refs;    /* channels alive         */
+    bool           destroyed;
+};
+
+struct cdk_upstream_conf_s {
+    const char**   endpoints; /* "host:port", "[v6]:port" */
+    int            count;
+    cdk_balancer_t balancer;
+    int            ejectafter; /* consecutive errors, 0 never ejects */
+    int            ejecttime;  /* in milliseconds, doubled per ejection */
+};
+
+/**
+ * One endpoint of an upstream keeps one connection, redialed when it
+ * closes. Its handler is the upstream's one with the callbacks wrapped,
+ * which is how a channel finds its way back to the endpoint.
+ */
+struct cdk_endpoint_s {
+    char                    host[NI_MAXHOST];
+    char                    port[6];
+    cdk_upstream_t*         upstream;
+    cdk_handler_t           handler;
+    _Atomic(cdk_channel_t*) channel; /* NULL while not connected */
+    cdk_poller_t*           poller; /* where the redial is due */
+    int                     failures;
+    int                     ejections;
+    bool                    ejected;
+};
+
+struct cdk_upstream_s {
+    cdk_endpoint_t* endpoints;
+    int             count;
+    cdk_balancer_t  balancer;
+    cdk_handler_t*  user;
+    int             ejectafter;
+    int             ejecttime;
+    atomic_int      nejected;
+    atomic_size_t   next; /* round-robin cursor */
+    struct {
+        uint64_t hash;
+        int      endpoint;
+    }* ring;
+    size_t      ringsize;
+    atomic_int  refs; /* endpoints not retired yet */
+    atomic_bool destroyed;
 };
 
 struct cdk_sha256_s {
@@ -440,6 +788,37 @@ struct cdk_sha256_s {
     uint32_t state[8];
 };
 
+enum cdk_resp_type_e {
+    RESP_TYPE_BGN,
+    RESP_TYPE_SIMPLE_STRING,
+    RESP_TYPE_ERROR,
+    RESP_TYPE_INTEGER,
+    RESP_TYPE_BULK_STRING,
+    RESP_TYPE_ARRAY,
+    RESP_TYPE_NULL,
+    RESP_TYPE_BOOLEAN,
+    RESP_TYPE_DOUBLE,
+    RESP_TYPE_BIG_NUMBER,
+    RESP_TYPE_BULK_ERROR,
+    RESP_TYPE_VERBATIM_STRING,
+    RESP_TYPE_MAP,
+    RESP_TYPE_SET,
+    RESP_TYPE_ATTRIBUTE,
+    RESP_TYPE_PUSH,
+    RESP_TYPE_END,
+};
+
+/**
+ * One RESP2/RESP3 value as decoded by cdk_resp_decode. The elements of an
+ * aggregate are not part of it, they are the count values that follow.
+ */
+struct cdk_resp_s {
+    cdk_resp_type_t type;
+    cdk_frame_t     str;     /* strings, errors, doubles and big numbers */
+    int64_t         integer; /* integers and booleans                    */
+    size_t          count;   /* elements of an aggregate, 2 per map pair */
+};
+
 struct cdk_sha1_s {
     uint32_t state[5];
     size_t   count[2];
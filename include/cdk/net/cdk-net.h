@@ -31,7 +31,21 @@ extern void cdk_net_concurrency_configure(int ncpus);
 extern void cdk_net_listen(const char* protocol, const char* host, const char* port, cdk_handler_t* handler);
 extern void cdk_net_dial(const char* protocol, const char* host, const char* port, cdk_handler_t* handler);
 extern bool cdk_net_send(cdk_channel_t* channel, void* data, size_t size);
+extern bool cdk_net_send_frame(cdk_channel_t* channel, void* data, size_t size);
+extern bool cdk_net_rpc_call(cdk_channel_t* channel, void* data, size_t size, int timeout, cdk_rpc_cb_t cb, void* arg);
+extern bool cdk_net_rpc_reply(cdk_channel_t* channel, uint64_t id, void* data, size_t size);
+extern cdk_pool_t* cdk_net_pool_create(const char* host, const char* port, cdk_handler_t* handler, size_t minidle, size_t maxidle);
+extern void cdk_net_pool_acquire(cdk_pool_t* pool, cdk_pool_cb_t cb, void* arg);
+extern void cdk_net_pool_release(cdk_channel_t* channel);
+extern void cdk_net_pool_destroy(cdk_pool_t* pool);
+extern cdk_upstream_t* cdk_net_upstream_create(cdk_upstream_conf_t* conf, cdk_handler_t* handler);
+extern cdk_channel_t* cdk_net_upstream_select(cdk_upstream_t* upstream, const void* key, size_t keylen);
+extern void cdk_net_upstream_destroy(cdk_upstream_t* upstream);
+extern bool cdk_net_resp_send(cdk_channel_t* channel, int argc, const char** argv, const size_t* argvlen);
+extern bool cdk_net_websocket_send(cdk_channel_t* channel, cdk_websocket_opcode_t opcode, void* data, size_t size);
 extern void cdk_net_post_event(cdk_poller_t* poller, void (*task)(void*), void* arg, bool totail);
 extern void cdk_net_timer_create(void (*routine)(void*), void* param, size_t expire, bool repeat);
 extern void cdk_net_close(cdk_channel_t* channel);
+extern bool cdk_net_tls_reload(cdk_tls_conf_t* conf);
+extern void cdk_net_memory(cdk_channel_t* channel, cdk_channel_memory_t* usage);
 extern void cdk_net_exit(void);
\ No newline at end of file
@@ -39,6 +39,11 @@ static int _thrdfunc(void* arg) {
             cnd_wait(&pool->qcnd, &pool->qmtx);
         }
         cdk_queue_node_t* node = cdk_queue_dequeue(&pool->queue);
+        mtx_unlock(&pool->qmtx);
+        /**
+         * Run the job without holding the queue lock, otherwise the workers
+         * would only ever run one job at a time.
+         */
         if (node) {
             job = cdk_queue_data(node, thrdpool_job_t, n);
             job->routine(job->arg);
@@ -47,7 +52,6 @@ static int _thrdfunc(void* arg) {
                 job = NULL;
             }
         }
-        mtx_unlock(&pool->qmtx);
     }
     return 0;
 }
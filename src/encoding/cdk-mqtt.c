@@ -0,0 +1,82 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "cdk/encoding/cdk-mqtt.h"
+
+#define MQTT_MAX_REMAINING 268435455
+
+/**
+ * Write the fixed header: the packet type and flags byte followed by the
+ * remaining length, 7 bits per byte with the least significant group
+ * first. Returns its size, 2 to 5 bytes, or -1 if the length is too large.
+ */
+int cdk_mqtt_header_encode(uint8_t type, uint32_t remaining, char* buf) {
+    int pos = 0;
+
+    if (remaining > MQTT_MAX_REMAINING) {
+        return -1;
+    }
+    buf[pos++] = (char)type;
+    do {
+        uint8_t byte = remaining & 0x7f;
+        remaining >>= 7;
+        if (remaining) {
+            byte |= 0x80;
+        }
+        buf[pos++] = (char)byte;
+    } while (remaining);
+    return pos;
+}
+
+/**
+ * Read the fixed header at buf. Returns its size, 0 if it is not complete
+ * yet and -1 if the remaining length runs over 4 bytes.
+ */
+int cdk_mqtt_header_decode(char* buf, size_t len, uint8_t* type, uint32_t* remaining) {
+    uint32_t value = 0;
+
+    for (size_t i = 1; i < 5; i++) {
+        if (i >= len) {
+            return 0;
+        }
+        uint8_t byte = (uint8_t)buf[i];
+        value |= (uint32_t)(byte & 0x7f) << (7 * (i - 1));
+        if (!(byte & 0x80)) {
+            *type = (uint8_t)buf[0];
+            *remaining = value;
+            return (int)i + 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Write a UTF-8 string as MQTT carries it, behind its length as a two byte
+ * big-endian integer. Returns the bytes written.
+ */
+int cdk_mqtt_string_encode(const char* str, uint16_t len, char* buf) {
+    buf[0] = (char)(len >> 8);
+    buf[1] = (char)(len & 0xff);
+    memcpy(buf + 2, str, len);
+    return len + 2;
+}
@@ -0,0 +1,231 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "cdk/encoding/cdk-resp.h"
+
+/**
+ * Find the CRLF ending the line at buf. Returns the line length, or -1 if
+ * the line is not complete yet.
+ */
+static inline int _line_end(char* buf, size_t len) {
+    for (char* p = buf; p < buf + len;) {
+        char* lf = memchr(p, '\n', (buf + len) - p);
+        if (!lf) {
+            return -1;
+        }
+        if (lf > buf && lf[-1] == '\r') {
+            return (int)(lf - 1 - buf);
+        }
+        p = lf + 1;
+    }
+    return -1;
+}
+
+static bool _integer_parse(char* buf, int len, int64_t* value) {
+    int      i = 0;
+    bool     negative = false;
+    uint64_t v = 0;
+
+    if (len && (buf[0] == '-' || buf[0] == '+')) {
+        negative = (buf[0] == '-');
+        i++;
+    }
+    if (i == len) {
+        return false;
+    }
+    for (; i < len; i++) {
+        if (buf[i] < '0' || buf[i] > '9' || v > (uint64_t)INT64_MAX / 10) {
+            return false;
+        }
+        v = v * 10 + (buf[i] - '0');
+    }
+    if (v > (uint64_t)INT64_MAX) {
+        return false;
+    }
+    *value = negative ? -(int64_t)v : (int64_t)v;
+    return true;
+}
+
+static inline int _uint_encode(uint64_t value, char* buf) {
+    char tmp[20];
+    int  n = 0;
+
+    do {
+        tmp[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (int i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+/**
+ * Decode the value at buf, which for a string includes its payload. Returns
+ * the bytes it takes, 0 if it is not complete yet and -1 if it is malformed.
+ * Streamed RESP3 strings and aggregates are not supported.
+ */
+int cdk_resp_decode(char* buf, size_t len, cdk_resp_t* value) {
+    if (len > INT_MAX) {
+        len = INT_MAX;
+    }
+    int ll = _line_end(buf, len);
+    if (ll < 0) {
+        return 0;
+    }
+    char* line = buf + 1;
+    int   n = ll - 1;
+    int   used = ll + 2;
+
+    if (!ll) {
+        return -1;
+    }
+    memset(value, 0, sizeof(cdk_resp_t));
+    switch (buf[0]) {
+    case '+':
+    case '-':
+    case ',':
+    case '(': {
+        value->type = (buf[0] == '+')   ? RESP_TYPE_SIMPLE_STRING
+                      : (buf[0] == '-') ? RESP_TYPE_ERROR
+                      : (buf[0] == ',') ? RESP_TYPE_DOUBLE
+                                        : RESP_TYPE_BIG_NUMBER;
+        value->str.buf = line;
+        value->str.len = n;
+        return used;
+    }
+    case ':': {
+        value->type = RESP_TYPE_INTEGER;
+        return _integer_parse(line, n, &value->integer) ? used : -1;
+    }
+    case '_': {
+        value->type = RESP_TYPE_NULL;
+        return n ? -1 : used;
+    }
+    case '#': {
+        value->type = RESP_TYPE_BOOLEAN;
+        if (n != 1 || (line[0] != 't' && line[0] != 'f')) {
+            return -1;
+        }
+        value->integer = (line[0] == 't');
+        return used;
+    }
+    case '$':
+    case '!':
+    case '=': {
+        int64_t size;
+        if (!_integer_parse(line, n, &size) || size < -1) {
+            return -1;
+        }
+        if (size == -1) {
+            value->type = RESP_TYPE_NULL;
+            return used;
+        }
+        value->type = (buf[0] == '$')   ? RESP_TYPE_BULK_STRING
+                      : (buf[0] == '!') ? RESP_TYPE_BULK_ERROR
+                                        : RESP_TYPE_VERBATIM_STRING;
+        if (size > (int64_t)(INT_MAX - used - 2)) {
+            return -1;
+        }
+        if ((size_t)used + size + 2 > len) {
+            return 0;
+        }
+        char* data = buf + used;
+        if (data[size] != '\r' || data[size + 1] != '\n') {
+            return -1;
+        }
+        value->str.buf = data;
+        value->str.len = (size_t)size;
+        return used + (int)size + 2;
+    }
+    case '*':
+    case '%':
+    case '~':
+    case '|':
+    case '>': {
+        int64_t count;
+        if (!_integer_parse(line, n, &count) || count < -1) {
+            return -1;
+        }
+        if (count == -1) {
+            value->type = RESP_TYPE_NULL;
+            return used;
+        }
+        switch (buf[0]) {
+        case '*':
+            value->type = RESP_TYPE_ARRAY;
+            break;
+        case '~':
+            value->type = RESP_TYPE_SET;
+            break;
+        case '>':
+            value->type = RESP_TYPE_PUSH;
+            break;
+        default:
+            value->type = (buf[0] == '%') ? RESP_TYPE_MAP : RESP_TYPE_ATTRIBUTE;
+            count *= 2;
+            break;
+        }
+        if (count > INT_MAX) {
+            return -1;
+        }
+        value->count = (size_t)count;
+        return used;
+    }
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Encode a command as an array of bulk strings, the form servers expect.
+ * With buf set to NULL only the size it takes is returned.
+ */
+size_t cdk_resp_encode(int argc, const char** argv, const size_t* argvlen, char* buf) {
+    char   num[20];
+    size_t size = 1 + _uint_encode((uint64_t)argc, num) + 2;
+
+    for (int i = 0; i < argc; i++) {
+        size += 1 + _uint_encode(argvlen[i], num) + 2 + argvlen[i] + 2;
+    }
+    if (!buf) {
+        return size;
+    }
+    char* p = buf;
+    *p++ = '*';
+    p += _uint_encode((uint64_t)argc, p);
+    *p++ = '\r';
+    *p++ = '\n';
+    for (int i = 0; i < argc; i++) {
+        *p++ = '$';
+        p += _uint_encode(argvlen[i], p);
+        *p++ = '\r';
+        *p++ = '\n';
+        memcpy(p, argv[i], argvlen[i]);
+        p += argvlen[i];
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+    return size;
+}
@@ -21,17 +21,26 @@
 
 #include "cdk/net/cdk-net.h"
 #include "cdk/cdk-logger.h"
+#include "cdk/cdk-threadpool.h"
 #include "cdk/cdk-time.h"
 #include "cdk/cdk-timer.h"
 #include "cdk/cdk-utils.h"
 #include "cdk/container/cdk-list.h"
+#include "cdk/encoding/cdk-resp.h"
+#include "cdk/encoding/cdk-varint.h"
 #include "cdk/sync/cdk-waitgroup.h"
 #include "channel.h"
+#include "dtls.h"
 #include "platform/platform-event.h"
 #include "platform/platform-socket.h"
 #include "poller.h"
+#include "pool.h"
+#include "resolver.h"
+#include "rpc.h"
 #include "tls.h"
 #include "txlist.h"
+#include "upstream.h"
+#include "websocket.h"
 
 cdk_net_engine_t global_net_engine = {.initialized = ATOMIC_FLAG_INIT};
 
@@ -41,15 +50,41 @@ typedef struct channel_send_ctx_s {
     char           data[];
 } channel_send_ctx_t;
 
+typedef struct rpc_send_ctx_s {
+    cdk_channel_t* channel;
+    uint64_t       id;
+    int            timeout;
+    cdk_rpc_cb_t   cb;
+    void*          arg;
+    size_t         size;
+    char           data[];
+} rpc_send_ctx_t;
+
+typedef struct websocket_send_ctx_s {
+    cdk_channel_t*         channel;
+    cdk_websocket_opcode_t opcode;
+    size_t                 size;
+    char                   data[];
+} websocket_send_ctx_t;
+
 typedef struct socket_ctx_s {
-    char           host[INET6_ADDRSTRLEN];
-    char           port[6];
-    int            protocol;
-    int            idx;
-    int            cores;
-    cdk_poller_t*  poller;
-    cdk_handler_t* handler;
-    cdk_tls_ctx_t* tls_ctx;
+    char                host[NI_MAXHOST];
+    char                port[6];
+    int                 family;
+    int                 protocol;
+    int                 idx;
+    int                 cores;
+    cdk_channel_mode_t  mode;
+    cdk_side_t          side;
+    cdk_poller_t*       poller;
+    cdk_handler_t*      handler;
+    cdk_tls_ctx_t*      tls_ctx;
+    cdk_channel_error_t error;
+    /**
+     * Stands in for the channel that couldn't be made when the failure is
+     * reported to on_close, see _socket_ctx_fail.
+     */
+    cdk_channel_t       standin;
 } socket_ctx_t;
 
 static void _async_poller_exit(void* param) {
@@ -57,12 +92,13 @@ static void _async_poller_exit(void* param) {
     poller->active = false;
 }
 
+static cdk_poller_t* curr;
+
 static inline cdk_poller_t* _roundrobin(void) {
     mtx_lock(&global_net_engine.poller_mtx);
     while (cdk_list_empty(&global_net_engine.poller_lst)) {
         cnd_wait(&global_net_engine.poller_cnd, &global_net_engine.poller_mtx);
     }
-    static cdk_poller_t* curr;
     if (curr == NULL) {
         curr = cdk_list_data(
             cdk_list_head(&global_net_engine.poller_lst), cdk_poller_t, node);
@@ -88,16 +124,42 @@ static void _net_engine_add_poller(cdk_poller_t* poller) {
 static void _net_engine_del_poller(cdk_poller_t* poller) {
     mtx_lock(&global_net_engine.poller_mtx);
     cdk_list_remove(&poller->node);
+    /* the poller is freed next, the round-robin must not step from it. */
+    if (curr == poller) {
+        curr = NULL;
+    }
+    mtx_unlock(&global_net_engine.poller_mtx);
+}
+
+/**
+ * Workers running the offloaded TLS handshakes, only started once a TLS
+ * configuration asks for it.
+ */
+static void _net_engine_thrdpool_create(cdk_tls_conf_t* tlsconf) {
+    if (!tlsconf || !tlsconf->offload) {
+        return;
+    }
+    mtx_lock(&global_net_engine.poller_mtx);
+    if (!global_net_engine.thrdpool.status) {
+        cdk_thrdpool_create(
+            &global_net_engine.thrdpool,
+            atomic_load(&global_net_engine.thrdcnt));
+    }
     mtx_unlock(&global_net_engine.poller_mtx);
 }
 
 static void _net_engine_destroy(void) {
+    if (global_net_engine.thrdpool.status) {
+        cdk_thrdpool_destroy(&global_net_engine.thrdpool);
+    }
+    resolver_destroy();
     free(global_net_engine.thrdids);
     global_net_engine.thrdids = NULL;
 
     mtx_destroy(&global_net_engine.poller_mtx);
     cnd_destroy(&global_net_engine.poller_cnd);
     cdk_waitgroup_destroy(global_net_engine.wg);
+    tls_session_store_clear();
     platform_socket_cleanup();
 }
 
@@ -118,6 +180,7 @@ static int _poll(void* param) {
 
 static void _net_engine_create(void) {
     platform_socket_startup();
+    resolver_create();
     if (!atomic_load(&global_net_engine.thrdcnt)) {
         atomic_store(&global_net_engine.thrdcnt, 1);
     }
@@ -141,50 +204,196 @@ static void _net_engine_create(void) {
     }
 }
 
+static bool _protocol_is_datagram(const char* protocol) {
+    return !strcmp(protocol, "udp") || !strcmp(protocol, "unixgram");
+}
+
+static bool _protocol_is_local(const char* protocol) {
+    return !strcmp(protocol, "unix") || !strcmp(protocol, "unixgram");
+}
+
 static socket_ctx_t* _socket_ctx_allocate(
     const char*    protocol,
     const char*    host,
     const char*    port,
+    bool           passive,
     int            idx,
     int            cores,
     cdk_handler_t* handler,
     cdk_tls_ctx_t* tlsctx) {
+    if (!port) {
+        port = "";
+    }
     socket_ctx_t* ctx = malloc(sizeof(socket_ctx_t));
     if (ctx) {
         memset(ctx, 0, sizeof(socket_ctx_t));
-        memcpy(ctx->host, host, strlen(host));
-        memcpy(ctx->port, port, strlen(port));
+        ctx->family = AF_UNSPEC;
         if (!strcmp(protocol, "tcp")) {
             ctx->protocol = SOCK_STREAM;
         }
         if (!strcmp(protocol, "udp")) {
             ctx->protocol = SOCK_DGRAM;
         }
+        if (!strcmp(protocol, "unix")) {
+            ctx->family = AF_UNIX;
+            ctx->protocol = SOCK_STREAM;
+        }
+        if (!strcmp(protocol, "unixgram")) {
+            ctx->family = AF_UNIX;
+            ctx->protocol = SOCK_DGRAM;
+        }
+        ctx->mode = passive ? CHANNEL_MODE_ACCEPT : CHANNEL_MODE_CONNECT;
+        ctx->side = passive ? SIDE_SERVER : SIDE_CLIENT;
         ctx->idx = idx;
         ctx->cores = cores;
         ctx->handler = handler;
         ctx->tls_ctx = tlsctx;
         ctx->poller = global_net_engine.poller_roundrobin();
+
+        if (!ctx->protocol || handler->gso_segment < 0 ||
+            handler->gso_segment > MAX_UDP_PAYLOAD_SIZE) {
+            ctx->error.code = CHANNEL_ERROR_SYSCALL_FAIL;
+            ctx->error.codestr = platform_socket_error2string(EINVAL);
+        } else if (
+            strlen(host) >= sizeof(ctx->host) ||
+            strlen(port) >= sizeof(ctx->port)) {
+            ctx->error.code = CHANNEL_ERROR_RESOLVE_FAIL;
+            ctx->error.codestr = CHANNEL_ERROR_RESOLVE_FAIL_STR;
+        } else {
+            memcpy(ctx->host, host, strlen(host));
+            memcpy(ctx->port, port, strlen(port));
+        }
     }
     return ctx;
 }
 
-static void _async_listen(void* param) {
-    socket_ctx_t* sctx = param;
+static void _socket_ctx_destroy_cb(void* param) {
+    free(param);
+}
+
+static void _async_socket_ctx_fail(void* param) {
+    socket_ctx_t*  sctx = param;
+    cdk_channel_t* channel = &sctx->standin;
+
+    memset(channel, 0, sizeof(cdk_channel_t));
+    channel->poller = sctx->poller;
+    channel->fd = PLATFORM_SO_ERROR_INVALID_SOCKET;
+    channel->handler = sctx->handler;
+    channel->type = sctx->protocol;
+    atomic_init(&channel->closing, true);
+    txlist_create(&channel->txlist);
+    channel->mode = sctx->mode;
+    channel->side = sctx->side;
+    channel->error = sctx->error;
+
+    tls_ctx_destroy(sctx->tls_ctx);
+    sctx->tls_ctx = NULL;
+
+    if (channel->handler->on_close) {
+        channel->handler->on_close(channel, channel->error);
+    }
+    /* freed late like a real channel, the user may still hold on to it. */
+    if (!cdk_timer_add(
+            sctx->poller->timermgr,
+            _socket_ctx_destroy_cb,
+            sctx,
+            CHANNEL_DELAYED_DESTROY_TIME,
+            false)) {
+        free(sctx);
+    }
+}
+
+/**
+ * A listen or a dial that failed before it had a channel is reported like
+ * a failed connect, as a channel closing with the error. No socket is made
+ * for it, on_close gets a closed stand-in that lives in the context and is
+ * called on the poller the channel would have run on.
+ */
+static void _socket_ctx_fail(socket_ctx_t* sctx, cdk_channel_error_t error) {
+    sctx->error = error;
+    cdk_net_post_event(sctx->poller, _async_socket_ctx_fail, sctx, true);
+}
+
+static void _socket_ctx_start(socket_ctx_t* sctx, resolver_cb_t cb) {
+    if (sctx->error.code != CHANNEL_ERROR_BGN) {
+        _socket_ctx_fail(sctx, sctx->error);
+        return;
+    }
+    if (!resolver_resolve(
+            sctx->poller,
+            sctx->host,
+            sctx->port,
+            sctx->family,
+            sctx->protocol,
+            sctx->side == SIDE_SERVER,
+            cb,
+            sctx)) {
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_SYSCALL_FAIL,
+            .codestr = platform_socket_error2string(ENOMEM)};
+        _socket_ctx_fail(sctx, error);
+    }
+}
 
-    cdk_sock_t sock = platform_socket_listen(
-        sctx->host, sctx->port, sctx->protocol, sctx->idx, sctx->cores, true);
+static cdk_channel_error_t _socket_ctx_error(resolver_addrs_t* addrs) {
+    cdk_channel_error_t error;
 
+    if (!addrs->count) {
+        error.code = CHANNEL_ERROR_RESOLVE_FAIL;
+        error.codestr = CHANNEL_ERROR_RESOLVE_FAIL_STR;
+    } else {
+        error.code = CHANNEL_ERROR_SYSCALL_FAIL;
+        error.codestr =
+            platform_socket_error2string(platform_socket_lasterror());
+    }
+    return error;
+}
+
+/**
+ * Make the channel of a listen or a dial that got its socket, a failure
+ * is reported like any other one.
+ */
+static cdk_channel_t*
+_socket_ctx_channel(socket_ctx_t* sctx, cdk_sock_t sock) {
     cdk_channel_t* channel = channel_create(
         sctx->poller,
         sock,
-        CHANNEL_MODE_ACCEPT,
-        SIDE_SERVER,
+        sctx->mode,
+        sctx->side,
         sctx->handler,
         sctx->tls_ctx);
     if (!channel) {
-        free(sctx);
-        sctx = NULL;
+        platform_socket_close(sock);
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_SYSCALL_FAIL,
+            .codestr = platform_socket_error2string(ENOMEM)};
+        _socket_ctx_fail(sctx, error);
+    }
+    return channel;
+}
+
+static void _async_listen(resolver_addrs_t* addrs, void* param) {
+    socket_ctx_t* sctx = param;
+    cdk_sock_t    sock = PLATFORM_SO_ERROR_INVALID_SOCKET;
+
+    for (int i = 0; i < addrs->count; i++) {
+        sock = platform_socket_listen(
+            &addrs->ss[i],
+            addrs->lens[i],
+            sctx->protocol,
+            sctx->idx,
+            sctx->cores,
+            true);
+        if (sock != PLATFORM_SO_ERROR_INVALID_SOCKET) {
+            break;
+        }
+    }
+    if (sock == PLATFORM_SO_ERROR_INVALID_SOCKET) {
+        _socket_ctx_fail(sctx, _socket_ctx_error(addrs));
+        return;
+    }
+    cdk_channel_t* channel = _socket_ctx_channel(sctx, sock);
+    if (!channel) {
         return;
     }
     channel->accepting = true;
@@ -196,37 +405,36 @@ static void _async_listen(void* param) {
     sctx = NULL;
 }
 
-static inline void _conn_timeout_cb(void* param) {
-    cdk_channel_t* channel = param;
-
-    cdk_channel_error_t error = {
-        .code = CHANNEL_ERROR_CONN_TIMEOUT,
-        .codestr = CHANNEL_ERROR_CONN_TIMEOUT_STR};
-    channel_error_update(channel, error);
-    channel_destroy(channel);
-}
-
-static void _async_dial(void* param) {
+static void _async_dial(resolver_addrs_t* addrs, void* param) {
     socket_ctx_t* sctx = param;
     bool          connected = false;
-
-    cdk_sock_t sock = platform_socket_dial(
-        sctx->host, sctx->port, sctx->protocol, &connected, true);
-
-    cdk_channel_t* channel = channel_create(
-        sctx->poller,
-        sock,
-        CHANNEL_MODE_CONNECT,
-        SIDE_CLIENT,
-        sctx->handler,
-        sctx->tls_ctx);
-
+    cdk_sock_t    sock = PLATFORM_SO_ERROR_INVALID_SOCKET;
+    int           i;
+
+    for (i = 0; i < addrs->count; i++) {
+        sock = platform_socket_dial(
+            &addrs->ss[i], addrs->lens[i], sctx->protocol, &connected, true);
+        if (sock != PLATFORM_SO_ERROR_INVALID_SOCKET) {
+            break;
+        }
+    }
+    if (sock == PLATFORM_SO_ERROR_INVALID_SOCKET) {
+        _socket_ctx_fail(sctx, _socket_ctx_error(addrs));
+        return;
+    }
+    cdk_channel_t* channel = _socket_ctx_channel(sctx, sock);
     if (!channel) {
-        free(sctx);
-        sctx = NULL;
         return;
     }
     if (channel->type == SOCK_STREAM) {
+        if (channel->tcp.tls_ssl) {
+            tls_ssl_session_resume(
+                sctx->tls_ctx, channel->tcp.tls_ssl, sctx->host, sctx->port);
+        }
+        /**
+         * conn_timeout covers both the TCP connection and the TLS handshake.
+         */
+        channel_conn_timer_create(channel);
         if (connected) {
             if (channel->tcp.tls_ssl) {
                 channel_tls_cli_handshake(channel);
@@ -238,30 +446,18 @@ static void _async_dial(void* param) {
             if (!channel_is_writing(channel)) {
                 channel_enable_write(channel);
             }
-            if (channel->handler->conn_timeout) {
-                channel->tcp.conn_timer = cdk_timer_add(
-                    channel->poller->timermgr,
-                    _conn_timeout_cb,
-                    channel,
-                    channel->handler->conn_timeout,
-                    false);
-            }
         }
     } else {
-        cdk_net_address_make(
-            sock, &channel->udp.peer.ss, sctx->host, sctx->port);
-        /**
-         * In MacOS, when the destination address parameter of the sendto
-         * function is of type struct sockaddr_storage, the address length
-         * cannot use sizeof(struct sockaddr_storage). This seems to be a
-         * bug in MacOS.
-         */
-        channel->udp.peer.sslen =
-            (platform_socket_extract_family(sock) == AF_INET)
-                ? sizeof(struct sockaddr_in)
-                : sizeof(struct sockaddr_in6);
+        memcpy(&channel->udp.peer.ss, &addrs->ss[i], addrs->lens[i]);
+        channel->udp.peer.sslen = addrs->lens[i];
 
-        channel_connected(channel);
+        if (channel->udp.dtls.ssl) {
+            tls_ssl_session_resume(
+                sctx->tls_ctx, channel->udp.dtls.ssl, sctx->host, sctx->port);
+            dtls_connect(channel);
+        } else {
+            channel_connected(channel);
+        }
     }
     free(sctx);
     sctx = NULL;
@@ -275,6 +471,49 @@ static void _async_channel_explicit_send(void* param) {
     ctx = NULL;
 }
 
+static void _async_rpc_call(void* param) {
+    rpc_send_ctx_t* ctx = param;
+
+    /**
+     * cdk_net_rpc_call has returned already, a call that cannot be issued
+     * is failed through its callback, as closed if the channel closed in
+     * between.
+     */
+    if (!rpc_call(
+            ctx->channel,
+            ctx->data,
+            ctx->size,
+            ctx->timeout,
+            ctx->cb,
+            ctx->arg)) {
+        ctx->cb(
+            ctx->channel,
+            atomic_load(&ctx->channel->closing) ? RPC_STATUS_CLOSED
+                                                : RPC_STATUS_FAIL,
+            NULL,
+            0,
+            ctx->arg);
+    }
+    free(ctx);
+    ctx = NULL;
+}
+
+static void _async_rpc_reply(void* param) {
+    rpc_send_ctx_t* ctx = param;
+
+    rpc_reply(ctx->channel, ctx->id, ctx->data, ctx->size);
+    free(ctx);
+    ctx = NULL;
+}
+
+static void _async_websocket_send(void* param) {
+    websocket_send_ctx_t* ctx = param;
+
+    websocket_send(ctx->channel, ctx->opcode, ctx->data, ctx->size);
+    free(ctx);
+    ctx = NULL;
+}
+
 static void _async_channel_destroy(void* param) {
     cdk_channel_t* channel = param;
 
@@ -395,22 +634,36 @@ void cdk_net_listen(
     if (!atomic_flag_test_and_set(&global_net_engine.initialized)) {
         _net_engine_create();
     }
+    _net_engine_thrdpool_create(handler->tlsconfig);
+
     /**
-     * Destroy tlsctx when the accepting channel is destroyed.
+     * A path binds only once, so a local socket gets a single listener. The
+     * connections it accepts are still spread over all pollers.
      */
-    cdk_tls_ctx_t* tlsctx = tls_ctx_create(handler->tlsconfig);
+    int listeners = _protocol_is_local(protocol)
+                        ? 1
+                        : atomic_load(&global_net_engine.thrdcnt);
 
-    for (int i = 0; i < atomic_load(&global_net_engine.thrdcnt); i++) {
-        socket_ctx_t* sctx = _socket_ctx_allocate(
+    for (int i = 0; i < listeners; i++) {
+        /**
+         * Every accepting channel holds its own reference to the shared
+         * tlsctx and releases it when it is destroyed.
+         */
+        cdk_tls_ctx_t* tlsctx =
+            tls_ctx_create(handler->tlsconfig, _protocol_is_datagram(protocol));
+        socket_ctx_t*  sctx = _socket_ctx_allocate(
             protocol,
             host,
             port,
+            true,
             i,
             atomic_load(&global_net_engine.thrdcnt),
             handler,
             tlsctx);
         if (sctx) {
-            cdk_net_post_event(sctx->poller, _async_listen, sctx, true);
+            _socket_ctx_start(sctx, _async_listen);
+        } else {
+            tls_ctx_destroy(tlsctx);
         }
     }
 }
@@ -424,15 +677,62 @@ void cdk_net_dial(
     if (!atomic_flag_test_and_set(&global_net_engine.initialized)) {
         _net_engine_create();
     }
-    cdk_tls_ctx_t* tlsctx = tls_ctx_create(handler->tlsconfig);
+    _net_engine_thrdpool_create(handler->tlsconfig);
+    cdk_tls_ctx_t* tlsctx =
+        tls_ctx_create(handler->tlsconfig, _protocol_is_datagram(protocol));
 
-    socket_ctx_t* sctx =
-        _socket_ctx_allocate(protocol, host, port, 0, 0, handler, tlsctx);
+    socket_ctx_t* sctx = _socket_ctx_allocate(
+        protocol, host, port, false, 0, 0, handler, tlsctx);
     if (sctx) {
-        cdk_net_post_event(sctx->poller, _async_dial, sctx, true);
+        _socket_ctx_start(sctx, _async_dial);
+    } else {
+        tls_ctx_destroy(tlsctx);
     }
 }
 
+cdk_pool_t* cdk_net_pool_create(
+    const char*    host,
+    const char*    port,
+    cdk_handler_t* handler,
+    size_t         minidle,
+    size_t         maxidle) {
+    return pool_create(host, port, handler, minidle, maxidle);
+}
+
+void cdk_net_pool_acquire(cdk_pool_t* pool, cdk_pool_cb_t cb, void* arg) {
+    pool_acquire(pool, cb, arg);
+}
+
+void cdk_net_pool_release(cdk_channel_t* channel) {
+    pool_release(channel);
+}
+
+void cdk_net_pool_destroy(cdk_pool_t* pool) {
+    pool_destroy(pool);
+}
+
+cdk_upstream_t*
+cdk_net_upstream_create(cdk_upstream_conf_t* conf, cdk_handler_t* handler) {
+    return upstream_create(conf, handler);
+}
+
+cdk_channel_t* cdk_net_upstream_select(
+    cdk_upstream_t* upstream, const void* key, size_t keylen) {
+    return upstream_select(upstream, key, keylen);
+}
+
+void cdk_net_upstream_destroy(cdk_upstream_t* upstream) {
+    upstream_destroy(upstream);
+}
+
+bool cdk_net_tls_reload(cdk_tls_conf_t* conf) {
+    return tls_ctx_reload(conf);
+}
+
+void cdk_net_memory(cdk_channel_t* channel, cdk_channel_memory_t* usage) {
+    channel_memory(channel, usage);
+}
+
 bool cdk_net_send(cdk_channel_t* channel, void* data, size_t size) {
     if (atomic_load(&channel->closing)) {
         return false;
@@ -455,6 +755,202 @@ bool cdk_net_send(cdk_channel_t* channel, void* data, size_t size) {
     return true;
 }
 
+/**
+ * Build the header the length-field unpacker of the channel expects in
+ * front of size bytes of payload: the length, fixed or varint, sits at its
+ * offset and the rest of the header is zeroed. Returns its size, or 0 if
+ * the configuration can't be encoded.
+ */
+static size_t _frame_header_make(
+    cdk_unpacker_t* unpacker, size_t size, char hdr[MAX_FRAME_HEADER_SIZE]) {
+    uint32_t payload = unpacker->lengthfield.payload;
+    uint32_t offset = unpacker->lengthfield.offset;
+    int64_t  ps = (int64_t)size - unpacker->lengthfield.adj;
+
+    if (ps < 0 || ps > UINT32_MAX || payload > MAX_FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    memset(hdr, 0, MAX_FRAME_HEADER_SIZE);
+    if (unpacker->lengthfield.coding == MODE_FIXEDINT) {
+        if (offset + sizeof(uint32_t) > payload) {
+            return 0;
+        }
+        uint32_t field = (uint32_t)ps;
+        if (cdk_utils_byteorder()) {
+            field = htonl(field);
+        }
+        memcpy(hdr + offset, &field, sizeof(uint32_t));
+        return payload;
+    }
+    char field[10];
+    int  flexible = cdk_varint_encode((uint64_t)ps, field);
+    if (offset + unpacker->lengthfield.size > payload ||
+        payload + flexible - unpacker->lengthfield.size > MAX_FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    memcpy(hdr + offset, field, flexible);
+    return payload + flexible - unpacker->lengthfield.size;
+}
+
+/**
+ * The header is built on the stack and goes out together with the payload
+ * in one gathered write, the payload is not copied unless the send has to
+ * be posted to the poller thread.
+ */
+bool cdk_net_send_frame(cdk_channel_t* channel, void* data, size_t size) {
+    char   hdr[MAX_FRAME_HEADER_SIZE];
+    size_t hs;
+
+    if (atomic_load(&channel->closing)) {
+        return false;
+    }
+    if (!channel->handler->unpacker ||
+        channel->handler->unpacker->type != UNPACKER_TYPE_LENGTHFIELD) {
+        return false;
+    }
+    hs = _frame_header_make(channel->handler->unpacker, size, hdr);
+    if (!hs) {
+        return false;
+    }
+    if (thrd_equal(channel->poller->tid, thrd_current())) {
+        void*  bufs[2] = {hdr, data};
+        size_t lens[2] = {hs, size};
+
+        channel_explicit_sendv(channel, bufs, lens, 2);
+    } else {
+        channel_send_ctx_t* ctx = malloc(sizeof(channel_send_ctx_t) + hs + size);
+        if (!ctx) {
+            return false;
+        }
+        ctx->channel = channel;
+        ctx->size = hs + size;
+        memcpy(ctx->data, hdr, hs);
+        memcpy(ctx->data + hs, data, size);
+
+        cdk_net_post_event(
+            channel->poller, _async_channel_explicit_send, ctx, true);
+    }
+    return true;
+}
+
+static rpc_send_ctx_t* _rpc_send_ctx_create(
+    cdk_channel_t* channel, void* data, size_t size) {
+    rpc_send_ctx_t* ctx = malloc(sizeof(rpc_send_ctx_t) + size);
+    if (ctx) {
+        memset(ctx, 0, sizeof(rpc_send_ctx_t));
+        ctx->channel = channel;
+        ctx->size = size;
+        memcpy(ctx->data, data, size);
+    }
+    return ctx;
+}
+
+bool cdk_net_rpc_call(
+    cdk_channel_t* channel,
+    void*          data,
+    size_t         size,
+    int            timeout,
+    cdk_rpc_cb_t   cb,
+    void*          arg) {
+    if (atomic_load(&channel->closing) || size > RPC_MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    if (thrd_equal(channel->poller->tid, thrd_current())) {
+        return rpc_call(channel, data, size, timeout, cb, arg);
+    } else {
+        rpc_send_ctx_t* ctx = _rpc_send_ctx_create(channel, data, size);
+        if (!ctx) {
+            return false;
+        }
+        ctx->timeout = timeout;
+        ctx->cb = cb;
+        ctx->arg = arg;
+
+        cdk_net_post_event(channel->poller, _async_rpc_call, ctx, true);
+    }
+    return true;
+}
+
+bool cdk_net_rpc_reply(
+    cdk_channel_t* channel, uint64_t id, void* data, size_t size) {
+    if (atomic_load(&channel->closing) || size > RPC_MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    if (thrd_equal(channel->poller->tid, thrd_current())) {
+        return rpc_reply(channel, id, data, size);
+    } else {
+        rpc_send_ctx_t* ctx = _rpc_send_ctx_create(channel, data, size);
+        if (!ctx) {
+            return false;
+        }
+        ctx->id = id;
+
+        cdk_net_post_event(channel->poller, _async_rpc_reply, ctx, true);
+    }
+    return true;
+}
+
+/**
+ * The command is encoded straight into the buffer that gets posted to the
+ * poller thread, or on the stack when sent from that thread and small.
+ */
+bool cdk_net_resp_send(
+    cdk_channel_t* channel, int argc, const char** argv, const size_t* argvlen) {
+    char   stack[MAX_RESP_STACK_SIZE];
+    size_t size = cdk_resp_encode(argc, argv, argvlen, NULL);
+
+    if (atomic_load(&channel->closing)) {
+        return false;
+    }
+    if (thrd_equal(channel->poller->tid, thrd_current())) {
+        char* data = (size <= sizeof(stack)) ? stack : malloc(size);
+        if (!data) {
+            return false;
+        }
+        cdk_resp_encode(argc, argv, argvlen, data);
+        channel_explicit_send(channel, data, size);
+        if (data != stack) {
+            free(data);
+        }
+    } else {
+        channel_send_ctx_t* ctx = malloc(sizeof(channel_send_ctx_t) + size);
+        if (!ctx) {
+            return false;
+        }
+        ctx->channel = channel;
+        ctx->size = size;
+        cdk_resp_encode(argc, argv, argvlen, ctx->data);
+
+        cdk_net_post_event(
+            channel->poller, _async_channel_explicit_send, ctx, true);
+    }
+    return true;
+}
+
+bool cdk_net_websocket_send(
+    cdk_channel_t* channel, cdk_websocket_opcode_t opcode, void* data, size_t size) {
+    if (atomic_load(&channel->closing)) {
+        return false;
+    }
+    if (thrd_equal(channel->poller->tid, thrd_current())) {
+        websocket_send(channel, opcode, data, size);
+    } else {
+        websocket_send_ctx_t* ctx = malloc(sizeof(websocket_send_ctx_t) + size);
+        if (!ctx) {
+            return false;
+        }
+        memset(ctx, 0, sizeof(websocket_send_ctx_t) + size);
+        ctx->channel = channel;
+        ctx->opcode = opcode;
+        ctx->size = size;
+        memcpy(ctx->data, data, size);
+
+        cdk_net_post_event(
+            channel->poller, _async_websocket_send, ctx, true);
+    }
+    return true;
+}
+
 void cdk_net_close(cdk_channel_t* channel) {
     if (atomic_load(&channel->closing)) {
         return;
@@ -481,13 +977,20 @@ void cdk_net_post_event(
     async_event->arg = arg;
 
     mtx_lock(&poller->evmtx);
+    bool idle = cdk_list_empty(&poller->evlist);
     if (totail) {
         cdk_list_insert_tail(&poller->evlist, &async_event->node);
     } else {
         cdk_list_insert_head(&poller->evlist, &async_event->node);
     }
     mtx_unlock(&poller->evmtx);
-    poller_wakeup(poller);
+    /**
+     * One wakeup per batch: a byte per event fills the socket pair under
+     * load and blocks the sender, the poller itself included.
+     */
+    if (idle) {
+        poller_wakeup(poller);
+    }
 }
 
 void cdk_net_timer_create(
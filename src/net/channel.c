@@ -21,18 +21,37 @@
 
 #include "channel.h"
 #include "cdk/cdk-logger.h"
+#include "cdk/cdk-threadpool.h"
 #include "cdk/cdk-time.h"
 #include "cdk/cdk-timer.h"
 #include "cdk/container/cdk-list.h"
 #include "cdk/container/cdk-rbtree.h"
 #include "cdk/net/cdk-net.h"
+#include "dtls.h"
 #include "platform/platform-event.h"
 #include "platform/platform-socket.h"
+#include "poller.h"
+#include "rpc.h"
+#include "session.h"
 #include "tls.h"
 #include "txlist.h"
 #include "unpacker.h"
+#include "websocket.h"
 
-#define CHANNEL_DELAYED_DESTROY_TIME 60000
+typedef struct channel_handshake_ctx_s {
+    cdk_channel_t* channel;
+    int            n;
+    int            err;
+} channel_handshake_ctx_t;
+
+static void _channel_release(cdk_channel_t* channel);
+
+typedef struct channel_accept_ctx_s {
+    cdk_poller_t*  poller;
+    cdk_sock_t     sock;
+    cdk_handler_t* handler;
+    cdk_tls_ctx_t* tlsctx;
+} channel_accept_ctx_t;
 
 extern cdk_net_engine_t global_net_engine;
 
@@ -41,19 +60,29 @@ static inline void _write_complete_cb(void* param) {
     channel->handler->on_write(channel);
 }
 
+/**
+ * Anyone can make a session by sending a datagram, so sessions always
+ * expire, after SESSION_IDLE_TIMEOUT if the handler has no rd_timeout.
+ */
+static inline uint64_t _rd_timeout(cdk_channel_t* channel) {
+    if (channel->handler->rd_timeout <= 0 && session_is(channel)) {
+        return SESSION_IDLE_TIMEOUT;
+    }
+    return (uint64_t)channel->handler->rd_timeout;
+}
+
 static inline void _rd_timeout_cb(void* param) {
     cdk_channel_t* channel = param;
 
     uint64_t elapsed_time = cdk_time_now() - channel->latest_rd_time;
-    if (elapsed_time > channel->handler->rd_timeout) {
+    if (elapsed_time >= _rd_timeout(channel)) {
         cdk_channel_error_t error = {
             .code = CHANNEL_ERROR_RD_TIMEOUT,
             .codestr = CHANNEL_ERROR_RD_TIMEOUT_STR};
         channel_error_update(channel, error);
         channel_destroy(channel);
     } else {
-        channel->rd_timer->expire =
-            (channel->handler->rd_timeout - elapsed_time);
+        channel->rd_timer->expire = (_rd_timeout(channel) - elapsed_time);
     }
 }
 
@@ -61,7 +90,7 @@ static inline void _wr_timeout_cb(void* param) {
     cdk_channel_t* channel = param;
 
     uint64_t elapsed_time = cdk_time_now() - channel->latest_wr_time;
-    if (elapsed_time > channel->handler->wr_timeout) {
+    if (elapsed_time >= channel->handler->wr_timeout) {
         cdk_channel_error_t error = {
             .code = CHANNEL_ERROR_WR_TIMEOUT,
             .codestr = CHANNEL_ERROR_WR_TIMEOUT_STR};
@@ -73,6 +102,27 @@ static inline void _wr_timeout_cb(void* param) {
     }
 }
 
+static inline void _conn_timeout_cb(void* param) {
+    cdk_channel_t* channel = param;
+    /**
+     * The timer is released by the timer manager once this callback returns.
+     */
+    channel->tcp.conn_timer = NULL;
+
+    cdk_channel_error_t error = {
+        .code = CHANNEL_ERROR_CONN_TIMEOUT,
+        .codestr = CHANNEL_ERROR_CONN_TIMEOUT_STR};
+    channel_error_update(channel, error);
+    channel_destroy(channel);
+}
+
+static inline void _conn_timer_destroy(cdk_channel_t* channel) {
+    if (channel->tcp.conn_timer) {
+        cdk_timer_del(channel->poller->timermgr, channel->tcp.conn_timer);
+        channel->tcp.conn_timer = NULL;
+    }
+}
+
 static inline void _heartbeat_cb(void* param) {
     cdk_channel_t* channel = param;
     if (channel->handler->on_heartbeat) {
@@ -81,6 +131,13 @@ static inline void _heartbeat_cb(void* param) {
 }
 
 void channel_timers_destroy(cdk_channel_t* channel) {
+    if (channel->type == SOCK_STREAM) {
+        _conn_timer_destroy(channel);
+    }
+    if (channel->type == SOCK_DGRAM && channel->udp.dtls.timer) {
+        cdk_timer_del(channel->poller->timermgr, channel->udp.dtls.timer);
+        channel->udp.dtls.timer = NULL;
+    }
     if (channel->hb_timer) {
         cdk_timer_del(channel->poller->timermgr, channel->hb_timer);
     }
@@ -115,12 +172,12 @@ void channel_timers_create(cdk_channel_t* channel) {
             channel->handler->hb_interval,
             true);
     }
-    if (channel->handler->rd_timeout) {
+    if (_rd_timeout(channel)) {
         channel->rd_timer = cdk_timer_add(
             channel->poller->timermgr,
             _rd_timeout_cb,
             channel,
-            channel->handler->rd_timeout,
+            _rd_timeout(channel),
             true);
     }
     if (channel->handler->wr_timeout) {
@@ -133,46 +190,403 @@ void channel_timers_create(cdk_channel_t* channel) {
     }
 }
 
+void channel_conn_timer_create(cdk_channel_t* channel) {
+    if (channel->handler->conn_timeout && !channel->tcp.conn_timer) {
+        channel->tcp.conn_timer = cdk_timer_add(
+            channel->poller->timermgr,
+            _conn_timeout_cb,
+            channel,
+            channel->handler->conn_timeout,
+            false);
+    }
+}
+
+/**
+ * Give a lowmem channel a receive buffer from the pool of its poller before
+ * reading. Returns false if the channel was destroyed.
+ */
+static bool _rxbuf_acquire(cdk_channel_t* channel) {
+    if (!channel->tcp.lowmem || channel->rxbuf.buf) {
+        return true;
+    }
+    channel->rxbuf.buf = poller_rxbuf_acquire(channel->poller);
+    if (!channel->rxbuf.buf) {
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_SYSCALL_FAIL,
+            .codestr = platform_socket_error2string(ENOMEM)};
+        channel_error_update(channel, error);
+        channel_destroy(channel);
+        return false;
+    }
+    channel->rxbuf.len = MAX_TCP_RECVBUF_SIZE;
+    channel->rxbuf.off = 0;
+    return true;
+}
+
+/**
+ * Hand the receive buffer of a lowmem channel back once no partial frame is
+ * left in it.
+ */
+static void _rxbuf_trim(cdk_channel_t* channel) {
+    if (!channel->tcp.lowmem || !channel->rxbuf.buf || channel->rxbuf.off ||
+        atomic_load(&channel->closing)) {
+        return;
+    }
+    poller_rxbuf_release(channel->poller, channel->rxbuf.buf);
+    channel->rxbuf.buf = NULL;
+    channel->rxbuf.len = 0;
+}
+
+/**
+ * True when the txlist holds plaintext that still has to go through
+ * SSL_write, false when it holds bytes for the socket as they are.
+ */
+static inline bool _tls_write_through(cdk_channel_t* channel) {
+    return channel->tcp.tls_ssl && !channel->tcp.ktls_tx &&
+           !channel->tcp.membio;
+}
+
+/**
+ * Write as much of the txlist as the socket takes with one gathered send,
+ * dropping what went out. Returns the number of bytes written or
+ * PLATFORM_SO_ERROR_SOCKET_ERROR.
+ */
+static ssize_t _txlist_sendv(cdk_channel_t* channel) {
+    void*  bufs[PLATFORM_SENDV_MAX];
+    size_t lens[PLATFORM_SENDV_MAX];
+    int    count = 0;
+
+    for (cdk_list_node_t* node = cdk_list_head(&channel->txlist.list);
+         node != cdk_list_sentinel(&channel->txlist.list) &&
+         count < PLATFORM_SENDV_MAX;
+         node = cdk_list_next(node)) {
+        txlist_node_t* e = cdk_list_data(node, txlist_node_t, n);
+        bufs[count] = e->buf;
+        lens[count] = e->len;
+        count++;
+    }
+    ssize_t n = platform_socket_sendv(channel->fd, bufs, lens, count);
+    if (n <= 0) {
+        return n;
+    }
+    size_t left = n;
+    while (left) {
+        txlist_node_t* e = cdk_list_data(
+            cdk_list_head(&channel->txlist.list), txlist_node_t, n);
+        if (left < e->len) {
+            memmove(e->buf, e->buf + left, e->len - left);
+            e->len -= left;
+            break;
+        }
+        left -= e->len;
+        txlist_remove(&channel->txlist, e);
+    }
+    return n;
+}
+
+/**
+ * Send the queued bytes without waiting for the socket to become writable.
+ * Returns the number of bytes written, or -1 if the channel was destroyed.
+ */
+static ssize_t _txlist_flush(cdk_channel_t* channel) {
+    if (txlist_empty(&channel->txlist)) {
+        return 0;
+    }
+    ssize_t n = _txlist_sendv(channel);
+    if (n == PLATFORM_SO_ERROR_SOCKET_ERROR) {
+        if ((platform_socket_lasterror() == PLATFORM_SO_ERROR_EAGAIN) ||
+            (platform_socket_lasterror() == PLATFORM_SO_ERROR_EWOULDBLOCK)) {
+            return 0;
+        }
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_SYSCALL_FAIL,
+            .codestr =
+                platform_socket_error2string(platform_socket_lasterror())};
+        channel_error_update(channel, error);
+        channel_destroy(channel);
+        return -1;
+    }
+    if (n > 0) {
+        channel->latest_wr_time = cdk_time_now();
+    }
+    return n;
+}
+
+/**
+ * Queue the records OpenSSL wrote to its memory BIO behind whatever is
+ * already pending.
+ */
+static void _tls_membio_flush(cdk_channel_t* channel) {
+    void*  data = NULL;
+    size_t len = tls_membio_peek(channel->tcp.tls_ssl, &data);
+    if (len) {
+        txlist_insert(&channel->txlist, data, len, true);
+        tls_membio_reset(channel->tcp.tls_ssl);
+    }
+}
+
+/**
+ * Park the handshake until the socket is ready for what OpenSSL is waiting
+ * for, the poller resumes it through _channel_handle.
+ */
+static void _tls_handshake_wait(cdk_channel_t* channel, bool wantwrite) {
+    channel->tcp.handshaking = true;
+    if (wantwrite) {
+        if (channel_is_reading(channel)) {
+            channel_disable_read(channel);
+        }
+        if (!channel_is_writing(channel)) {
+            channel_enable_write(channel);
+        }
+    } else {
+        if (channel_is_writing(channel)) {
+            channel_disable_write(channel);
+        }
+        if (!channel_is_reading(channel)) {
+            channel_enable_read(channel);
+        }
+    }
+}
+
+static inline bool _websocket_enabled(cdk_channel_t* channel) {
+    return channel->type == SOCK_STREAM && channel->handler->unpacker &&
+           channel->handler->unpacker->type == UNPACKER_TYPE_WEBSOCKET;
+}
+
 void channel_connected(cdk_channel_t* channel) {
     channel_disable_all(channel);
-
-    if (channel->handler->conn_timeout) {
-        cdk_timer_del(channel->poller->timermgr, channel->tcp.conn_timer);
+    if (channel->type == SOCK_STREAM) {
+        _conn_timer_destroy(channel);
     }
-    if (channel->handler->on_connect) {
+
+    /* a WebSocket client is announced once the upgrade went through. */
+    if (_websocket_enabled(channel)) {
+        websocket_upgrade(channel);
+    } else if (channel->handler->on_connect) {
         channel->handler->on_connect(channel);
     }
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
     if (!channel_is_reading(channel)) {
         channel_enable_read(channel);
     }
     channel_timers_create(channel);
 }
 
-void channel_recv(cdk_channel_t* channel) {
-    if (atomic_load(&channel->closing)) {
+/**
+ * Deliver one datagram to the channel or session it belongs to. Returns
+ * false when the rest of the received buffer must be dropped.
+ */
+static bool _dgram_dispatch(cdk_channel_t* channel, char* dgram, size_t len) {
+    cdk_channel_t* target = channel;
+
+    if (channel->side == SIDE_SERVER && session_enabled(channel)) {
+        target = session_find(channel, &channel->udp.peer.ss);
+        if (!target) {
+            /**
+             * A DTLS peer only gets a session once it has echoed the
+             * cookie of the server.
+             */
+            if (channel->udp.dtls.ctx) {
+                dtls_listen(channel, dgram, len);
+                return !atomic_load(&channel->closing);
+            }
+            target = session_create(
+                channel, &channel->udp.peer.ss, channel->udp.peer.sslen);
+            if (!target) {
+                return false;
+            }
+            channel_accepted(target);
+        }
+        if (atomic_load(&target->closing)) {
+            return false;
+        }
+    }
+    target->latest_rd_time = cdk_time_now();
+    if (target->udp.dtls.ssl) {
+        dtls_recv(target, dgram, len);
+    } else if (target->handler->on_read) {
+        target->handler->on_read(target, dgram, len);
+    }
+    return !atomic_load(&target->closing);
+}
+
+/**
+ * Decrypt what OpenSSL holds in its read BIO into rxbuf and unpack it. The
+ * records OpenSSL may produce on the way (alerts, key updates) are sent
+ * right after.
+ */
+static void _tls_membio_drain(cdk_channel_t* channel) {
+    int                 tlserr = 0;
+    cdk_channel_error_t error = {0};
+
+    while (channel->rxbuf.off < channel->rxbuf.len) {
+        int n = tls_ssl_read(
+            channel->tcp.tls_ssl,
+            (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
+            (int)(channel->rxbuf.len - channel->rxbuf.off),
+            &tlserr);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            _tls_membio_flush(channel);
+            _txlist_flush(channel);
+            if (atomic_load(&channel->closing)) {
+                return;
+            }
+            error.code = CHANNEL_ERROR_TLS_FAIL;
+            error.codestr = tls_error2string(tlserr);
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        channel->latest_rd_time = cdk_time_now();
+        channel->rxbuf.off += n;
+
+        if (!unpacker_unpack(channel)) {
+            error.code = CHANNEL_ERROR_BUFFER_OVERFLOW;
+            error.codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR;
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        if (atomic_load(&channel->closing)) {
+            return;
+        }
+    }
+    _tls_membio_flush(channel);
+    if (!channel_is_writing(channel) && !txlist_empty(&channel->txlist)) {
+        if (_txlist_flush(channel) < 0) {
+            return;
+        }
+        if (!txlist_empty(&channel->txlist)) {
+            channel_enable_write(channel);
+        }
+    }
+}
+
+/**
+ * Read a large chunk of ciphertext into the free part of rxbuf, hand it to
+ * OpenSSL and decrypt it back in place.
+ */
+static void _tls_membio_recv(cdk_channel_t* channel) {
+    int                 tlserr = 0;
+    cdk_channel_error_t error = {0};
+
+    if (tls_membio_fill(
+            channel->tcp.tls_ssl,
+            channel->fd,
+            (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
+            (int)(channel->rxbuf.len - channel->rxbuf.off),
+            &tlserr) < 0) {
+        error.code = CHANNEL_ERROR_TLS_FAIL;
+        error.codestr = tls_error2string(tlserr);
+
+        channel_error_update(channel, error);
+        channel_destroy(channel);
         return;
     }
+    _tls_membio_drain(channel);
+}
+
+static void _tls_recv_resume_cb(void* param) {
+    cdk_channel_t* channel = param;
+    channel_recv(channel);
+}
+
+/**
+ * OpenSSL reads whole records off the socket and may keep decrypted bytes
+ * or further records to itself, which raise no readiness event. Keep
+ * reading while it has some, up to MAX_TLS_READ_ROUNDS, then let the other
+ * channels of the poller run before coming back.
+ */
+static void _tls_recv(cdk_channel_t* channel) {
     int                 tlserr = 0;
+    cdk_channel_error_t error = {0};
+
+    for (int rounds = 0; rounds < MAX_TLS_READ_ROUNDS; rounds++) {
+        if (channel->rxbuf.off >= channel->rxbuf.len) {
+            error.code = CHANNEL_ERROR_BUFFER_OVERFLOW;
+            error.codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR;
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        int n = tls_ssl_read(
+            channel->tcp.tls_ssl,
+            (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
+            (int)(channel->rxbuf.len - channel->rxbuf.off),
+            &tlserr);
+        if (n == 0) {
+            return;
+        }
+        if (n < 0) {
+            error.code = CHANNEL_ERROR_TLS_FAIL;
+            error.codestr = tls_error2string(tlserr);
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        channel->latest_rd_time = cdk_time_now();
+        channel->rxbuf.off += n;
+
+        if (!unpacker_unpack(channel)) {
+            error.code = CHANNEL_ERROR_BUFFER_OVERFLOW;
+            error.codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR;
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        if (atomic_load(&channel->closing) ||
+            !tls_ssl_pending(channel->tcp.tls_ssl)) {
+            return;
+        }
+    }
+    cdk_net_post_event(channel->poller, _tls_recv_resume_cb, channel, true);
+}
+
+static void _channel_recv(cdk_channel_t* channel) {
+    int                 segsize = 0;
     ssize_t             n = 0;
     cdk_channel_error_t error = {0};
 
     if (channel->type == SOCK_STREAM) {
+        if (channel->rxbuf.off >= channel->rxbuf.len) {
+            error.code = CHANNEL_ERROR_BUFFER_OVERFLOW;
+            error.codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR;
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
         if (channel->tcp.tls_ssl) {
-            n = tls_ssl_read(
-                channel->tcp.tls_ssl,
-                (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
-                MAX_TCP_RECVBUF_SIZE,
-                &tlserr);
-        } else {
-            n = platform_socket_recv(
-                channel->fd,
-                (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
-                MAX_TCP_RECVBUF_SIZE);
+            if (channel->tcp.membio) {
+                _tls_membio_recv(channel);
+            } else {
+                _tls_recv(channel);
+            }
+            return;
         }
+        n = platform_socket_recv(
+            channel->fd,
+            (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
+            (int)(channel->rxbuf.len - channel->rxbuf.off));
     } else {
         if (channel->side == SIDE_CLIENT) {
-            n = platform_socket_recv(
-                channel->fd, channel->rxbuf.buf, MAX_UDP_RECVBUF_SIZE);
+            n = platform_socket_recvfrom(
+                channel->fd,
+                channel->rxbuf.buf,
+                MAX_UDP_RECVBUF_SIZE,
+                NULL,
+                NULL,
+                &segsize);
         } else {
             channel->udp.peer.sslen = sizeof(struct sockaddr_storage);
             n = platform_socket_recvfrom(
@@ -180,81 +594,236 @@ void channel_recv(cdk_channel_t* channel) {
                 channel->rxbuf.buf,
                 MAX_UDP_RECVBUF_SIZE,
                 &channel->udp.peer.ss,
-                &channel->udp.peer.sslen);
+                &channel->udp.peer.sslen,
+                &segsize);
+            /**
+             * a local address is shorter than the storage, clear what the
+             * previous peer left behind so sessions can compare it whole.
+             */
+            if (n != PLATFORM_SO_ERROR_SOCKET_ERROR &&
+                channel->udp.peer.ss.ss_family == AF_UNIX) {
+                memset(
+                    (char*)&channel->udp.peer.ss + channel->udp.peer.sslen,
+                    0,
+                    sizeof(struct sockaddr_storage) - channel->udp.peer.sslen);
+            }
         }
     }
-    if (channel->type == SOCK_STREAM && channel->tcp.tls_ssl) {
-        if (n <= 0) {
-            if (n == 0) {
-                return;
-            }
-            error.code = CHANNEL_ERROR_TLS_FAIL;
-            error.codestr = tls_error2string(tlserr);
+    if (n == PLATFORM_SO_ERROR_SOCKET_ERROR) {
+        if ((platform_socket_lasterror() == PLATFORM_SO_ERROR_EAGAIN) ||
+            (platform_socket_lasterror() == PLATFORM_SO_ERROR_EWOULDBLOCK)) {
+            return;
+        }
+        error.code = CHANNEL_ERROR_SYSCALL_FAIL;
+        error.codestr =
+            platform_socket_error2string(platform_socket_lasterror());
+
+        channel_error_update(channel, error);
+        channel_destroy(channel);
+        return;
+    }
+    if (channel->type == SOCK_STREAM) {
+        if (n == 0) {
+            error.code = CHANNEL_ERROR_SYSCALL_FAIL;
+            error.codestr =
+                platform_socket_error2string(PLATFORM_SO_ERROR_ECONNRESET);
+
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        channel->latest_rd_time = cdk_time_now();
+        channel->rxbuf.off += n;
+
+        if (!unpacker_unpack(channel)) {
+            error.code = CHANNEL_ERROR_BUFFER_OVERFLOW;
+            error.codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR;
 
             channel_error_update(channel, error);
             channel_destroy(channel);
             return;
         }
     } else {
-        if (n == PLATFORM_SO_ERROR_SOCKET_ERROR) {
-            if ((platform_socket_lasterror() == PLATFORM_SO_ERROR_EAGAIN) ||
-                (platform_socket_lasterror() ==
-                 PLATFORM_SO_ERROR_EWOULDBLOCK)) {
-                return;
+        /**
+         * With UDP_GRO the kernel may hand us several datagrams of segsize
+         * bytes glued together (the last one may be shorter), split them
+         * back before dispatching.
+         */
+        char*   dgram = channel->rxbuf.buf;
+        ssize_t left = n;
+        ssize_t seg = (segsize > 0) ? segsize : n;
+        do {
+            ssize_t len = (left < seg) ? left : seg;
+            if (!_dgram_dispatch(channel, dgram, len)) {
+                break;
             }
-            error.code = CHANNEL_ERROR_SYSCALL_FAIL;
-            error.codestr =
-                platform_socket_error2string(platform_socket_lasterror());
+            dgram += len;
+            left -= len;
+        } while (left > 0);
+    }
+}
 
+void channel_recv(cdk_channel_t* channel) {
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    if (channel->type == SOCK_STREAM && channel->tcp.lowmem) {
+        if (_rxbuf_acquire(channel)) {
+            _channel_recv(channel);
+            _rxbuf_trim(channel);
+        }
+        return;
+    }
+    _channel_recv(channel);
+}
+
+void channel_memory(cdk_channel_t* channel, cdk_channel_memory_t* usage) {
+    usage->rxbuf = channel->rxbuf.buf ? channel->rxbuf.len : 0;
+    usage->txbuf = txlist_size(&channel->txlist);
+    if (channel->type == SOCK_STREAM) {
+        usage->tls = tls_ssl_memory(channel->tcp.tls_ssl);
+    } else {
+        usage->tls = tls_ssl_memory(channel->udp.dtls.ssl);
+    }
+}
+
+void channel_accepted(cdk_channel_t* channel) {
+    if (channel->type == SOCK_STREAM) {
+        _conn_timer_destroy(channel);
+        if (channel_is_writing(channel)) {
+            channel_disable_write(channel);
+        }
+    }
+    if (channel->handler->on_accept && !_websocket_enabled(channel)) {
+        channel->handler->on_accept(channel);
+    }
+    if (!channel_is_reading(channel)) {
+        channel_enable_read(channel);
+    }
+    channel_timers_create(channel);
+}
+
+/**
+ * Run one step of the handshake, which may be on a worker thread. Returns 1
+ * once the handshake is done, 0 if it would block and -1 on failure.
+ */
+static int _tls_handshake_step(cdk_channel_t* channel, int* err) {
+    if (channel->tcp.membio &&
+        tls_membio_fill(
+            channel->tcp.tls_ssl,
+            channel->fd,
+            (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
+            (int)(channel->rxbuf.len - channel->rxbuf.off),
+            err) < 0) {
+        return -1;
+    }
+    if (channel->side == SIDE_CLIENT) {
+        return tls_connect(channel->tcp.tls_ssl, channel->fd, err);
+    }
+    /**
+     * Early data has to be drained before the handshake is resumed, it is
+     * kept in rxbuf until the channel is announced by on_accept.
+     */
+    while (channel->tcp.earlydata) {
+        bool finished = false;
+        int  n = tls_read_early_data(
+            channel->tcp.tls_ssl,
+            channel->fd,
+            (char*)(channel->rxbuf.buf) + channel->rxbuf.off,
+            (int)(channel->rxbuf.len - channel->rxbuf.off),
+            &finished,
+            err);
+        if (n < 0) {
+            return -1;
+        }
+        if (!n && !finished) {
+            return 0;
+        }
+        channel->rxbuf.off += n;
+        if (finished) {
+            channel->tcp.earlydata = false;
+        }
+    }
+    return tls_accept(channel->tcp.tls_ssl, channel->fd, err);
+}
+
+static void _tls_handshake_complete(cdk_channel_t* channel, int n, int err) {
+    /**
+     * With memory BIOs the handshake messages, or the alert of a failed
+     * handshake, are still to be sent.
+     */
+    if (channel->tcp.membio) {
+        _tls_membio_flush(channel);
+        if (_txlist_flush(channel) < 0) {
+            return;
+        }
+    }
+    if (n <= 0) {
+        if (n == 0) {
+            _tls_handshake_wait(
+                channel,
+                tls_want_write(err) || !txlist_empty(&channel->txlist));
+            _rxbuf_trim(channel);
+            return;
+        }
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_TLS_FAIL, .codestr = tls_error2string(err)};
+        channel_error_update(channel, error);
+        channel_destroy(channel);
+        return;
+    }
+    channel->tcp.handshaking = false;
+    channel->tcp.ktls_tx = tls_ktls_tx(channel->tcp.tls_ssl);
+    if (channel->side == SIDE_CLIENT) {
+        channel_connected(channel);
+    } else {
+        channel_accepted(channel);
+    }
+    if (channel->side == SIDE_SERVER && channel->rxbuf.off &&
+        !atomic_load(&channel->closing)) {
+        if (!unpacker_unpack(channel)) {
+            cdk_channel_error_t error = {
+                .code = CHANNEL_ERROR_BUFFER_OVERFLOW,
+                .codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR};
             channel_error_update(channel, error);
             channel_destroy(channel);
             return;
         }
     }
-    if (channel->type == SOCK_STREAM) {
-        if (!channel->tcp.tls_ssl) {
-            if (n == 0) {
-                error.code = CHANNEL_ERROR_SYSCALL_FAIL;
-                error.codestr =
-                    platform_socket_error2string(PLATFORM_SO_ERROR_ECONNRESET);
-
-                channel_error_update(channel, error);
-                channel_destroy(channel);
-                return;
-            }
-        }
-        channel->latest_rd_time = cdk_time_now();
-        channel->rxbuf.off += n;
+    /**
+     * Records that came in with the last handshake flight are already in the
+     * read BIO, the socket will not signal them again.
+     */
+    if (channel->tcp.membio && !atomic_load(&channel->closing)) {
+        _tls_membio_drain(channel);
+    }
+    _rxbuf_trim(channel);
+}
 
-        if (!unpacker_unpack(channel)) {
-            error.code = CHANNEL_ERROR_BUFFER_OVERFLOW;
-            error.codestr = CHANNEL_ERROR_BUFFER_OVERFLOW_STR;
+static void _tls_handshake_resume(void* param) {
+    channel_handshake_ctx_t* ctx = param;
+    cdk_channel_t*           channel = ctx->channel;
 
-            channel_error_update(channel, error);
-            channel_destroy(channel);
-            return;
-        }
+    channel->tcp.offloading = false;
+    if (atomic_load(&channel->closing)) {
+        _channel_release(channel);
     } else {
-        channel->latest_rd_time = cdk_time_now();
-        if (channel->handler->on_read) {
-            channel->handler->on_read(channel, channel->rxbuf.buf, n);
-        }
+        _tls_handshake_complete(channel, ctx->n, ctx->err);
     }
+    free(ctx);
 }
 
-void channel_accepted(cdk_channel_t* channel) {
-    if (channel->handler->on_accept) {
-        channel->handler->on_accept(channel);
-    }
-    if (!channel_is_reading(channel)) {
-        channel_enable_read(channel);
-    }
-    channel_timers_create(channel);
+static void _tls_handshake_offloaded(void* param) {
+    channel_handshake_ctx_t* ctx = param;
+    cdk_poller_t*            poller = ctx->channel->poller;
+
+    ctx->n = _tls_handshake_step(ctx->channel, &ctx->err);
+    cdk_net_post_event(poller, _tls_handshake_resume, ctx, true);
+    atomic_fetch_sub(&poller->offloads, 1);
 }
 
-void channel_tls_cli_handshake(void* param) {
-    int            err = 0;
-    cdk_channel_t* channel = param;
+static void _tls_handshake(cdk_channel_t* channel) {
+    int err = 0;
     /**
      * If the TLS connection times out, the connection timer will destroy the
      * channel and release the SSL. If we don't check whether the channel is
@@ -264,21 +833,35 @@ void channel_tls_cli_handshake(void* param) {
     if (atomic_load(&channel->closing)) {
         return;
     }
-    int n = tls_connect(channel->tcp.tls_ssl, channel->fd, &err);
-    if (n <= 0) {
-        if (n == 0) {
-            cdk_net_post_event(
-                channel->poller, channel_tls_cli_handshake, channel, true);
+    if (!_rxbuf_acquire(channel)) {
+        return;
+    }
+    if (channel->tcp.offload && channel->poller->active) {
+        channel_handshake_ctx_t* ctx = malloc(sizeof(channel_handshake_ctx_t));
+        if (ctx) {
+            ctx->channel = channel;
+            ctx->n = 0;
+            ctx->err = 0;
+            /**
+             * The SSL belongs to the worker until _tls_handshake_resume runs
+             * on the poller again, so the socket must not be dispatched in
+             * the meantime.
+             */
+            channel_disable_all(channel);
+            channel->tcp.handshaking = true;
+            channel->tcp.offloading = true;
+            atomic_fetch_add(&channel->poller->offloads, 1);
+            cdk_thrdpool_post(
+                &global_net_engine.thrdpool, _tls_handshake_offloaded, ctx);
             return;
         }
-        cdk_channel_error_t error = {
-            .code = CHANNEL_ERROR_TLS_FAIL, .codestr = tls_error2string(err)};
-        channel_error_update(channel, error);
-
-        channel_destroy(channel);
-        return;
     }
-    channel_connected(channel);
+    int n = _tls_handshake_step(channel, &err);
+    _tls_handshake_complete(channel, n, err);
+}
+
+void channel_tls_cli_handshake(void* param) {
+    _tls_handshake(param);
 }
 
 void channel_error_update(cdk_channel_t* channel, cdk_channel_error_t error) {
@@ -287,26 +870,7 @@ void channel_error_update(cdk_channel_t* channel, cdk_channel_error_t error) {
 }
 
 void channel_tls_srv_handshake(void* param) {
-    int            err = 0;
-    cdk_channel_t* channel = param;
-
-    if (atomic_load(&channel->closing)) {
-        return;
-    }
-    int n = tls_accept(channel->tcp.tls_ssl, channel->fd, &err);
-    if (n <= 0) {
-        if (n == 0) {
-            cdk_net_post_event(
-                channel->poller, channel_tls_srv_handshake, channel, true);
-            return;
-        }
-        cdk_channel_error_t error = {
-            .code = CHANNEL_ERROR_TLS_FAIL, .codestr = tls_error2string(err)};
-        channel_error_update(channel, error);
-        channel_destroy(channel);
-        return;
-    }
-    channel_accepted(channel);
+    _tls_handshake(param);
 }
 
 cdk_channel_t* channel_create(
@@ -323,21 +887,47 @@ cdk_channel_t* channel_create(
         channel->poller = poller;
         channel->fd = sock;
         channel->handler = handler;
+        unpacker_init(channel);
         channel->type = platform_socket_getsocktype(sock);
         atomic_init(&channel->closing, false);
         txlist_create(&channel->txlist);
         channel->mode = mode;
         channel->side = side;
 
-        if (channel->type == SOCK_STREAM) {
+        if (channel->type == SOCK_STREAM && tlsctx) {
+            channel->tcp.lowmem = tls_lowmem_enabled(tlsctx);
+        }
+        /**
+         * A lowmem channel only takes a receive buffer when it has something
+         * to read, see _rxbuf_acquire.
+         */
+        if (channel->type == SOCK_STREAM && !channel->tcp.lowmem) {
             channel->rxbuf.len = MAX_TCP_RECVBUF_SIZE;
-        } else {
+        }
+        if (channel->type == SOCK_DGRAM) {
             channel->rxbuf.len = MAX_UDP_RECVBUF_SIZE;
         }
         channel->rxbuf.off = 0;
-        channel->rxbuf.buf = malloc(channel->rxbuf.len);
-        if (channel->rxbuf.buf) {
-            memset(channel->rxbuf.buf, 0, channel->rxbuf.len);
+        if (channel->rxbuf.len) {
+            channel->rxbuf.buf = malloc(channel->rxbuf.len);
+            if (channel->rxbuf.buf) {
+                memset(channel->rxbuf.buf, 0, channel->rxbuf.len);
+            }
+        }
+        if (channel->type == SOCK_DGRAM) {
+            if (handler->gro) {
+                platform_socket_gro(sock, true);
+            }
+            if (tlsctx) {
+                if (channel->mode == CHANNEL_MODE_ACCEPT ||
+                    channel->mode == CHANNEL_MODE_CONNECT) {
+                    channel->udp.dtls.ctx = tlsctx;
+                }
+                if (channel->mode == CHANNEL_MODE_CONNECT) {
+                    channel->udp.dtls.ssl = tls_dgram_ssl_create(
+                        tlsctx, SIDE_CLIENT, &channel->udp.peer.ss);
+                }
+            }
         }
         if (channel->type == SOCK_STREAM) {
             if (tlsctx) {
@@ -349,6 +939,12 @@ cdk_channel_t* channel_create(
                     channel->mode == CHANNEL_MODE_NORMAL) {
                     channel->tcp.tls_ssl = tls_ssl_create(tlsctx);
                 }
+                if (channel->mode == CHANNEL_MODE_NORMAL &&
+                    channel->side == SIDE_SERVER) {
+                    channel->tcp.earlydata = tls_early_data_enabled(tlsctx);
+                }
+                channel->tcp.offload = tls_offload_enabled(tlsctx);
+                channel->tcp.membio = tls_membio_enabled(tlsctx);
             }
         }
         cdk_list_insert_tail(&poller->chlist, &channel->node);
@@ -363,6 +959,17 @@ void channel_destroy(cdk_channel_t* channel) {
     }
     atomic_store(&channel->closing, true);
     channel_disable_all(channel);
+    /**
+     * A worker is still running a handshake step on the SSL and the socket,
+     * the channel is released once the step is handed back to the poller.
+     */
+    if (channel->type == SOCK_STREAM && channel->tcp.offloading) {
+        return;
+    }
+    _channel_release(channel);
+}
+
+static void _channel_release(cdk_channel_t* channel) {
     /**
      * Note: The SSL connection must be closed before the socket file descriptor
      * is closed. This is because when SSL_shutdown is called, it relies on the
@@ -375,22 +982,51 @@ void channel_destroy(cdk_channel_t* channel) {
     if (channel->type == SOCK_STREAM) {
         if (channel->mode == CHANNEL_MODE_CONNECT ||
             channel->mode == CHANNEL_MODE_NORMAL) {
+            if (channel->tcp.membio && channel->tcp.tls_ssl) {
+                tls_membio_shutdown(channel->tcp.tls_ssl, channel->fd);
+            }
             tls_ssl_destroy(channel->tcp.tls_ssl);
         }
         if (channel->mode == CHANNEL_MODE_ACCEPT ||
             channel->mode == CHANNEL_MODE_CONNECT) {
             tls_ctx_destroy(channel->tcp.tls_ctx);
         }
+    } else {
+        dtls_destroy(channel);
+    }
+    /**
+     * A session shares the socket of its server channel, only the server
+     * channel may close it, after all of its sessions are gone.
+     */
+    if (session_is(channel)) {
+        session_remove(channel);
+    } else {
+        if (channel->type == SOCK_DGRAM && channel->udp.sessions.buckets) {
+            session_destroy_all(channel);
+        }
+        /* the path of a local listener goes with it. */
+        if (channel->mode == CHANNEL_MODE_ACCEPT) {
+            platform_socket_unix_unlink(channel->fd);
+        }
+        platform_socket_close(channel->fd);
     }
-    platform_socket_close(channel->fd);
     cdk_list_remove(&channel->node);
     txlist_destroy(&channel->txlist);
 
-    free(channel->rxbuf.buf);
+    if (channel->type == SOCK_STREAM && channel->tcp.lowmem &&
+        channel->rxbuf.buf) {
+        poller_rxbuf_release(channel->poller, channel->rxbuf.buf);
+    } else {
+        free(channel->rxbuf.buf);
+    }
     channel->rxbuf.buf = NULL;
     channel->rxbuf.len = 0;
     channel->rxbuf.off = 0;
 
+    if (channel->type == SOCK_STREAM && channel->handler->unpacker &&
+        channel->handler->unpacker->type == UNPACKER_TYPE_RPC) {
+        rpc_abort_all(channel);
+    }
     cdk_net_post_event(
         channel->poller, _async_channel_timers_destroy_cb, channel, true);
 
@@ -409,39 +1045,39 @@ void channel_send(cdk_channel_t* channel) {
     if (atomic_load(&channel->closing)) {
         return;
     }
+    if (channel->type == SOCK_DGRAM && channel->udp.sessions.buckets) {
+        session_send(channel);
+        return;
+    }
     if (txlist_empty(&channel->txlist)) {
         if (channel_is_writing(channel)) {
             channel_disable_write(channel);
         }
         return;
     }
-    txlist_node_t* e =
-        cdk_list_data(cdk_list_head(&(channel->txlist)), txlist_node_t, n);
-
     int tlserr = 0;
     ssize_t n = 0;
     cdk_channel_error_t error = {0};
-    
-    if (channel->type == SOCK_STREAM) {
-        if (channel->tcp.tls_ssl) {
-            n = tls_ssl_write(
-                channel->tcp.tls_ssl, e->buf, (int)e->len, &tlserr);
-        } else {
-            n = platform_socket_send(channel->fd, e->buf, (int)e->len);
+
+    /**
+     * Bytes meant for the socket as they are go out in one gathered write.
+     */
+    if (channel->type == SOCK_STREAM && !_tls_write_through(channel)) {
+        n = _txlist_flush(channel);
+        if (n > 0 && channel->handler->on_write) {
+            channel->handler->on_write(channel);
         }
+        return;
+    }
+    txlist_node_t* e =
+        cdk_list_data(cdk_list_head(&channel->txlist.list), txlist_node_t, n);
+
+    if (channel->type == SOCK_STREAM) {
+        n = tls_ssl_write(channel->tcp.tls_ssl, e->buf, (int)e->len, &tlserr);
     } else {
-        if (channel->side == SIDE_CLIENT) {
-            n = platform_socket_send(channel->fd, e->buf, (int)e->len);
-        } else {
-            n = platform_socket_sendto(
-                channel->fd,
-                e->buf,
-                (int)e->len,
-                &(channel->udp.peer.ss),
-                channel->udp.peer.sslen);
-        }
+        n = channel_sendto(channel, e->buf, e->len, e->segsize);
     }
-    if (channel->type == SOCK_STREAM && channel->tcp.tls_ssl) {
+    if (channel->type == SOCK_STREAM) {
         if (n <= 0) {
             if (n == 0) {
                 return;
@@ -469,16 +1105,47 @@ void channel_send(cdk_channel_t* channel) {
             return;
         }
     }
-    if (channel->type == SOCK_STREAM) {
-        if (n < e->len) {
+    /**
+     * For UDP, a partial write only happens when a segmented (GSO) send was
+     * interrupted by a full socket buffer, n is then a whole number of
+     * segments and the rest is sent on the next writable event.
+     */
+    if (n < e->len) {
+        txlist_node_t* rest =
             txlist_insert(&channel->txlist, e->buf + n, (e->len - n), false);
+        if (rest) {
+            rest->segsize = e->segsize;
         }
     }
     channel->latest_wr_time = cdk_time_now();
+    txlist_remove(&channel->txlist, e);
     if (n > 0 && channel->handler->on_write) {
         channel->handler->on_write(channel);
     }
-    txlist_remove(e);
+}
+
+static void _accepted_channel_create(void* param) {
+    channel_accept_ctx_t* ctx = param;
+
+    cdk_channel_t* nchannel = channel_create(
+        ctx->poller,
+        ctx->sock,
+        CHANNEL_MODE_NORMAL,
+        SIDE_SERVER,
+        ctx->handler,
+        ctx->tlsctx);
+    tls_ctx_destroy(ctx->tlsctx);
+    if (nchannel) {
+        if (nchannel->tcp.tls_ssl) {
+            channel_conn_timer_create(nchannel);
+            channel_tls_srv_handshake(nchannel);
+        } else {
+            channel_accepted(nchannel);
+        }
+    } else {
+        platform_socket_close(ctx->sock);
+    }
+    free(ctx);
 }
 
 void channel_accepting(cdk_channel_t* channel) {
@@ -499,27 +1166,28 @@ void channel_accepting(cdk_channel_t* channel) {
         channel_destroy(channel);
         return;
     }
-    cdk_channel_t* nchannel = channel_create(
-        global_net_engine.poller_roundrobin(),
-        cli,
-        CHANNEL_MODE_NORMAL,
-        SIDE_SERVER,
-        channel->handler,
-        channel->tcp.tls_ctx);
-    if (nchannel) {
-        if (nchannel->tcp.tls_ssl) {
-            channel_tls_srv_handshake(nchannel);
-        } else {
-            channel_accepted(nchannel);
-        }
+    channel_accept_ctx_t* ctx = malloc(sizeof(channel_accept_ctx_t));
+    if (!ctx) {
+        platform_socket_close(cli);
+        return;
+    }
+    ctx->poller = global_net_engine.poller_roundrobin();
+    ctx->sock = cli;
+    ctx->handler = channel->handler;
+    ctx->tlsctx = tls_ctx_ref(channel->tcp.tls_ctx);
+    /**
+     * The channel, its handshake and its callbacks all belong to the poller
+     * it is assigned to, which may not be the accepting one.
+     */
+    if (thrd_equal(ctx->poller->tid, thrd_current())) {
+        _accepted_channel_create(ctx);
+    } else {
+        cdk_net_post_event(ctx->poller, _accepted_channel_create, ctx, true);
     }
 }
 
 void channel_connecting(cdk_channel_t* channel) {
     if (atomic_load(&channel->closing)) {
-        if (channel->handler->conn_timeout) {
-            cdk_timer_del(channel->poller->timermgr, channel->tcp.conn_timer);
-        }
         return;
     }
     int       err = 0;
@@ -543,6 +1211,11 @@ void channel_connecting(cdk_channel_t* channel) {
 }
 
 void channel_enable_write(cdk_channel_t* channel) {
+    if (session_is(channel)) {
+        session_enable_write(channel);
+        channel->events |= EVENT_WR;
+        return;
+    }
     if (channel->events) {
         platform_event_mod(
             channel->poller->pfd,
@@ -560,6 +1233,10 @@ void channel_enable_write(cdk_channel_t* channel) {
 }
 
 void channel_enable_read(cdk_channel_t* channel) {
+    if (session_is(channel)) {
+        channel->events |= EVENT_RD;
+        return;
+    }
     if (channel->events) {
         platform_event_mod(
             channel->poller->pfd,
@@ -577,7 +1254,14 @@ void channel_enable_read(cdk_channel_t* channel) {
 }
 
 void channel_disable_write(cdk_channel_t* channel) {
-    if (channel->events) {
+    if (session_is(channel)) {
+        if (channel->events & EVENT_WR) {
+            session_disable_write(channel);
+        }
+        channel->events &= ~EVENT_WR;
+        return;
+    }
+    if (channel->events & ~EVENT_WR) {
         platform_event_mod(
             channel->poller->pfd,
             channel->fd,
@@ -590,7 +1274,11 @@ void channel_disable_write(cdk_channel_t* channel) {
 }
 
 void channel_disable_read(cdk_channel_t* channel) {
-    if (channel->events) {
+    if (session_is(channel)) {
+        channel->events &= ~EVENT_RD;
+        return;
+    }
+    if (channel->events & ~EVENT_RD) {
         platform_event_mod(
             channel->poller->pfd,
             channel->fd,
@@ -603,6 +1291,13 @@ void channel_disable_read(cdk_channel_t* channel) {
 }
 
 void channel_disable_all(cdk_channel_t* channel) {
+    if (session_is(channel)) {
+        if (channel->events & EVENT_WR) {
+            session_disable_write(channel);
+        }
+        channel->events = 0;
+        return;
+    }
     platform_event_del(channel->poller->pfd, channel->fd);
     channel->events = 0;
 }
@@ -615,38 +1310,132 @@ bool channel_is_reading(cdk_channel_t* channel) {
     return channel->events & EVENT_RD;
 }
 
+ssize_t channel_sendto(
+    cdk_channel_t* channel, void* data, size_t size, int segsize) {
+    /**
+     * Sessions share the socket of their server channel, and so whether the
+     * kernel takes UDP_SEGMENT on it.
+     */
+    cdk_channel_t* owner =
+        session_is(channel) ? channel->udp.sessions.parent : channel;
+
+    if (channel->side == SIDE_CLIENT) {
+        return platform_socket_sendto(
+            channel->fd, data, (int)size, NULL, 0, segsize, &owner->udp.nogso);
+    }
+    return platform_socket_sendto(
+        channel->fd,
+        data,
+        (int)size,
+        &(channel->udp.peer.ss),
+        channel->udp.peer.sslen,
+        segsize,
+        &owner->udp.nogso);
+}
+
+void channel_dgram_send(
+    cdk_channel_t* channel, void* data, size_t size, int segsize) {
+    ssize_t             n = 0;
+    cdk_channel_error_t error = {0};
+
+    if (txlist_empty(&channel->txlist)) {
+        n = channel_sendto(channel, data, size, segsize);
+        if (n == PLATFORM_SO_ERROR_SOCKET_ERROR) {
+            if ((platform_socket_lasterror() != PLATFORM_SO_ERROR_EAGAIN) &&
+                (platform_socket_lasterror() !=
+                 PLATFORM_SO_ERROR_EWOULDBLOCK)) {
+                error.code = CHANNEL_ERROR_SYSCALL_FAIL;
+                error.codestr =
+                    platform_socket_error2string(platform_socket_lasterror());
+
+                channel_error_update(channel, error);
+                channel_destroy(channel);
+                return;
+            }
+            n = 0;
+        }
+    }
+    if ((size_t)n < size) {
+        txlist_node_t* e = txlist_insert(
+            &channel->txlist, (char*)data + n, (size - n), true);
+        if (e) {
+            e->segsize = segsize;
+        }
+        if (!channel_is_writing(channel)) {
+            channel_enable_write(channel);
+        }
+    }
+    if (n > 0) {
+        channel->latest_wr_time = cdk_time_now();
+    }
+}
+
 void channel_explicit_send(cdk_channel_t* channel, void* data, size_t size) {
     if (atomic_load(&channel->closing)) {
         return;
     }
     int                 tlserr = 0;
+    int                 segsize = 0;
     ssize_t             n = 0;
     cdk_channel_error_t error = {0};
+    txlist_node_t*      e = NULL;
 
+    if (channel->type == SOCK_DGRAM) {
+        if (channel->udp.dtls.ssl) {
+            if (dtls_send(channel, data, size) && channel->handler->on_write) {
+                cdk_net_post_event(
+                    channel->poller, _write_complete_cb, channel, true);
+            }
+            return;
+        }
+        segsize = channel->handler->gso_segment;
+    }
+    if (channel->type == SOCK_STREAM && channel->tcp.membio &&
+        channel->tcp.tls_ssl) {
+        if (tls_ssl_write(channel->tcp.tls_ssl, data, size, &tlserr) <= 0) {
+            error.code = CHANNEL_ERROR_TLS_FAIL;
+            error.codestr = tls_error2string(tlserr);
+            channel_error_update(channel, error);
+
+            channel_destroy(channel);
+            return;
+        }
+        _tls_membio_flush(channel);
+        if (channel_is_writing(channel)) {
+            return;
+        }
+        n = _txlist_flush(channel);
+        if (n < 0) {
+            return;
+        }
+        if (!txlist_empty(&channel->txlist)) {
+            channel_enable_write(channel);
+        }
+        if (n > 0 && channel->handler->on_write) {
+            cdk_net_post_event(
+                channel->poller, _write_complete_cb, channel, true);
+        }
+        return;
+    }
     if (txlist_empty(&channel->txlist)) {
         if (channel->type == SOCK_STREAM) {
-            if (channel->tcp.tls_ssl) {
+            if (channel->tcp.tls_ssl && !channel->tcp.ktls_tx) {
                 n = tls_ssl_write(channel->tcp.tls_ssl, data, size, &tlserr);
             } else {
                 n = platform_socket_send(channel->fd, data, size);
             }
         } else {
-            if (channel->side == SIDE_CLIENT) {
-                n = platform_socket_send(channel->fd, data, size);
-            } else {
-                n = platform_socket_sendto(
-                    channel->fd,
-                    data,
-                    size,
-                    &(channel->udp.peer.ss),
-                    channel->udp.peer.sslen);
-            }
+            n = channel_sendto(channel, data, size, segsize);
         }
     }
-    if (channel->type == SOCK_STREAM && channel->tcp.tls_ssl) {
+    if (channel->type == SOCK_STREAM && channel->tcp.tls_ssl &&
+        !channel->tcp.ktls_tx) {
         if (n <= 0) {
             if (n == 0) {
-                txlist_insert(&channel->txlist, data, size, true);
+                e = txlist_insert(&channel->txlist, data, size, true);
+                if (e) {
+                    e->segsize = segsize;
+                }
                 if (!channel_is_writing(channel)) {
                     channel_enable_write(channel);
                 }
@@ -665,7 +1454,10 @@ void channel_explicit_send(cdk_channel_t* channel, void* data, size_t size) {
                 (platform_socket_lasterror() ==
                  PLATFORM_SO_ERROR_EWOULDBLOCK)) {
 
-                txlist_insert(&channel->txlist, data, size, true);
+                e = txlist_insert(&channel->txlist, data, size, true);
+                if (e) {
+                    e->segsize = segsize;
+                }
                 if (!channel_is_writing(channel)) {
                     channel_enable_write(channel);
                 }
@@ -681,7 +1473,10 @@ void channel_explicit_send(cdk_channel_t* channel, void* data, size_t size) {
         }
     }
     if (n < size) {
-        txlist_insert(&channel->txlist, (char*)data + n, (size - n), true);
+        e = txlist_insert(&channel->txlist, (char*)data + n, (size - n), true);
+        if (e) {
+            e->segsize = segsize;
+        }
         if (!channel_is_writing(channel)) {
             channel_enable_write(channel);
         }
@@ -694,3 +1489,77 @@ void channel_explicit_send(cdk_channel_t* channel, void* data, size_t size) {
         cdk_net_post_event(channel->poller, _write_complete_cb, channel, true);
     }
 }
+
+/**
+ * Send the buffers as one gathered write where the channel writes to the
+ * socket itself. Otherwise they are joined first, so that TLS still makes a
+ * single record of them.
+ */
+void channel_explicit_sendv(
+    cdk_channel_t* channel, void** bufs, size_t* lens, int count) {
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += lens[i];
+    }
+    if (channel->type != SOCK_STREAM || count > PLATFORM_SENDV_MAX ||
+        (channel->tcp.tls_ssl && !channel->tcp.ktls_tx)) {
+        char* data = malloc(total);
+        if (!data) {
+            cdk_channel_error_t error = {
+                .code = CHANNEL_ERROR_SYSCALL_FAIL,
+                .codestr = platform_socket_error2string(ENOMEM)};
+            channel_error_update(channel, error);
+            channel_destroy(channel);
+            return;
+        }
+        for (size_t i = 0, off = 0; i < (size_t)count; off += lens[i], i++) {
+            memcpy(data + off, bufs[i], lens[i]);
+        }
+        channel_explicit_send(channel, data, total);
+        free(data);
+        return;
+    }
+    ssize_t n = 0;
+    if (txlist_empty(&channel->txlist)) {
+        n = platform_socket_sendv(channel->fd, bufs, lens, count);
+        if (n == PLATFORM_SO_ERROR_SOCKET_ERROR) {
+            if ((platform_socket_lasterror() != PLATFORM_SO_ERROR_EAGAIN) &&
+                (platform_socket_lasterror() !=
+                 PLATFORM_SO_ERROR_EWOULDBLOCK)) {
+                cdk_channel_error_t error = {
+                    .code = CHANNEL_ERROR_SYSCALL_FAIL,
+                    .codestr = platform_socket_error2string(
+                        platform_socket_lasterror())};
+                channel_error_update(channel, error);
+                channel_destroy(channel);
+                return;
+            }
+            n = 0;
+        }
+    }
+    if ((size_t)n < total) {
+        size_t skip = n;
+        for (int i = 0; i < count; i++) {
+            if (skip >= lens[i]) {
+                skip -= lens[i];
+                continue;
+            }
+            txlist_insert(
+                &channel->txlist, (char*)bufs[i] + skip, lens[i] - skip, true);
+            skip = 0;
+        }
+        if (!channel_is_writing(channel)) {
+            channel_enable_write(channel);
+        }
+        if (n == 0) {
+            return;
+        }
+    }
+    channel->latest_wr_time = cdk_time_now();
+    if (channel->handler->on_write) {
+        cdk_net_post_event(channel->poller, _write_complete_cb, channel, true);
+    }
+}
@@ -25,6 +25,15 @@ _Pragma("once")
 
 #define MAX_TCP_RECVBUF_SIZE 1048576 // 1M
 #define MAX_UDP_RECVBUF_SIZE 65535   // 64K
+#define MAX_UDP_PAYLOAD_SIZE 65507   // over IPv4
+#define MAX_TLS_READ_ROUNDS  16
+#define MAX_RXBUF_POOL_SIZE  16
+#define MAX_DGRAMBUF_POOL_SIZE 4
+#define MAX_RESP_STACK_SIZE  4096
+#define MAX_FRAME_HEADER_SIZE 64
+
+#define CHANNEL_DELAYED_DESTROY_TIME 60000
+#define SESSION_IDLE_TIMEOUT         60000
 
 #define CHANNEL_ERROR_USER_CLOSE_STR                                          \
     "Channel destroyed due to User-triggered (normal behavior)"
@@ -38,12 +47,20 @@ _Pragma("once")
     "Channel destroyed due to poller shutdown"
 #define CHANNEL_ERROR_BUFFER_OVERFLOW_STR                                     \
     "Channel destroyed due to buffer overflow"
+#define CHANNEL_ERROR_RESOLVE_FAIL_STR                                        \
+    "Channel destroyed due to name resolution failure"
+#define CHANNEL_ERROR_PROTOCOL_FAIL_STR                                       \
+    "Channel destroyed due to protocol violation"
 
     extern cdk_channel_t* channel_create(cdk_poller_t* poller, cdk_sock_t sock, cdk_channel_mode_t mode, cdk_side_t side, cdk_handler_t* handler, cdk_tls_ctx_t* tls_ctx);
 extern void channel_destroy(cdk_channel_t* channel);
 extern void channel_recv(cdk_channel_t* channel);
+extern void channel_memory(cdk_channel_t* channel, cdk_channel_memory_t* usage);
 extern void channel_send(cdk_channel_t* channel);
 extern void channel_explicit_send(cdk_channel_t* channel, void* data, size_t size);
+extern void channel_explicit_sendv(cdk_channel_t* channel, void** bufs, size_t* lens, int count);
+extern ssize_t channel_sendto(cdk_channel_t* channel, void* data, size_t size, int segsize);
+extern void channel_dgram_send(cdk_channel_t* channel, void* data, size_t size, int segsize);
 extern void channel_accepting(cdk_channel_t* channel);
 extern void channel_connecting(cdk_channel_t* channel);
 extern void channel_enable_write(cdk_channel_t* channel);
@@ -60,3 +77,4 @@ extern void channel_accepted(cdk_channel_t* channel);
 extern void channel_error_update(cdk_channel_t* channel, cdk_channel_error_t error);
 extern void channel_timers_create(cdk_channel_t* channel);
 extern void channel_timers_destroy(cdk_channel_t* channel);
+extern void channel_conn_timer_create(cdk_channel_t* channel);
@@ -0,0 +1,330 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "dtls.h"
+#include "cdk/cdk-time.h"
+#include "cdk/cdk-timer.h"
+#include "channel.h"
+#include "poller.h"
+#include "session.h"
+#include "tls.h"
+
+/**
+ * Largest datagram tls_dgram_next may return: a full record of application
+ * data with its expansion, anything else is packed up to DTLS_MTU.
+ */
+#define DTLS_MAX_PLAINTEXT 16384
+#define DTLS_MAX_DATAGRAM (DTLS_MAX_PLAINTEXT + 2048 + 13)
+#define DTLS_MAX_TRAIN MAX_UDP_PAYLOAD_SIZE
+
+static void _dtls_fail(cdk_channel_t* channel, int err) {
+    cdk_channel_error_t error = {
+        .code = CHANNEL_ERROR_TLS_FAIL, .codestr = tls_error2string(err)};
+
+    channel_error_update(channel, error);
+    channel_destroy(channel);
+}
+
+static void _dtls_emit(
+    cdk_channel_t* channel,
+    char*          train,
+    size_t         len,
+    int            segsize,
+    bool           besteffort) {
+    if (besteffort) {
+        channel_sendto(channel, train, len, segsize);
+    } else {
+        channel_dgram_send(channel, train, len, segsize);
+    }
+}
+
+/**
+ * Send out every record OpenSSL produced. Datagrams of the same size (the
+ * last one may be shorter) are gathered into a train and handed to the
+ * socket in a single call, which uses UDP_SEGMENT where available. When
+ * besteffort is set nothing is queued, for the records of the listening SSL
+ * and the close_notify of a channel being released.
+ *
+ * The train lives in a buffer of the poller, without one the records wait
+ * in wbio for the next flush.
+ */
+static void _dtls_flush(cdk_channel_t* channel, bool besteffort) {
+    cdk_poller_t* poller = channel->poller;
+    char*         train = poller_dgrambuf_acquire(poller);
+    size_t        off = 0;
+    int           segsize = 0;
+
+    if (!train) {
+        return;
+    }
+    while (!atomic_load(&channel->closing) || besteffort) {
+        if (DTLS_MAX_TRAIN - off < DTLS_MAX_DATAGRAM) {
+            _dtls_emit(channel, train, off, segsize, besteffort);
+            off = 0;
+        }
+        int n = tls_dgram_next(
+            channel->udp.dtls.ssl, train + off, (int)(DTLS_MAX_TRAIN - off));
+        if (n <= 0) {
+            break;
+        }
+        if (!off) {
+            segsize = n;
+            off = n;
+            continue;
+        }
+        if (n == segsize) {
+            off += n;
+            continue;
+        }
+        if (n < segsize) {
+            off += n;
+            _dtls_emit(channel, train, off, segsize, besteffort);
+            off = 0;
+            continue;
+        }
+        _dtls_emit(channel, train, off, segsize, besteffort);
+        memmove(train, train + off, n);
+        segsize = n;
+        off = n;
+    }
+    if (off && (!atomic_load(&channel->closing) || besteffort)) {
+        _dtls_emit(channel, train, off, segsize, besteffort);
+    }
+    poller_dgrambuf_release(poller, train);
+}
+
+static void _dtls_timeout_cb(void* param);
+
+static void _dtls_timer_update(cdk_channel_t* channel) {
+    int timeout = tls_dgram_timeout(channel->udp.dtls.ssl);
+
+    if (timeout < 0) {
+        if (channel->udp.dtls.timer) {
+            cdk_timer_del(channel->poller->timermgr, channel->udp.dtls.timer);
+            channel->udp.dtls.timer = NULL;
+        }
+        return;
+    }
+    if (channel->udp.dtls.timer) {
+        cdk_timer_reset(
+            channel->poller->timermgr, channel->udp.dtls.timer, timeout);
+    } else {
+        channel->udp.dtls.timer = cdk_timer_add(
+            channel->poller->timermgr,
+            _dtls_timeout_cb,
+            channel,
+            timeout,
+            false);
+    }
+}
+
+static void _dtls_handshake(cdk_channel_t* channel) {
+    int err = 0;
+    int ret = tls_dgram_handshake(channel->udp.dtls.ssl, &err);
+
+    _dtls_flush(channel, false);
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    if (ret < 0) {
+        _dtls_fail(channel, err);
+        return;
+    }
+    _dtls_timer_update(channel);
+    if (ret == 0) {
+        return;
+    }
+    channel->udp.dtls.handshaking = false;
+    if (channel->side == SIDE_CLIENT) {
+        channel_connected(channel);
+    } else {
+        channel_accepted(channel);
+    }
+}
+
+/**
+ * Retransmit the last flight, OpenSSL gives the handshake up after too many
+ * attempts and the channel is then destroyed.
+ */
+static void _dtls_timeout_cb(void* param) {
+    cdk_channel_t* channel = param;
+
+    channel->udp.dtls.timer = NULL;
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    if (tls_dgram_handle_timeout(channel->udp.dtls.ssl) < 0) {
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_CONN_TIMEOUT,
+            .codestr = CHANNEL_ERROR_CONN_TIMEOUT_STR};
+
+        channel_error_update(channel, error);
+        channel_destroy(channel);
+        return;
+    }
+    _dtls_flush(channel, false);
+    if (!atomic_load(&channel->closing)) {
+        _dtls_timer_update(channel);
+    }
+}
+
+void dtls_listen(cdk_channel_t* channel, void* dgram, size_t len) {
+    if (!channel->udp.dtls.ssl) {
+        channel->udp.dtls.ssl = tls_dgram_ssl_create(
+            channel->udp.dtls.ctx, SIDE_SERVER, &channel->udp.peer.ss);
+        if (!channel->udp.dtls.ssl) {
+            return;
+        }
+    }
+    tls_membio_feed(channel->udp.dtls.ssl, dgram, len);
+    int ret = tls_dgram_listen(channel->udp.dtls.ssl);
+    /**
+     * The HelloVerifyRequest carrying the cookie, if any. The server keeps
+     * no state for the peer until the cookie comes back, so it is not queued
+     * either.
+     */
+    _dtls_flush(channel, true);
+    if (ret < 0) {
+        tls_ssl_destroy(channel->udp.dtls.ssl);
+        channel->udp.dtls.ssl = NULL;
+        return;
+    }
+    if (ret == 0) {
+        return;
+    }
+    cdk_channel_t* session = session_create(
+        channel, &channel->udp.peer.ss, channel->udp.peer.sslen);
+    if (!session) {
+        tls_ssl_destroy(channel->udp.dtls.ssl);
+        channel->udp.dtls.ssl = NULL;
+        return;
+    }
+    session->udp.dtls.ssl = channel->udp.dtls.ssl;
+    session->udp.dtls.handshaking = true;
+    channel->udp.dtls.ssl = NULL;
+    tls_dgram_peer_set(session->udp.dtls.ssl, &session->udp.peer.ss);
+
+    session->latest_rd_time = cdk_time_now();
+    _dtls_handshake(session);
+}
+
+void dtls_connect(cdk_channel_t* channel) {
+    if (!channel_is_reading(channel)) {
+        channel_enable_read(channel);
+    }
+    channel->udp.dtls.handshaking = true;
+    _dtls_handshake(channel);
+}
+
+void dtls_recv(cdk_channel_t* channel, void* dgram, size_t len) {
+    cdk_poller_t* poller = channel->poller;
+    char*         buf = NULL;
+    int           err = 0;
+
+    tls_membio_feed(channel->udp.dtls.ssl, dgram, len);
+    if (channel->udp.dtls.handshaking) {
+        _dtls_handshake(channel);
+        if (atomic_load(&channel->closing) || channel->udp.dtls.handshaking) {
+            return;
+        }
+    }
+    /**
+     * Left in rbio when no buffer can be had, the next datagram reads it.
+     */
+    buf = poller_dgrambuf_acquire(poller);
+    if (!buf) {
+        return;
+    }
+    while (!atomic_load(&channel->closing)) {
+        int n = tls_ssl_read(
+            channel->udp.dtls.ssl, buf, DTLS_MAX_DATAGRAM, &err);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            poller_dgrambuf_release(poller, buf);
+            _dtls_fail(channel, err);
+            return;
+        }
+        if (channel->handler->on_read) {
+            channel->handler->on_read(channel, buf, n);
+        }
+    }
+    poller_dgrambuf_release(poller, buf);
+    /**
+     * Reading may answer the peer too, e.g. by retransmitting the last
+     * handshake flight when the peer did not get it.
+     */
+    _dtls_flush(channel, false);
+}
+
+bool dtls_send(cdk_channel_t* channel, void* data, size_t size) {
+    int    err = 0;
+    size_t seg = channel->handler->gso_segment;
+    size_t off = 0;
+
+    if (!size) {
+        return true;
+    }
+    if (!seg || seg > DTLS_MAX_PLAINTEXT) {
+        seg = DTLS_MAX_PLAINTEXT;
+    }
+    /**
+     * Every record travels in its own datagram, so a gso_segment sized
+     * split still reaches the peer as separate messages, all sent as one
+     * train by _dtls_flush. A record can't carry more than 16K.
+     *
+     * The memory BIOs never push back, a write that doesn't complete means
+     * the session can't take application data right now, e.g. while a
+     * handshake is under way. The rest is dropped like a datagram the
+     * network lost and on_write is not called, only an error fails the
+     * channel.
+     */
+    do {
+        size_t len = ((size - off) < seg) ? (size - off) : seg;
+        int    n = tls_ssl_write(
+            channel->udp.dtls.ssl, (char*)data + off, (int)len, &err);
+        if (n < 0) {
+            _dtls_fail(channel, err);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        off += n;
+    } while (off < size);
+
+    _dtls_flush(channel, false);
+    return off == size && !atomic_load(&channel->closing);
+}
+
+void dtls_destroy(cdk_channel_t* channel) {
+    if (channel->udp.dtls.ssl) {
+        tls_dgram_shutdown(channel->udp.dtls.ssl);
+        _dtls_flush(channel, true);
+        tls_ssl_destroy(channel->udp.dtls.ssl);
+        channel->udp.dtls.ssl = NULL;
+    }
+    if (channel->mode == CHANNEL_MODE_ACCEPT ||
+        channel->mode == CHANNEL_MODE_CONNECT) {
+        tls_ctx_destroy(channel->udp.dtls.ctx);
+    }
+}
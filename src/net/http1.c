@@ -0,0 +1,450 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "http1.h"
+#include "simd.h"
+
+#define HTTP1_MAX_CHUNK_LINE 1024
+
+static inline bool _is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline bool _frame_equal(cdk_frame_t* frame, const char* str) {
+    size_t len = strlen(str);
+    if (frame->len != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)((char*)frame->buf)[i]) != str[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Whether a comma separated header value such as Connection lists the given
+ * token, compared case-insensitively. With last set only its final item is
+ * compared.
+ */
+bool http1_token_has(cdk_frame_t* value, const char* token, bool last) {
+    char* p = value->buf;
+    char* end = p + value->len;
+    bool  found = false;
+
+    while (p < end) {
+        char* comma = (char*)simd_memchr(p, ',', end - p);
+        char* stop = comma ? comma : end;
+        while (p < stop && _is_space(*p)) {
+            p++;
+        }
+        char* q = stop;
+        while (q > p && _is_space(q[-1])) {
+            q--;
+        }
+        cdk_frame_t item = {.buf = p, .len = q - p};
+        found = _frame_equal(&item, token);
+        if (found && !last) {
+            return true;
+        }
+        p = stop + 1;
+    }
+    return last && found;
+}
+
+/**
+ * Return the line starting at p without its CRLF (or bare LF) in line, and
+ * the start of the next one.
+ */
+static inline char* _line_next(char* p, char* end, cdk_frame_t* line) {
+    char* lf = (char*)simd_memchr(p, '\n', end - p);
+    if (!lf) {
+        return NULL;
+    }
+    line->buf = p;
+    line->len = lf - p;
+    if (line->len && p[line->len - 1] == '\r') {
+        line->len--;
+    }
+    return lf + 1;
+}
+
+static bool _startline_parse(cdk_frame_t* line, cdk_http1_message_t* msg) {
+    char* p = line->buf;
+    char* end = p + line->len;
+
+    char* sp1 = (char*)simd_memchr(p, ' ', end - p);
+    if (!sp1 || sp1 == p) {
+        return false;
+    }
+    if (line->len > 5 && !memcmp(p, "HTTP/", 5)) {
+        msg->request = false;
+        msg->version.buf = p;
+        msg->version.len = sp1 - p;
+
+        char* s = sp1 + 1;
+        if (end - s < 3) {
+            return false;
+        }
+        msg->status = 0;
+        for (int i = 0; i < 3; i++) {
+            if (!isdigit((unsigned char)s[i])) {
+                return false;
+            }
+            msg->status = msg->status * 10 + (s[i] - '0');
+        }
+        s += 3;
+        if (s < end && *s != ' ') {
+            return false;
+        }
+        msg->reason.buf = (s < end) ? s + 1 : s;
+        msg->reason.len = end - (char*)msg->reason.buf;
+        return true;
+    }
+    char* sp2 = (char*)simd_memchr(sp1 + 1, ' ', end - (sp1 + 1));
+    if (!sp2 || sp2 == sp1 + 1 || sp2 + 1 == end) {
+        return false;
+    }
+    msg->request = true;
+    msg->method.buf = p;
+    msg->method.len = sp1 - p;
+    msg->target.buf = sp1 + 1;
+    msg->target.len = sp2 - (sp1 + 1);
+    msg->version.buf = sp2 + 1;
+    msg->version.len = end - (sp2 + 1);
+    return msg->version.len > 5 && !memcmp(msg->version.buf, "HTTP/", 5);
+}
+
+/**
+ * Slice the start line and the headers of a head of hlen bytes, the last of
+ * which is the LF of its empty line. Nothing is copied.
+ */
+bool http1_head_parse(char* buf, size_t hlen, cdk_http1_message_t* msg) {
+    char*       p = buf;
+    char*       end = buf + hlen;
+    cdk_frame_t line;
+
+    memset(msg, 0, sizeof(cdk_http1_message_t));
+    p = _line_next(p, end, &line);
+    if (!p || !_startline_parse(&line, msg)) {
+        return false;
+    }
+    while ((p = _line_next(p, end, &line)) && line.len) {
+        char* s = line.buf;
+        char* e = s + line.len;
+        /* obsolete line folding is rejected as RFC 9112 allows. */
+        if (_is_space(*s) || msg->nheaders == HTTP1_MAX_HEADERS) {
+            return false;
+        }
+        char* colon = (char*)simd_memchr(s, ':', e - s);
+        if (!colon || colon == s || _is_space(colon[-1])) {
+            return false;
+        }
+        char* v = colon + 1;
+        while (v < e && _is_space(*v)) {
+            v++;
+        }
+        while (e > v && _is_space(e[-1])) {
+            e--;
+        }
+        cdk_http1_header_t* header = &msg->headers[msg->nheaders++];
+        header->name.buf = s;
+        header->name.len = colon - s;
+        header->value.buf = v;
+        header->value.len = e - v;
+    }
+    return true;
+}
+
+/**
+ * Look for the empty line that ends a head. Only the LFs are searched for,
+ * the empty line follows the one preceded by another LF, maybe with a CR in
+ * between. scanned carries what was searched in vain over to the next call.
+ * Returns the head length, or 0 if it is not complete yet.
+ */
+size_t http1_head_find(char* buf, size_t len, size_t* scanned) {
+    char* from = buf + *scanned;
+    char* end = buf + len;
+
+    while (from < end) {
+        char* lf = (char*)simd_memchr(from, '\n', end - from);
+        if (!lf) {
+            break;
+        }
+        if ((lf - buf >= 1 && lf[-1] == '\n')
+            || (lf - buf >= 2 && lf[-1] == '\r' && lf[-2] == '\n')) {
+            *scanned = 0;
+            return lf + 1 - buf;
+        }
+        from = lf + 1;
+    }
+    *scanned = len;
+    return 0;
+}
+
+cdk_frame_t* http1_header_find(cdk_http1_message_t* msg, const char* name) {
+    for (size_t i = 0; i < msg->nheaders; i++) {
+        if (_frame_equal(&msg->headers[i].name, name)) {
+            return &msg->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Work out how the body of a parsed head is framed: chunked, or clen bytes.
+ * A response that is only delimited by the connection close is refused, it
+ * can't be told apart from a truncated one.
+ */
+static bool _framing_parse(cdk_http1_message_t* msg, bool* chunked, uint64_t* clen) {
+    bool te = false;
+    bool cl = false;
+
+    *chunked = false;
+    *clen = 0;
+
+    /* persistent by default from HTTP/1.1 on. */
+    bool keepalive = !_frame_equal(&msg->version, "http/1.0");
+    for (size_t i = 0; i < msg->nheaders; i++) {
+        cdk_http1_header_t* header = &msg->headers[i];
+
+        if (_frame_equal(&header->name, "transfer-encoding")) {
+            /* chunked has to be the final coding. */
+            if (!http1_token_has(&header->value, "chunked", true)) {
+                return false;
+            }
+            te = true;
+        }
+        if (_frame_equal(&header->name, "content-length")) {
+            uint64_t value = 0;
+            if (!header->value.len) {
+                return false;
+            }
+            for (size_t j = 0; j < header->value.len; j++) {
+                char c = ((char*)header->value.buf)[j];
+                if (!isdigit((unsigned char)c) || value > (UINT32_MAX / 10)) {
+                    return false;
+                }
+                value = value * 10 + (c - '0');
+            }
+            if (cl && value != *clen) {
+                return false;
+            }
+            cl = true;
+            *clen = value;
+        }
+        if (_frame_equal(&header->name, "connection")) {
+            if (http1_token_has(&header->value, "close", false)) {
+                keepalive = false;
+            }
+            if (http1_token_has(&header->value, "keep-alive", false)) {
+                keepalive = true;
+            }
+        }
+    }
+    msg->keepalive = keepalive;
+
+    if (!msg->request) {
+        if (msg->status < 200 || msg->status == 204 || msg->status == 304) {
+            *clen = 0;
+            return true;
+        }
+        if (!te && !cl) {
+            return false;
+        }
+    }
+    if (te) {
+        *chunked = true;
+        *clen = 0;
+    }
+    return true;
+}
+
+/**
+ * Decode the chunked body of the message at buf in place: the chunk data is
+ * moved down right behind the head, the raw bytes not decoded yet always
+ * lie beyond it. Returns 1 once the last chunk and the trailers are in, 0
+ * if more bytes are needed and -1 on malformed input.
+ */
+static int _chunked_decode(cdk_channel_t* channel, char* buf, size_t len) {
+    char*       end = buf + len;
+    cdk_frame_t line;
+
+    while (true) {
+        char* p = buf + channel->unpacker.http1.rpos;
+        if (channel->unpacker.http1.trailers) {
+            char* next = _line_next(p, end, &line);
+            if (!next) {
+                return (end - p > HTTP1_MAX_CHUNK_LINE) ? -1 : 0;
+            }
+            channel->unpacker.http1.rpos = (uint32_t)(next - buf);
+            if (!line.len) {
+                return 1;
+            }
+            continue;
+        }
+        if (!channel->unpacker.http1.chunk) {
+            char* next = _line_next(p, end, &line);
+            if (!next) {
+                return (end - p > HTTP1_MAX_CHUNK_LINE) ? -1 : 0;
+            }
+            uint64_t size = 0;
+            size_t   i = 0;
+            for (; i < line.len && isxdigit((unsigned char)p[i]); i++) {
+                char c = (char)tolower((unsigned char)p[i]);
+                size = size * 16 + (isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10);
+                if (size > (uint64_t)channel->rxbuf.len) {
+                    return -1;
+                }
+            }
+            if (!i || (i < line.len && p[i] != ';' && !_is_space(p[i]))) {
+                return -1;
+            }
+            if (channel->unpacker.http1.hlen + channel->unpacker.http1.blen + size > (uint64_t)channel->rxbuf.len) {
+                return -1;
+            }
+            channel->unpacker.http1.rpos = (uint32_t)(next - buf);
+            if (!size) {
+                channel->unpacker.http1.trailers = true;
+            } else {
+                channel->unpacker.http1.chunk = (uint32_t)size + 2;
+            }
+            continue;
+        }
+        size_t avail = end - p;
+        if (!avail) {
+            return 0;
+        }
+        if (channel->unpacker.http1.chunk > 2) {
+            size_t n = channel->unpacker.http1.chunk - 2;
+            if (n > avail) {
+                n = avail;
+            }
+            memmove(buf + channel->unpacker.http1.hlen + channel->unpacker.http1.blen, p, n);
+            channel->unpacker.http1.blen += (uint32_t)n;
+            channel->unpacker.http1.rpos += (uint32_t)n;
+            channel->unpacker.http1.chunk -= (uint32_t)n;
+            continue;
+        }
+        /* the CRLF closing the chunk data, a bare LF is tolerated. */
+        if (channel->unpacker.http1.chunk == 2 && *p == '\r') {
+            channel->unpacker.http1.chunk = 1;
+        } else if (*p == '\n') {
+            channel->unpacker.http1.chunk = 0;
+        } else {
+            return -1;
+        }
+        channel->unpacker.http1.rpos++;
+    }
+}
+
+bool http1_unpack(cdk_channel_t* channel) {
+    char* head = channel->rxbuf.buf;
+    char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
+    char* tmp = head;
+
+    cdk_http1_message_t msg;
+    bool                parsed = false;
+
+    while (tmp < tail) {
+        uint32_t accumulated = (uint32_t)(tail - tmp);
+
+        if (!channel->unpacker.http1.hlen) {
+            /* empty lines ahead of a message are ignored. */
+            if (*tmp == '\r' || *tmp == '\n') {
+                tmp++;
+                continue;
+            }
+            uint32_t hlen = (uint32_t)http1_head_find(tmp, accumulated, &channel->unpacker.scanned);
+            if (!hlen) {
+                break;
+            }
+            bool     chunked;
+            uint64_t clen;
+            if (!http1_head_parse(tmp, hlen, &msg) || !_framing_parse(&msg, &chunked, &clen)) {
+                return false;
+            }
+            if (hlen + clen > (uint64_t)channel->rxbuf.len) {
+                return false;
+            }
+            parsed = true;
+
+            channel->unpacker.http1.hlen = hlen;
+            channel->unpacker.http1.blen = (uint32_t)clen;
+            channel->unpacker.http1.rpos = hlen;
+            channel->unpacker.http1.chunk = 0;
+            channel->unpacker.http1.chunked = chunked;
+            channel->unpacker.http1.trailers = false;
+        }
+        uint32_t fs; /* raw size of the message on the wire */
+        if (channel->unpacker.http1.chunked) {
+            int ret = _chunked_decode(channel, tmp, accumulated);
+            if (ret < 0) {
+                return false;
+            }
+            if (!ret) {
+                break;
+            }
+            fs = channel->unpacker.http1.rpos;
+        } else {
+            fs = channel->unpacker.http1.hlen + channel->unpacker.http1.blen;
+            if (accumulated < fs) {
+                break;
+            }
+        }
+        /**
+         * The head is sliced again if the body took more than one read, the
+         * message only lives on the stack of the read it completes in.
+         */
+        if (!parsed) {
+            bool     chunked;
+            uint64_t clen;
+            http1_head_parse(tmp, channel->unpacker.http1.hlen, &msg);
+            _framing_parse(&msg, &chunked, &clen);
+        }
+        msg.body.buf = tmp + channel->unpacker.http1.hlen;
+        msg.body.len = channel->unpacker.http1.blen;
+
+        memset(&channel->unpacker.http1, 0, sizeof(channel->unpacker.http1));
+        parsed = false;
+
+        if (channel->handler->on_read) {
+            channel->handler->on_read(channel, &msg, sizeof(cdk_http1_message_t));
+            if (atomic_load(&channel->closing)) {
+                return true;
+            }
+        }
+        tmp += fs;
+    }
+    if (tmp == head) {
+        return true;
+    }
+    uint32_t accumulated = (uint32_t)(tail - tmp);
+    channel->rxbuf.off = accumulated;
+    if (accumulated) {
+        memmove(channel->rxbuf.buf, tmp, accumulated);
+    }
+    return true;
+}
@@ -26,31 +26,76 @@
 #include "cdk/container/cdk-rbtree.h"
 #include "cdk/net/cdk-net.h"
 #include "net/channel.h"
+#include "net/session.h"
 #include "net/txlist.h"
 #include "platform/platform-event.h"
 #include "platform/platform-socket.h"
 #include <limits.h>
 
+static void _events_drain(cdk_poller_t* poller) {
+    while (!cdk_list_empty(&poller->evlist)) {
+        cdk_async_event_t* async_event = cdk_list_data(
+            cdk_list_head(&poller->evlist), cdk_async_event_t, node);
+        cdk_list_remove(&async_event->node);
+
+        if (async_event) {
+            async_event->task(async_event->arg);
+            free(async_event);
+            async_event = NULL;
+        }
+    }
+}
+
+/**
+ * A wakeup is only sent when the event list goes from empty to not, so the
+ * socket is drained and every event queued so far is run. Events posted
+ * while they run wake the poller again.
+ * An event may stop the poller, what is left of the batch is then put back
+ * for poller_destroy as if it had never been taken.
+ */
 static inline void _event_handle(cdk_poller_t* poller) {
-    bool wakeup;
-    platform_socket_recv(poller->evfds[1], (char*)(&wakeup), sizeof(bool));
+    char       wakeup[64];
+    cdk_list_t events;
 
+    while (platform_socket_recv(poller->evfds[1], wakeup, sizeof(wakeup)) > 0) {
+    }
+    cdk_list_init(&events);
     mtx_lock(&poller->evmtx);
-    cdk_async_event_t* async_event = NULL;
-    if (!cdk_list_empty(&poller->evlist)) {
-        async_event = cdk_list_data(
-            cdk_list_head(&poller->evlist), cdk_async_event_t, node);
-        cdk_list_remove(&async_event->node);
+    while (!cdk_list_empty(&poller->evlist)) {
+        cdk_list_node_t* node = cdk_list_head(&poller->evlist);
+        cdk_list_remove(node);
+        cdk_list_insert_tail(&events, node);
     }
     mtx_unlock(&poller->evmtx);
-    if (async_event) {
+
+    while (!cdk_list_empty(&events) && poller->active) {
+        cdk_async_event_t* async_event =
+            cdk_list_data(cdk_list_head(&events), cdk_async_event_t, node);
+        cdk_list_remove(&async_event->node);
         async_event->task(async_event->arg);
         free(async_event);
-        async_event = NULL;
     }
+    if (cdk_list_empty(&events)) {
+        return;
+    }
+    mtx_lock(&poller->evmtx);
+    while (!cdk_list_empty(&events)) {
+        cdk_list_node_t* node = cdk_list_tail(&events);
+        cdk_list_remove(node);
+        cdk_list_insert_head(&poller->evlist, node);
+    }
+    mtx_unlock(&poller->evmtx);
 }
 
 static void _channel_handle(cdk_channel_t* channel, uint32_t mask) {
+    if (channel->type == SOCK_STREAM && channel->tcp.handshaking) {
+        if (channel->side == SIDE_CLIENT) {
+            channel_tls_cli_handshake(channel);
+        } else {
+            channel_tls_srv_handshake(channel);
+        }
+        return;
+    }
     if (mask & EVENT_RD) {
         if (channel->type == SOCK_STREAM) {
             if (channel->accepting) {
@@ -61,7 +106,13 @@ static void _channel_handle(cdk_channel_t* channel, uint32_t mask) {
         } else {
             if (channel->accepting) {
                 channel->accepting = false;
-                channel_timers_create(channel);
+                /**
+                 * With per-peer sessions, timers belong to the sessions, an
+                 * idle server channel must not time out.
+                 */
+                if (!session_enabled(channel)) {
+                    channel_timers_create(channel);
+                }
                 channel_recv(channel);
             } else {
                 channel_recv(channel);
@@ -130,6 +181,52 @@ void poller_poll(cdk_poller_t* poller) {
     }
 }
 
+/**
+ * Receive buffers of idle lowmem channels are kept here for the next channel
+ * to become readable, the list node lives in the buffer itself.
+ */
+void* poller_rxbuf_acquire(cdk_poller_t* poller) {
+    if (!cdk_list_empty(&poller->rxpool)) {
+        cdk_list_node_t* node = cdk_list_head(&poller->rxpool);
+        cdk_list_remove(node);
+        poller->rxpoolsize--;
+        return node;
+    }
+    return malloc(MAX_TCP_RECVBUF_SIZE);
+}
+
+void poller_rxbuf_release(cdk_poller_t* poller, void* buf) {
+    if (poller->rxpoolsize < MAX_RXBUF_POOL_SIZE) {
+        cdk_list_insert_head(&poller->rxpool, (cdk_list_node_t*)buf);
+        poller->rxpoolsize++;
+        return;
+    }
+    free(buf);
+}
+
+/**
+ * Scratch buffers of MAX_UDP_RECVBUF_SIZE for DTLS, too large for the stack.
+ * A callback run while one is in use may need another, so a few are kept.
+ */
+void* poller_dgrambuf_acquire(cdk_poller_t* poller) {
+    if (!cdk_list_empty(&poller->dgrampool)) {
+        cdk_list_node_t* node = cdk_list_head(&poller->dgrampool);
+        cdk_list_remove(node);
+        poller->dgrampoolsize--;
+        return node;
+    }
+    return malloc(MAX_UDP_RECVBUF_SIZE);
+}
+
+void poller_dgrambuf_release(cdk_poller_t* poller, void* buf) {
+    if (poller->dgrampoolsize < MAX_DGRAMBUF_POOL_SIZE) {
+        cdk_list_insert_head(&poller->dgrampool, (cdk_list_node_t*)buf);
+        poller->dgrampoolsize++;
+        return;
+    }
+    free(buf);
+}
+
 void poller_wakeup(cdk_poller_t* poller) {
     bool wakeup = true;
     platform_socket_send(poller->evfds[0], &wakeup, sizeof(bool));
@@ -143,9 +240,14 @@ cdk_poller_t* poller_create(void) {
         poller->tid = thrd_current();
         poller->active = true;
         poller->timermgr = cdk_timer_manager_create();
+        atomic_init(&poller->offloads, 0);
 
         cdk_list_init(&poller->evlist);
         cdk_list_init(&poller->chlist);
+        cdk_list_init(&poller->rxpool);
+        poller->rxpoolsize = 0;
+        cdk_list_init(&poller->dgrampool);
+        poller->dgrampoolsize = 0;
 
         mtx_init(&poller->evmtx, mtx_plain);
         platform_socket_socketpair(AF_INET, SOCK_STREAM, 0, poller->evfds);
@@ -159,7 +261,18 @@ cdk_poller_t* poller_create(void) {
 void poller_destroy(cdk_poller_t* poller) {
     poller->active = false;
     platform_socket_pollfd_destroy(poller->pfd);
+    /**
+     * Offloaded handshakes and name lookups hand their result back through
+     * evlist, wait for them so that no worker touches a channel or the
+     * poller once freed.
+     * The wakeup socket is only closed afterwards, a worker posting its
+     * result still writes to it.
+     */
+    while (atomic_load(&poller->offloads)) {
+        cdk_time_sleep(1);
+    }
     platform_socket_close(poller->evfds[0]);
+    _events_drain(poller);
 
     while (!cdk_list_empty(&poller->chlist)) {
         cdk_channel_t* channel =
@@ -171,22 +284,23 @@ void poller_destroy(cdk_poller_t* poller) {
         channel_error_update(channel, error);
         channel_destroy(channel);
     }
-    while (!cdk_list_empty(&poller->evlist)) {
-        cdk_async_event_t* async_event = cdk_list_data(
-            cdk_list_head(&poller->evlist), cdk_async_event_t, node);
-        cdk_list_remove(&async_event->node);
+    _events_drain(poller);
 
-        if (async_event) {
-            async_event->task(async_event->arg);
-            free(async_event);
-            async_event = NULL;
-        }
-    }
     while (!cdk_timer_empty(poller->timermgr)) {
         cdk_timer_t* timer = cdk_timer_min(poller->timermgr);
         timer->routine(timer->param);
         cdk_timer_del(poller->timermgr, timer);
     }
+    while (!cdk_list_empty(&poller->rxpool)) {
+        cdk_list_node_t* node = cdk_list_head(&poller->rxpool);
+        cdk_list_remove(node);
+        free(node);
+    }
+    while (!cdk_list_empty(&poller->dgrampool)) {
+        cdk_list_node_t* node = cdk_list_head(&poller->dgrampool);
+        cdk_list_remove(node);
+        free(node);
+    }
     mtx_destroy(&poller->evmtx);
     cdk_timer_manager_destroy(poller->timermgr);
     free(poller);
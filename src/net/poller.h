@@ -26,4 +26,8 @@ _Pragma("once")
 extern cdk_poller_t* poller_create(void);
 extern void poller_destroy(cdk_poller_t* poller);
 extern void poller_poll(cdk_poller_t* poller);
-extern void poller_wakeup(cdk_poller_t* poller);
\ No newline at end of file
+extern void poller_wakeup(cdk_poller_t* poller);
+extern void* poller_rxbuf_acquire(cdk_poller_t* poller);
+extern void poller_rxbuf_release(cdk_poller_t* poller, void* buf);
+extern void* poller_dgrambuf_acquire(cdk_poller_t* poller);
+extern void poller_dgrambuf_release(cdk_poller_t* poller, void* buf);
\ No newline at end of file
@@ -0,0 +1,457 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "pool.h"
+#include "channel.h"
+#include "cdk/cdk-timer.h"
+#include "cdk/container/cdk-list.h"
+#include "cdk/net/cdk-net.h"
+
+/**
+ * Idle channels are kept on the free list of the poller they run on, so a
+ * lease taken on a poller thread hands out a channel it can drive directly.
+ */
+typedef struct pool_slot_s {
+    cdk_poller_t*   poller;
+    cdk_list_t      idle;
+    cdk_list_node_t node;
+} pool_slot_t;
+
+typedef struct pool_waiter_s {
+    cdk_pool_cb_t   cb;
+    void*           arg;
+    cdk_list_node_t node;
+} pool_waiter_t;
+
+typedef struct pool_lease_ctx_s {
+    cdk_pool_t*    pool;
+    cdk_channel_t* channel;
+    cdk_pool_cb_t  cb;
+    void*          arg;
+} pool_lease_ctx_t;
+
+static inline cdk_pool_t* _pool_of(cdk_channel_t* channel) {
+    return cdk_list_data(channel->handler, cdk_pool_t, handler);
+}
+
+static inline bool _on_poller(cdk_channel_t* channel) {
+    return thrd_equal(channel->poller->tid, thrd_current());
+}
+
+static pool_slot_t* _slot_find(cdk_pool_t* pool, cdk_poller_t* poller) {
+    for (cdk_list_node_t* n = cdk_list_head(&pool->slots);
+         n != cdk_list_sentinel(&pool->slots);
+         n = cdk_list_next(n)) {
+        pool_slot_t* slot = cdk_list_data(n, pool_slot_t, node);
+        if (slot->poller == poller) {
+            return slot;
+        }
+    }
+    pool_slot_t* slot = malloc(sizeof(pool_slot_t));
+    if (!slot) {
+        return NULL;
+    }
+    memset(slot, 0, sizeof(pool_slot_t));
+    slot->poller = poller;
+    cdk_list_init(&slot->idle);
+    cdk_list_insert_tail(&pool->slots, &slot->node);
+    return slot;
+}
+
+/**
+ * Called with the pool locked. Returns false if the channel can't be kept.
+ */
+static bool _idle_push(cdk_pool_t* pool, cdk_channel_t* channel) {
+    if (pool->destroyed || pool->nidle >= pool->maxidle) {
+        return false;
+    }
+    pool_slot_t* slot = _slot_find(pool, channel->poller);
+    if (!slot) {
+        return false;
+    }
+    /* most recently used first, the coldest ones age out on rd_timeout. */
+    cdk_list_insert_head(&slot->idle, &channel->tcp.pool.node);
+    channel->tcp.pool.idle = true;
+    pool->nidle++;
+    return true;
+}
+
+static void _idle_remove(cdk_pool_t* pool, cdk_channel_t* channel) {
+    cdk_list_remove(&channel->tcp.pool.node);
+    channel->tcp.pool.idle = false;
+    pool->nidle--;
+}
+
+/**
+ * Called with the pool locked. Prefers the free list of the calling poller.
+ */
+static cdk_channel_t* _idle_pop(cdk_pool_t* pool) {
+    pool_slot_t* found = NULL;
+
+    for (cdk_list_node_t* n = cdk_list_head(&pool->slots);
+         n != cdk_list_sentinel(&pool->slots);
+         n = cdk_list_next(n)) {
+        pool_slot_t* slot = cdk_list_data(n, pool_slot_t, node);
+        if (cdk_list_empty(&slot->idle)) {
+            continue;
+        }
+        if (thrd_equal(slot->poller->tid, thrd_current())) {
+            found = slot;
+            break;
+        }
+        if (!found) {
+            found = slot;
+        }
+    }
+    if (!found) {
+        return NULL;
+    }
+    cdk_channel_t* channel = cdk_list_data(
+        cdk_list_head(&found->idle), cdk_channel_t, tcp.pool.node);
+    _idle_remove(pool, channel);
+    return channel;
+}
+
+static pool_waiter_t* _waiter_pop(cdk_pool_t* pool) {
+    if (cdk_list_empty(&pool->waiters)) {
+        return NULL;
+    }
+    pool_waiter_t* waiter =
+        cdk_list_data(cdk_list_head(&pool->waiters), pool_waiter_t, node);
+    cdk_list_remove(&waiter->node);
+    pool->nwaiters--;
+    return waiter;
+}
+
+/**
+ * Called with the pool locked, the caller dials the returned count once it
+ * has unlocked it.
+ */
+static size_t _dials_reserve(cdk_pool_t* pool, size_t want) {
+    if (pool->destroyed || pool->pending >= want) {
+        return 0;
+    }
+    size_t n = want - pool->pending;
+    pool->pending += n;
+    pool->refs += n;
+    return n;
+}
+
+static size_t _replenish_reserve(cdk_pool_t* pool) {
+    if (pool->nidle >= pool->minidle) {
+        return 0;
+    }
+    return _dials_reserve(pool, pool->minidle - pool->nidle);
+}
+
+/**
+ * One dial per waiting lease that no dial in progress will serve, at most
+ * maxidle at once: a burst is served by connections coming back rather
+ * than by as many new ones.
+ */
+static size_t _waiters_reserve(cdk_pool_t* pool) {
+    return _dials_reserve(
+        pool, pool->nwaiters < pool->maxidle ? pool->nwaiters : pool->maxidle);
+}
+
+static void _dial(cdk_pool_t* pool, size_t n) {
+    while (n--) {
+        cdk_net_dial("tcp", pool->host, pool->port, &pool->handler);
+    }
+}
+
+static void _pool_free_cb(void* param) {
+    cdk_pool_t* pool = param;
+
+    while (!cdk_list_empty(&pool->slots)) {
+        pool_slot_t* slot =
+            cdk_list_data(cdk_list_head(&pool->slots), pool_slot_t, node);
+        cdk_list_remove(&slot->node);
+        free(slot);
+    }
+    mtx_destroy(&pool->mtx);
+    free(pool);
+}
+
+/**
+ * Channels of a pool may still be on their way down on other pollers, it
+ * is freed as late as they are. Given the poller of the last one to close,
+ * the timer goes there: it may be going down with the engine and have
+ * left the round-robin of cdk_net_timer_create already.
+ */
+static void _pool_free(cdk_pool_t* pool, cdk_poller_t* poller) {
+    if (!poller) {
+        cdk_net_timer_create(
+            _pool_free_cb, pool, CHANNEL_DELAYED_DESTROY_TIME, false);
+        return;
+    }
+    cdk_timer_add(
+        poller->timermgr,
+        _pool_free_cb,
+        pool,
+        CHANNEL_DELAYED_DESTROY_TIME,
+        false);
+}
+
+static void _async_lease(void* param) {
+    pool_lease_ctx_t* ctx = param;
+
+    /* it went down between being taken and getting here, try again. */
+    if (atomic_load(&ctx->channel->closing)) {
+        pool_acquire(ctx->pool, ctx->cb, ctx->arg);
+    } else {
+        ctx->cb(ctx->channel, ctx->arg);
+    }
+    free(ctx);
+}
+
+/**
+ * Hand the channel to the caller on its own poller thread.
+ */
+static void _lease(
+    cdk_pool_t* pool, cdk_channel_t* channel, cdk_pool_cb_t cb, void* arg) {
+    if (_on_poller(channel)) {
+        cb(channel, arg);
+        return;
+    }
+    pool_lease_ctx_t* ctx = malloc(sizeof(pool_lease_ctx_t));
+    if (!ctx) {
+        cb(NULL, arg);
+        return;
+    }
+    ctx->pool = pool;
+    ctx->channel = channel;
+    ctx->cb = cb;
+    ctx->arg = arg;
+    cdk_net_post_event(channel->poller, _async_lease, ctx, true);
+}
+
+/**
+ * Runs on the poller of the channel, as does everything else that moves
+ * it in or out of a free list but _idle_pop.
+ */
+static void _checkin(cdk_pool_t* pool, cdk_channel_t* channel) {
+    mtx_lock(&pool->mtx);
+    pool_waiter_t* waiter = _waiter_pop(pool);
+    if (waiter) {
+        mtx_unlock(&pool->mtx);
+        waiter->cb(channel, waiter->arg);
+        free(waiter);
+        return;
+    }
+    bool kept = _idle_push(pool, channel);
+    mtx_unlock(&pool->mtx);
+    if (!kept) {
+        cdk_net_close(channel);
+    }
+}
+
+static void _async_release(void* param) {
+    cdk_channel_t* channel = param;
+
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    _checkin(_pool_of(channel), channel);
+}
+
+static void _pool_on_connect(cdk_channel_t* channel) {
+    cdk_pool_t* pool = _pool_of(channel);
+
+    channel->tcp.pool.connected = true;
+    mtx_lock(&pool->mtx);
+    pool->pending--;
+    mtx_unlock(&pool->mtx);
+
+    if (pool->user->on_connect) {
+        pool->user->on_connect(channel);
+    }
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    _checkin(pool, channel);
+}
+
+static void _pool_on_close(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_pool_t*    pool = _pool_of(channel);
+    pool_waiter_t* waiter = NULL;
+    size_t         ndials = 0;
+
+    mtx_lock(&pool->mtx);
+    if (channel->tcp.pool.idle) {
+        _idle_remove(pool, channel);
+    }
+    /* nothing is dialed for once the poller goes down with the engine. */
+    if (!channel->tcp.pool.connected) {
+        /* a dial failed, the lease it was made for fails with it. */
+        pool->pending--;
+        waiter = _waiter_pop(pool);
+        /* the ones behind it are dialed for again, they fail the same way. */
+        if (channel->poller->active) {
+            ndials = _waiters_reserve(pool);
+        }
+    } else if (channel->poller->active) {
+        ndials = _replenish_reserve(pool);
+    }
+    bool release = (--pool->refs == 0) && pool->destroyed;
+    mtx_unlock(&pool->mtx);
+
+    if (pool->user->on_close) {
+        pool->user->on_close(channel, error);
+    }
+    if (waiter) {
+        waiter->cb(NULL, waiter->arg);
+        free(waiter);
+    }
+    _dial(pool, ndials);
+    if (release) {
+        _pool_free(pool, channel->poller);
+    }
+}
+
+/**
+ * The heartbeat doubles as the health check: the user's callback probes
+ * the channel and rd_timeout evicts the ones that don't answer. Idle
+ * connections lost to failed dials are made up for here too.
+ */
+static void _pool_on_heartbeat(cdk_channel_t* channel) {
+    cdk_pool_t* pool = _pool_of(channel);
+
+    if (pool->user->on_heartbeat) {
+        pool->user->on_heartbeat(channel);
+    }
+    mtx_lock(&pool->mtx);
+    size_t ndials = _replenish_reserve(pool);
+    mtx_unlock(&pool->mtx);
+    _dial(pool, ndials);
+}
+
+cdk_pool_t* pool_create(
+    const char*    host,
+    const char*    port,
+    cdk_handler_t* handler,
+    size_t         minidle,
+    size_t         maxidle) {
+    if (strlen(host) >= NI_MAXHOST || strlen(port) >= 6 ||
+        minidle > maxidle) {
+        return NULL;
+    }
+    cdk_pool_t* pool = malloc(sizeof(cdk_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(cdk_pool_t));
+    strcpy(pool->host, host);
+    strcpy(pool->port, port);
+    pool->user = handler;
+    pool->handler = *handler;
+    pool->handler.on_connect = _pool_on_connect;
+    pool->handler.on_close = _pool_on_close;
+    pool->handler.on_heartbeat = _pool_on_heartbeat;
+    pool->minidle = minidle;
+    pool->maxidle = maxidle;
+    mtx_init(&pool->mtx, mtx_plain);
+    cdk_list_init(&pool->slots);
+    cdk_list_init(&pool->waiters);
+
+    mtx_lock(&pool->mtx);
+    size_t ndials = _dials_reserve(pool, minidle);
+    mtx_unlock(&pool->mtx);
+    _dial(pool, ndials);
+    return pool;
+}
+
+void pool_destroy(cdk_pool_t* pool) {
+    cdk_list_t idle;
+
+    cdk_list_init(&idle);
+    mtx_lock(&pool->mtx);
+    pool->destroyed = true;
+
+    cdk_channel_t* channel;
+    while ((channel = _idle_pop(pool))) {
+        cdk_list_insert_tail(&idle, &channel->tcp.pool.node);
+    }
+    cdk_list_t waiters;
+    cdk_list_init(&waiters);
+    pool_waiter_t* waiter;
+    while ((waiter = _waiter_pop(pool))) {
+        cdk_list_insert_tail(&waiters, &waiter->node);
+    }
+    bool release = (pool->refs == 0);
+    mtx_unlock(&pool->mtx);
+
+    while (!cdk_list_empty(&idle)) {
+        channel =
+            cdk_list_data(cdk_list_head(&idle), cdk_channel_t, tcp.pool.node);
+        cdk_list_remove(&channel->tcp.pool.node);
+        cdk_net_close(channel);
+    }
+    while (!cdk_list_empty(&waiters)) {
+        waiter = cdk_list_data(cdk_list_head(&waiters), pool_waiter_t, node);
+        cdk_list_remove(&waiter->node);
+        waiter->cb(NULL, waiter->arg);
+        free(waiter);
+    }
+    if (release) {
+        _pool_free(pool, NULL);
+    }
+}
+
+void pool_acquire(cdk_pool_t* pool, cdk_pool_cb_t cb, void* arg) {
+    mtx_lock(&pool->mtx);
+    if (pool->destroyed) {
+        mtx_unlock(&pool->mtx);
+        cb(NULL, arg);
+        return;
+    }
+    cdk_channel_t* channel = _idle_pop(pool);
+    if (channel) {
+        mtx_unlock(&pool->mtx);
+        _lease(pool, channel, cb, arg);
+        return;
+    }
+    pool_waiter_t* waiter = malloc(sizeof(pool_waiter_t));
+    if (!waiter) {
+        mtx_unlock(&pool->mtx);
+        cb(NULL, arg);
+        return;
+    }
+    waiter->cb = cb;
+    waiter->arg = arg;
+    cdk_list_insert_tail(&pool->waiters, &waiter->node);
+    pool->nwaiters++;
+
+    size_t ndials = _waiters_reserve(pool);
+    mtx_unlock(&pool->mtx);
+    _dial(pool, ndials);
+}
+
+void pool_release(cdk_channel_t* channel) {
+    if (atomic_load(&channel->closing)) {
+        return;
+    }
+    if (_on_poller(channel)) {
+        _checkin(_pool_of(channel), channel);
+    } else {
+        cdk_net_post_event(channel->poller, _async_release, channel, true);
+    }
+}
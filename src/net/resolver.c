@@ -0,0 +1,260 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "resolver.h"
+#include "cdk/cdk-threadpool.h"
+#include "cdk/cdk-time.h"
+#include "cdk/container/cdk-rbtree.h"
+#include "cdk/net/cdk-net.h"
+#include "platform/platform-socket.h"
+
+/**
+ * getaddrinfo doesn't tell the TTL of the records it returns, answers are
+ * kept for a fixed time instead, failures for a shorter one so that a name
+ * that comes back is picked up soon.
+ */
+#define RESOLVER_CACHE_TTL      30000
+#define RESOLVER_NEGATIVE_TTL   1000
+#define RESOLVER_CACHE_MAX_SIZE 1024
+#define RESOLVER_THREADS        4
+
+typedef struct resolver_entry_s {
+    resolver_addrs_t  addrs;
+    uint64_t          expire;
+    cdk_rbtree_node_t node;
+    char              key[];
+} resolver_entry_t;
+
+typedef struct resolver_job_s {
+    cdk_poller_t*    poller;
+    resolver_cb_t    cb;
+    void*            arg;
+    char*            host;
+    char*            port;
+    int              protocol;
+    bool             passive;
+    resolver_addrs_t addrs;
+    char             key[];
+} resolver_job_t;
+
+static struct {
+    cdk_rbtree_t   cache;
+    size_t         size;
+    mtx_t          mtx;
+    cdk_thrdpool_t workers;
+} resolver;
+
+/**
+ * Literal addresses resolve without a lookup, on the calling thread.
+ */
+static bool _numeric(const char* host) {
+    struct in6_addr addr;
+
+    return !host || inet_pton(AF_INET, host, &addr) == 1 ||
+           inet_pton(AF_INET6, host, &addr) == 1;
+}
+
+static void _cache_erase(resolver_entry_t* entry) {
+    cdk_rbtree_erase(&resolver.cache, &entry->node);
+    free(entry);
+    resolver.size--;
+}
+
+/**
+ * Make room in a full cache: drop what expired, or if every name is still
+ * fresh the one closest to expiring. Called with the lock held.
+ */
+static void _cache_evict(uint64_t now) {
+    cdk_rbtree_node_t* node = cdk_rbtree_first(&resolver.cache);
+    resolver_entry_t*  oldest = NULL;
+
+    while (node) {
+        resolver_entry_t* entry = cdk_rbtree_data(node, resolver_entry_t, node);
+        node = cdk_rbtree_next(node);
+        if (entry->expire <= now) {
+            _cache_erase(entry);
+        } else if (!oldest || entry->expire < oldest->expire) {
+            oldest = entry;
+        }
+    }
+    if (resolver.size >= RESOLVER_CACHE_MAX_SIZE && oldest) {
+        _cache_erase(oldest);
+    }
+}
+
+static void _cache_insert(resolver_job_t* job) {
+    size_t            klen = strlen(job->key) + 1;
+    resolver_entry_t* entry = malloc(sizeof(resolver_entry_t) + klen);
+    if (!entry) {
+        return;
+    }
+    uint64_t now = cdk_time_now();
+    memcpy(entry->key, job->key, klen);
+    entry->addrs = job->addrs;
+    entry->expire =
+        now + (job->addrs.count ? RESOLVER_CACHE_TTL : RESOLVER_NEGATIVE_TTL);
+    entry->node.key.str = entry->key;
+
+    mtx_lock(&resolver.mtx);
+    cdk_rbtree_node_t* node = cdk_rbtree_find(&resolver.cache, entry->node.key);
+    if (node) {
+        _cache_erase(cdk_rbtree_data(node, resolver_entry_t, node));
+    }
+    if (resolver.size >= RESOLVER_CACHE_MAX_SIZE) {
+        _cache_evict(now);
+    }
+    cdk_rbtree_insert(&resolver.cache, &entry->node);
+    resolver.size++;
+    mtx_unlock(&resolver.mtx);
+}
+
+static bool _cache_lookup(const char* key, resolver_addrs_t* addrs) {
+    bool found = false;
+
+    mtx_lock(&resolver.mtx);
+    cdk_rbtree_node_t* node =
+        cdk_rbtree_find(&resolver.cache, (cdk_rbtree_key_t){.str = (char*)key});
+    if (node) {
+        resolver_entry_t* entry = cdk_rbtree_data(node, resolver_entry_t, node);
+        if (entry->expire > cdk_time_now()) {
+            *addrs = entry->addrs;
+            found = true;
+        } else {
+            _cache_erase(entry);
+        }
+    }
+    mtx_unlock(&resolver.mtx);
+    return found;
+}
+
+static void _async_resolved(void* param) {
+    resolver_job_t* job = param;
+
+    job->cb(&job->addrs, job->arg);
+    free(job);
+}
+
+static void _resolve(resolver_job_t* job) {
+    job->addrs.count = platform_socket_resolve(
+        job->host,
+        job->port,
+        job->protocol,
+        job->passive,
+        job->addrs.ss,
+        job->addrs.lens,
+        RESOLVER_MAX_ADDRS);
+}
+
+/**
+ * The lookup counts as offloaded work of its poller until the result is
+ * posted, poller_destroy waits for it so that the poller outlives the post.
+ */
+static void _resolve_offloaded(void* param) {
+    resolver_job_t* job = param;
+    cdk_poller_t*   poller = job->poller;
+
+    _resolve(job);
+    _cache_insert(job);
+    cdk_net_post_event(poller, _async_resolved, job, true);
+    atomic_fetch_sub(&poller->offloads, 1);
+}
+
+void resolver_create(void) {
+    cdk_rbtree_init(&resolver.cache, default_keycmp_str);
+    resolver.size = 0;
+    mtx_init(&resolver.mtx, mtx_plain);
+}
+
+void resolver_destroy(void) {
+    if (resolver.workers.status) {
+        cdk_thrdpool_destroy(&resolver.workers);
+        resolver.workers.status = false;
+    }
+    cdk_rbtree_node_t* node;
+    while ((node = cdk_rbtree_first(&resolver.cache))) {
+        cdk_rbtree_erase(&resolver.cache, node);
+        free(cdk_rbtree_data(node, resolver_entry_t, node));
+    }
+    resolver.size = 0;
+    mtx_destroy(&resolver.mtx);
+}
+
+/**
+ * Resolve host and port, the callback runs on the poller with the
+ * addresses. Names are looked up by workers so that a slow resolver never
+ * holds up a poller, behind a cache shared by all of them, an AF_UNIX host
+ * is a path and is taken as it is. Returns false, without calling back, if
+ * the lookup couldn't be started.
+ */
+bool resolver_resolve(
+    cdk_poller_t* poller,
+    const char*   host,
+    const char*   port,
+    int           family,
+    int           protocol,
+    bool          passive,
+    resolver_cb_t cb,
+    void*         arg) {
+    size_t hlen = host ? strlen(host) + 1 : 0;
+    size_t plen = strlen(port) + 1;
+    size_t klen = hlen + plen + 8;
+
+    resolver_job_t* job = malloc(sizeof(resolver_job_t) + klen + hlen + plen);
+    if (!job) {
+        return false;
+    }
+    memset(job, 0, sizeof(resolver_job_t));
+    job->poller = poller;
+    job->cb = cb;
+    job->arg = arg;
+    job->protocol = protocol;
+    job->passive = passive;
+    snprintf(
+        job->key,
+        klen,
+        "%d%c|%s|%s",
+        protocol,
+        passive ? 'p' : 'a',
+        host ? host : "",
+        port);
+    job->host = host ? memcpy(job->key + klen, host, hlen) : NULL;
+    job->port = memcpy(job->key + klen + hlen, port, plen);
+
+    if (family == AF_UNIX) {
+        job->addrs.count = platform_socket_unix_address(
+                               host, &job->addrs.ss[0], &job->addrs.lens[0])
+                               ? 1
+                               : 0;
+    } else if (_numeric(host)) {
+        _resolve(job);
+    } else if (!_cache_lookup(job->key, &job->addrs)) {
+        mtx_lock(&resolver.mtx);
+        if (!resolver.workers.status) {
+            cdk_thrdpool_create(&resolver.workers, RESOLVER_THREADS);
+        }
+        mtx_unlock(&resolver.mtx);
+        atomic_fetch_add(&poller->offloads, 1);
+        cdk_thrdpool_post(&resolver.workers, _resolve_offloaded, job);
+        return true;
+    }
+    cdk_net_post_event(poller, _async_resolved, job, true);
+    return true;
+}
@@ -0,0 +1,38 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+_Pragma("once")
+
+#include "cdk/cdk-types.h"
+
+#define RESOLVER_MAX_ADDRS 8
+
+typedef struct resolver_addrs_s {
+    struct sockaddr_storage ss[RESOLVER_MAX_ADDRS];
+    socklen_t               lens[RESOLVER_MAX_ADDRS];
+    int                     count; /* 0 if the name didn't resolve */
+} resolver_addrs_t;
+
+typedef void (*resolver_cb_t)(resolver_addrs_t* addrs, void* arg);
+
+extern void resolver_create(void);
+extern void resolver_destroy(void);
+extern bool resolver_resolve(cdk_poller_t* poller, const char* host, const char* port, int family, int protocol, bool passive, resolver_cb_t cb, void* arg);
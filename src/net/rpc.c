@@ -0,0 +1,209 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "rpc.h"
+#include "channel.h"
+#include "cdk/cdk-timer.h"
+#include "cdk/container/cdk-rbtree.h"
+
+/**
+ * A message is framed as a 4 byte length of what follows it, the 8 byte
+ * request id and a kind byte, all big-endian, then the payload.
+ */
+#define RPC_KIND_REQUEST  0
+#define RPC_KIND_RESPONSE 1
+
+typedef struct rpc_call_s {
+    cdk_channel_t*    channel;
+    cdk_rpc_cb_t      cb;
+    void*             arg;
+    cdk_timer_t*      timer;
+    cdk_rbtree_node_t node;
+} rpc_call_t;
+
+static inline void _u32_encode(uint32_t value, uint8_t* buf) {
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t)(value >> (24 - 8 * i));
+    }
+}
+
+static inline void _u64_encode(uint64_t value, uint8_t* buf) {
+    for (int i = 0; i < 8; i++) {
+        buf[i] = (uint8_t)(value >> (56 - 8 * i));
+    }
+}
+
+static inline uint64_t _u64_decode(uint8_t* buf, int n) {
+    uint64_t value = 0;
+    for (int i = 0; i < n; i++) {
+        value = (value << 8) | buf[i];
+    }
+    return value;
+}
+
+static void _message_send(
+    cdk_channel_t* channel, uint64_t id, uint8_t kind, void* data, size_t size) {
+    uint8_t hdr[RPC_HEADER_SIZE];
+
+    _u32_encode((uint32_t)(RPC_HEADER_SIZE - 4 + size), hdr);
+    _u64_encode(id, hdr + 4);
+    hdr[12] = kind;
+
+    void*  bufs[2] = {hdr, data};
+    size_t lens[2] = {RPC_HEADER_SIZE, size};
+    channel_explicit_sendv(channel, bufs, lens, size ? 2 : 1);
+}
+
+/**
+ * Take the call out of the channel and hand it its outcome. The timer is
+ * left alone when it is the one firing, the timer manager releases it.
+ */
+static void _call_complete(
+    rpc_call_t* call, cdk_rpc_status_t status, void* buf, size_t len) {
+    cdk_channel_t* channel = call->channel;
+
+    cdk_rbtree_erase(&channel->tcp.rpc.calls, &call->node);
+    channel->tcp.rpc.inflight--;
+    if (call->timer && status != RPC_STATUS_TIMEOUT) {
+        cdk_timer_del(channel->poller->timermgr, call->timer);
+    }
+    call->cb(channel, status, buf, len, call->arg);
+    free(call);
+}
+
+static void _call_timeout_cb(void* param) {
+    _call_complete(param, RPC_STATUS_TIMEOUT, NULL, 0);
+}
+
+void rpc_init(cdk_channel_t* channel) {
+    cdk_rbtree_init(&channel->tcp.rpc.calls, default_keycmp_u64);
+}
+
+/**
+ * Returns false, without calling cb, if the call could not be issued. Once
+ * issued cb gets its outcome, even if sending the request fails the channel.
+ */
+bool rpc_call(
+    cdk_channel_t* channel,
+    void*          data,
+    size_t         size,
+    int            timeout,
+    cdk_rpc_cb_t   cb,
+    void*          arg) {
+    if (atomic_load(&channel->closing) || size > RPC_MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    rpc_call_t* call = malloc(sizeof(rpc_call_t));
+    if (!call) {
+        return false;
+    }
+    memset(call, 0, sizeof(rpc_call_t));
+    call->channel = channel;
+    call->cb = cb;
+    call->arg = arg;
+    call->node.key.u64 = ++channel->tcp.rpc.nextid;
+
+    if (timeout > 0) {
+        call->timer = cdk_timer_add(
+            channel->poller->timermgr, _call_timeout_cb, call, timeout, false);
+        if (!call->timer) {
+            free(call);
+            return false;
+        }
+    }
+    cdk_rbtree_insert(&channel->tcp.rpc.calls, &call->node);
+    channel->tcp.rpc.inflight++;
+    _message_send(channel, call->node.key.u64, RPC_KIND_REQUEST, data, size);
+    return true;
+}
+
+bool rpc_reply(cdk_channel_t* channel, uint64_t id, void* data, size_t size) {
+    if (atomic_load(&channel->closing) || size > RPC_MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+    _message_send(channel, id, RPC_KIND_RESPONSE, data, size);
+    return true;
+}
+
+/**
+ * Fail the calls still in flight when the channel goes away.
+ */
+void rpc_abort_all(cdk_channel_t* channel) {
+    cdk_rbtree_node_t* node;
+
+    while ((node = cdk_rbtree_first(&channel->tcp.rpc.calls))) {
+        _call_complete(
+            cdk_rbtree_data(node, rpc_call_t, node), RPC_STATUS_CLOSED, NULL, 0);
+    }
+}
+
+bool rpc_unpack(cdk_channel_t* channel) {
+    char* head = channel->rxbuf.buf;
+    char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
+    char* tmp = head;
+
+    uint32_t accumulated = (uint32_t)(tail - head);
+    while (accumulated >= RPC_HEADER_SIZE) {
+        uint8_t* hdr = (uint8_t*)tmp;
+        uint64_t fs = 4 + _u64_decode(hdr, 4);
+        if (fs < RPC_HEADER_SIZE || fs > (uint64_t)channel->rxbuf.len) {
+            return false;
+        }
+        if (accumulated < fs) {
+            break;
+        }
+        uint64_t id = _u64_decode(hdr + 4, 8);
+        char*    payload = tmp + RPC_HEADER_SIZE;
+        size_t   len = (size_t)fs - RPC_HEADER_SIZE;
+
+        if (hdr[12] == RPC_KIND_REQUEST) {
+            if (channel->handler->on_rpc_request) {
+                channel->handler->on_rpc_request(channel, id, payload, len);
+            }
+        } else if (hdr[12] == RPC_KIND_RESPONSE) {
+            /* a response whose call timed out already is dropped. */
+            cdk_rbtree_node_t* node = cdk_rbtree_find(
+                &channel->tcp.rpc.calls, (cdk_rbtree_key_t){.u64 = id});
+            if (node) {
+                _call_complete(
+                    cdk_rbtree_data(node, rpc_call_t, node),
+                    RPC_STATUS_OK,
+                    payload,
+                    len);
+            }
+        } else {
+            return false;
+        }
+        if (atomic_load(&channel->closing)) {
+            return true;
+        }
+        tmp += fs;
+        accumulated -= (uint32_t)fs;
+    }
+    if (tmp == head) {
+        return true;
+    }
+    channel->rxbuf.off = accumulated;
+    if (accumulated) {
+        memmove(channel->rxbuf.buf, tmp, accumulated);
+    }
+    return true;
+}
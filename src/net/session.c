@@ -0,0 +1,262 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "session.h"
+#include "cdk/container/cdk-list.h"
+#include "channel.h"
+#include "tls.h"
+#include "txlist.h"
+
+#define SESSION_INITIAL_BUCKETS 64
+#define SESSION_DEFAULT_MAX     4096
+
+static uint32_t _fnv1a(uint32_t hash, const void* data, size_t len) {
+    const uint8_t* p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * Peers pick their own addresses, the seed keeps them from picking ones
+ * that all land in the same bucket.
+ */
+static uint32_t _peer_hash(struct sockaddr_storage* ss, uint32_t seed) {
+    uint32_t hash = 2166136261U ^ seed;
+
+    switch (ss->ss_family) {
+    case AF_INET: {
+        struct sockaddr_in* si = (struct sockaddr_in*)ss;
+        hash = _fnv1a(hash, &si->sin_addr, sizeof(si->sin_addr));
+        hash = _fnv1a(hash, &si->sin_port, sizeof(si->sin_port));
+        break;
+    }
+    case AF_INET6: {
+        struct sockaddr_in6* si6 = (struct sockaddr_in6*)ss;
+        hash = _fnv1a(hash, &si6->sin6_addr, sizeof(si6->sin6_addr));
+        hash = _fnv1a(hash, &si6->sin6_port, sizeof(si6->sin6_port));
+        break;
+    }
+    case AF_UNIX:
+        /* the bytes past a local address are zeroed by _channel_recv. */
+        hash = _fnv1a(hash, ss, sizeof(struct sockaddr_storage));
+        break;
+    default:
+        break;
+    }
+    return hash;
+}
+
+static bool _peer_equal(
+    struct sockaddr_storage* ss1, struct sockaddr_storage* ss2) {
+    if (ss1->ss_family != ss2->ss_family) {
+        return false;
+    }
+    switch (ss1->ss_family) {
+    case AF_INET: {
+        struct sockaddr_in* si1 = (struct sockaddr_in*)ss1;
+        struct sockaddr_in* si2 = (struct sockaddr_in*)ss2;
+        return (si1->sin_port == si2->sin_port) &&
+               !memcmp(&si1->sin_addr, &si2->sin_addr, sizeof(si1->sin_addr));
+    }
+    case AF_INET6: {
+        struct sockaddr_in6* si61 = (struct sockaddr_in6*)ss1;
+        struct sockaddr_in6* si62 = (struct sockaddr_in6*)ss2;
+        return (si61->sin6_port == si62->sin6_port) &&
+               !memcmp(
+                   &si61->sin6_addr,
+                   &si62->sin6_addr,
+                   sizeof(si61->sin6_addr));
+    }
+    case AF_UNIX:
+        return !memcmp(ss1, ss2, sizeof(struct sockaddr_storage));
+    default:
+        return false;
+    }
+}
+
+static bool _buckets_resize(cdk_channel_t* channel, size_t nbuckets) {
+    uint32_t    seed = channel->udp.sessions.seed;
+    cdk_list_t* buckets = malloc(nbuckets * sizeof(cdk_list_t));
+    if (!buckets) {
+        return false;
+    }
+    for (size_t i = 0; i < nbuckets; i++) {
+        cdk_list_init(&buckets[i]);
+    }
+    for (size_t i = 0; i < channel->udp.sessions.nbuckets; i++) {
+        cdk_list_t* bucket = &channel->udp.sessions.buckets[i];
+        while (!cdk_list_empty(bucket)) {
+            cdk_list_node_t* n = cdk_list_head(bucket);
+            cdk_channel_t*   session =
+                cdk_list_data(n, cdk_channel_t, udp.sessions.bnode);
+            uint32_t         hash = _peer_hash(&session->udp.peer.ss, seed);
+            cdk_list_remove(n);
+            cdk_list_insert_tail(&buckets[hash & (nbuckets - 1)], n);
+        }
+    }
+    free(channel->udp.sessions.buckets);
+    channel->udp.sessions.buckets = buckets;
+    channel->udp.sessions.nbuckets = nbuckets;
+    return true;
+}
+
+/**
+ * DTLS servers always run with sessions, each peer has its own SSL.
+ */
+bool session_enabled(cdk_channel_t* channel) {
+    return channel->handler->sessions || channel->udp.dtls.ctx;
+}
+
+bool session_is(cdk_channel_t* channel) {
+    return channel->type == SOCK_DGRAM && channel->udp.sessions.parent;
+}
+
+cdk_channel_t* session_find(
+    cdk_channel_t* channel, struct sockaddr_storage* ss) {
+    if (!channel->udp.sessions.count) {
+        return NULL;
+    }
+    cdk_list_t* bucket =
+        &channel->udp.sessions.buckets
+             [_peer_hash(ss, channel->udp.sessions.seed) &
+              (channel->udp.sessions.nbuckets - 1)];
+
+    for (cdk_list_node_t* n = cdk_list_head(bucket);
+         n != cdk_list_sentinel(bucket);
+         n = cdk_list_next(n)) {
+        cdk_channel_t* session =
+            cdk_list_data(n, cdk_channel_t, udp.sessions.bnode);
+        if (_peer_equal(&session->udp.peer.ss, ss)) {
+            return session;
+        }
+    }
+    return NULL;
+}
+
+cdk_channel_t* session_create(
+    cdk_channel_t* channel, struct sockaddr_storage* ss, socklen_t sslen) {
+    size_t max = channel->handler->max_sessions > 0
+                     ? (size_t)channel->handler->max_sessions
+                     : SESSION_DEFAULT_MAX;
+    if (channel->udp.sessions.count >= max) {
+        return NULL;
+    }
+    if (!channel->udp.sessions.buckets) {
+        cdk_list_init(&channel->udp.sessions.wrlist);
+        if (!tls_rand_bytes(
+                &channel->udp.sessions.seed,
+                sizeof(channel->udp.sessions.seed))) {
+            return NULL;
+        }
+        if (!_buckets_resize(channel, SESSION_INITIAL_BUCKETS)) {
+            return NULL;
+        }
+    }
+    if (channel->udp.sessions.count >= channel->udp.sessions.nbuckets &&
+        !_buckets_resize(channel, channel->udp.sessions.nbuckets * 2)) {
+        return NULL;
+    }
+    cdk_channel_t* session = malloc(sizeof(cdk_channel_t));
+    if (!session) {
+        return NULL;
+    }
+    memset(session, 0, sizeof(cdk_channel_t));
+    session->poller = channel->poller;
+    session->fd = channel->fd;
+    session->handler = channel->handler;
+    session->type = SOCK_DGRAM;
+    atomic_init(&session->closing, false);
+    txlist_create(&session->txlist);
+    session->mode = CHANNEL_MODE_NORMAL;
+    session->side = SIDE_SERVER;
+    /**
+     * Sessions never read from the socket themselves, datagrams are
+     * received by the server channel and dispatched here, so no rxbuf.
+     */
+    memcpy(&session->udp.peer.ss, ss, sslen);
+    session->udp.peer.sslen = sslen;
+    session->udp.sessions.parent = channel;
+
+    cdk_list_insert_tail(
+        &channel->udp.sessions.buckets
+             [_peer_hash(ss, channel->udp.sessions.seed) &
+              (channel->udp.sessions.nbuckets - 1)],
+        &session->udp.sessions.bnode);
+    channel->udp.sessions.count++;
+
+    cdk_list_insert_tail(&channel->poller->chlist, &session->node);
+    return session;
+}
+
+void session_remove(cdk_channel_t* session) {
+    cdk_list_remove(&session->udp.sessions.bnode);
+    session->udp.sessions.parent->udp.sessions.count--;
+}
+
+void session_destroy_all(cdk_channel_t* channel) {
+    for (size_t i = 0; i < channel->udp.sessions.nbuckets; i++) {
+        cdk_list_t* bucket = &channel->udp.sessions.buckets[i];
+        while (!cdk_list_empty(bucket)) {
+            cdk_channel_t* session = cdk_list_data(
+                cdk_list_head(bucket), cdk_channel_t, udp.sessions.bnode);
+            channel_error_update(session, channel->error);
+            channel_destroy(session);
+        }
+    }
+    free(channel->udp.sessions.buckets);
+    channel->udp.sessions.buckets = NULL;
+    channel->udp.sessions.nbuckets = 0;
+}
+
+void session_enable_write(cdk_channel_t* session) {
+    cdk_channel_t* channel = session->udp.sessions.parent;
+
+    cdk_list_insert_tail(
+        &channel->udp.sessions.wrlist, &session->udp.sessions.wrnode);
+    if (!channel_is_writing(channel)) {
+        channel_enable_write(channel);
+    }
+}
+
+void session_disable_write(cdk_channel_t* session) {
+    cdk_list_remove(&session->udp.sessions.wrnode);
+}
+
+void session_send(cdk_channel_t* channel) {
+    cdk_list_t* wrlist = &channel->udp.sessions.wrlist;
+
+    cdk_list_node_t* n = cdk_list_head(wrlist);
+    while (n != cdk_list_sentinel(wrlist)) {
+        cdk_channel_t* session =
+            cdk_list_data(n, cdk_channel_t, udp.sessions.wrnode);
+        /**
+         * channel_send may unlink the session from wrlist.
+         */
+        n = cdk_list_next(n);
+        channel_send(session);
+    }
+    if (cdk_list_empty(wrlist)) {
+        channel_disable_write(channel);
+    }
+}
@@ -0,0 +1,147 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "simd.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SIMD_NEON
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static inline int _ctz64(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+static inline const char* _scalar_memchr(const char* s, char c, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == c) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Compare a whole vector of bytes against c at once and turn the result into
+ * a bit mask, the lowest set bit is the first match. Only unaligned loads
+ * are used and never past s + n, the remainder goes through the scalar loop.
+ */
+const char* simd_memchr(const char* s, char c, size_t n) {
+    size_t i = 0;
+#if defined(SIMD_AVX2)
+    __m256i needle = _mm256_set1_epi8(c);
+    for (; i + 32 <= n; i += 32) {
+        __m256i  chunk = _mm256_loadu_si256((const __m256i*)(s + i));
+        uint32_t mask =
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask) {
+            return s + i + _ctz64(mask);
+        }
+    }
+#endif
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    __m128i needle16 = _mm_set1_epi8(c);
+    for (; i + 16 <= n; i += 16) {
+        __m128i  chunk = _mm_loadu_si128((const __m128i*)(s + i));
+        uint32_t mask =
+            (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle16));
+        if (mask) {
+            return s + i + _ctz64(mask);
+        }
+    }
+#endif
+#if defined(SIMD_NEON)
+    uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*)(s + i)), needle);
+        /**
+         * NEON has no movemask, narrowing each 16 bit lane by 4 leaves one
+         * nibble per byte in a 64 bit mask.
+         */
+        uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask) {
+            return s + i + (_ctz64(mask) >> 2);
+        }
+    }
+#endif
+    return _scalar_memchr(s + i, c, n - i);
+}
+
+/**
+ * XOR buf with the 4 byte key repeated over it, which masks and unmasks
+ * alike. The key is broadcast to a whole vector, each step covering a
+ * multiple of 4 bytes keeps it in phase for the scalar remainder.
+ */
+void simd_xormask(char* buf, size_t len, const uint8_t key[4]) {
+    size_t   i = 0;
+    uint32_t k;
+    memcpy(&k, key, 4);
+#if defined(SIMD_AVX2)
+    __m256i mask = _mm256_set1_epi32((int)k);
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(buf + i));
+        _mm256_storeu_si256((__m256i*)(buf + i), _mm256_xor_si256(chunk, mask));
+    }
+#endif
+#if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    __m128i mask16 = _mm_set1_epi32((int)k);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + i));
+        _mm_storeu_si128((__m128i*)(buf + i), _mm_xor_si128(chunk, mask16));
+    }
+#endif
+#if defined(SIMD_NEON)
+    uint8x16_t mask = vreinterpretq_u8_u32(vdupq_n_u32(k));
+    for (; i + 16 <= len; i += 16) {
+        uint8_t* p = (uint8_t*)(buf + i);
+        vst1q_u8(p, veorq_u8(vld1q_u8(p), mask));
+    }
+#endif
+    uint64_t k64 = ((uint64_t)k << 32) | k;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, buf + i, 8);
+        chunk ^= k64;
+        memcpy(buf + i, &chunk, 8);
+    }
+    for (; i < len; i++) {
+        buf[i] ^= key[i & 3];
+    }
+}
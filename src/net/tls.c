@@ -20,16 +20,273 @@
  */
 
 #include "tls.h"
+#include "cdk/cdk-time.h"
+#include "cdk/container/cdk-list.h"
+#include "cdk/container/cdk-rbtree.h"
 #include "cdk/net/cdk-net.h"
 #include "platform/platform-socket.h"
+#include <openssl/core_names.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 
 #define COOKIE_SECRET_LENGTH 16
+#define TICKET_KEY_NAME_LENGTH 16
+#define TICKET_KEY_LENGTH 32
+#define TICKET_KEY_ROTATION 3600000 // 1 hour, in milliseconds
+#define SESSION_TIMEOUT 7200        // 2 hours, in seconds
+#define SESSION_STORE_SIZE 1024
+#define CONF_FINGERPRINT_LENGTH 16
+#define MAX_EARLY_DATA_SIZE 16384
+#define DTLS_RECORD_HEADER_LENGTH 13
+#define TLS_RECORD_BUFFERS_SIZE (2 * SSL3_RT_MAX_PACKET_SIZE)
+
+typedef struct tls_ticket_key_s {
+    unsigned char name[TICKET_KEY_NAME_LENGTH];
+    unsigned char aes_key[TICKET_KEY_LENGTH];
+    unsigned char hmac_key[TICKET_KEY_LENGTH];
+    uint64_t      created;
+} tls_ticket_key_t;
+
+typedef struct tls_ctx_entry_s {
+    cdk_list_node_t node;
+    cdk_tls_conf_t  conf;
+    bool            dtls;
+    SSL_CTX*        ctx;
+    size_t          refs;
+    char            fingerprint[2 * CONF_FINGERPRINT_LENGTH + 1];
+} tls_ctx_entry_t;
+
+typedef struct tls_session_s {
+    cdk_rbtree_node_t node;
+    cdk_list_node_t   lru;
+    SSL_SESSION*      session;
+    char              dest[];
+} tls_session_t;
 
 static unsigned char cookie_secret[COOKIE_SECRET_LENGTH];
-static bool          cookie_initialized;
+
+/**
+ * Ticket keys are process wide, every listening context (and so every poller)
+ * encrypts with keys[0] and still accepts tickets sealed with keys[1], the
+ * key it replaced, until the next rotation.
+ */
+static struct {
+    tls_ticket_key_t keys[2];
+    size_t           nkeys;
+    mtx_t            mtx;
+} ticket_keys;
+
+/**
+ * Client side sessions, indexed by the context they were negotiated with and
+ * the "host:port" passed to cdk_net_dial, most recently used first in lru.
+ */
+static struct {
+    cdk_rbtree_t tree;
+    cdk_list_t   lru;
+    size_t       count;
+    mtx_t        mtx;
+    int          index;
+} session_store;
+
+/**
+ * Contexts are built once per distinct configuration and shared by every
+ * channel using it, a cdk_tls_ctx_t is a reference to one of these entries.
+ */
+static struct {
+    cdk_list_t entries;
+    mtx_t      mtx;
+} ctx_cache;
+
+static once_flag tls_once = ONCE_FLAG_INIT;
+
+static void _tls_init(void) {
+    cdk_list_init(&ctx_cache.entries);
+    mtx_init(&ctx_cache.mtx, mtx_plain);
+    mtx_init(&ticket_keys.mtx, mtx_plain);
+    mtx_init(&session_store.mtx, mtx_plain);
+    cdk_rbtree_init(&session_store.tree, default_keycmp_str);
+    cdk_list_init(&session_store.lru);
+    session_store.index = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+    RAND_bytes(cookie_secret, sizeof(cookie_secret));
+}
+
+static bool _ticket_key_rotate(void) {
+    tls_ticket_key_t key;
+
+    if (RAND_bytes(key.name, sizeof(key.name)) <= 0 ||
+        RAND_bytes(key.aes_key, sizeof(key.aes_key)) <= 0 ||
+        RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) <= 0) {
+        return false;
+    }
+    key.created = cdk_time_now();
+    ticket_keys.keys[1] = ticket_keys.keys[0];
+    ticket_keys.keys[0] = key;
+    if (ticket_keys.nkeys < 2) {
+        ticket_keys.nkeys++;
+    }
+    return true;
+}
+
+static int _ticket_key_cb(
+    SSL*           ssl,
+    unsigned char* key_name,
+    unsigned char* iv,
+    EVP_CIPHER_CTX* cctx,
+    EVP_MAC_CTX*   hctx,
+    int            enc) {
+    tls_ticket_key_t key;
+    int              ret = 1;
+
+    (void)(ssl);
+    mtx_lock(&ticket_keys.mtx);
+    if (!ticket_keys.nkeys ||
+        cdk_time_now() - ticket_keys.keys[0].created >= TICKET_KEY_ROTATION) {
+        if (!_ticket_key_rotate() && !ticket_keys.nkeys) {
+            mtx_unlock(&ticket_keys.mtx);
+            return -1;
+        }
+    }
+    if (enc) {
+        key = ticket_keys.keys[0];
+    } else {
+        size_t i;
+        for (i = 0; i < ticket_keys.nkeys; i++) {
+            if (!memcmp(
+                    key_name, ticket_keys.keys[i].name, TICKET_KEY_NAME_LENGTH)) {
+                break;
+            }
+        }
+        if (i == ticket_keys.nkeys) {
+            mtx_unlock(&ticket_keys.mtx);
+            /**
+             * Unknown or expired key, fall back to a full handshake.
+             */
+            return 0;
+        }
+        key = ticket_keys.keys[i];
+        /**
+         * Sealed with the previous key, ask OpenSSL to issue a fresh ticket.
+         */
+        ret = (i == 0) ? 1 : 2;
+    }
+    mtx_unlock(&ticket_keys.mtx);
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(
+            OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key)),
+        OSSL_PARAM_construct_utf8_string(
+            OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_end()};
+
+    if (enc) {
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) <= 0) {
+            return -1;
+        }
+        memcpy(key_name, key.name, TICKET_KEY_NAME_LENGTH);
+        if (!EVP_EncryptInit_ex(
+                cctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv)) {
+            return -1;
+        }
+    } else {
+        if (!EVP_DecryptInit_ex(
+                cctx, EVP_aes_256_cbc(), NULL, key.aes_key, iv)) {
+            return -1;
+        }
+    }
+    if (!EVP_MAC_CTX_set_params(hctx, params)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int _new_session_cb(SSL* ssl, SSL_SESSION* session) {
+    char* dest = SSL_get_ex_data(ssl, session_store.index);
+    if (!dest || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+    mtx_lock(&session_store.mtx);
+    cdk_rbtree_node_t* node = cdk_rbtree_find(
+        &session_store.tree, (cdk_rbtree_key_t){.str = dest});
+    if (node) {
+        tls_session_t* s = cdk_rbtree_data(node, tls_session_t, node);
+        SSL_SESSION_free(s->session);
+        s->session = session;
+        cdk_list_remove(&s->lru);
+        cdk_list_insert_head(&session_store.lru, &s->lru);
+        mtx_unlock(&session_store.mtx);
+        return 1;
+    }
+    if (session_store.count >= SESSION_STORE_SIZE) {
+        tls_session_t* s = cdk_list_data(
+            cdk_list_tail(&session_store.lru), tls_session_t, lru);
+        cdk_rbtree_erase(&session_store.tree, &s->node);
+        cdk_list_remove(&s->lru);
+        SSL_SESSION_free(s->session);
+        free(s);
+        session_store.count--;
+    }
+    tls_session_t* s = malloc(sizeof(tls_session_t) + strlen(dest) + 1);
+    if (!s) {
+        mtx_unlock(&session_store.mtx);
+        return 0;
+    }
+    memcpy(s->dest, dest, strlen(dest) + 1);
+    s->session = session;
+    s->node.key.str = s->dest;
+    cdk_rbtree_insert(&session_store.tree, &s->node);
+    cdk_list_insert_head(&session_store.lru, &s->lru);
+    session_store.count++;
+    mtx_unlock(&session_store.mtx);
+    /**
+     * Keep the reference handed over by OpenSSL.
+     */
+    return 1;
+}
+
+/**
+ * Digest of the certificates and verification policy of a configuration.
+ */
+static bool _conf_digest(
+    cdk_tls_conf_t* tlsconf, unsigned char* md, unsigned int* mdlen) {
+    EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+    const char* fields[] = {
+        tlsconf->cafile, tlsconf->capath, tlsconf->crtfile, tlsconf->keyfile};
+
+    if (!mdctx) {
+        return false;
+    }
+    EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL);
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (fields[i]) {
+            EVP_DigestUpdate(mdctx, fields[i], strlen(fields[i]) + 1);
+        } else {
+            EVP_DigestUpdate(mdctx, "", 1);
+        }
+    }
+    EVP_DigestUpdate(mdctx, &tlsconf->verifypeer, sizeof(tlsconf->verifypeer));
+    EVP_DigestFinal_ex(mdctx, md, mdlen);
+    EVP_MD_CTX_free(mdctx);
+    return true;
+}
+
+/**
+ * Sessions are only resumed by contexts built from the same certificates and
+ * verification policy, since ticket keys are shared by all of them.
+ */
+static bool _session_id_context_set(SSL_CTX* ctx, cdk_tls_conf_t* tlsconf) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int  mdlen = 0;
+
+    if (!_conf_digest(tlsconf, md, &mdlen)) {
+        return false;
+    }
+    if (mdlen > SSL_MAX_SID_CTX_LENGTH) {
+        mdlen = SSL_MAX_SID_CTX_LENGTH;
+    }
+    return SSL_CTX_set_session_id_context(ctx, md, mdlen) == 1;
+}
 
 static int _alpn_select_cb(
     SSL*                  ssl,
@@ -46,11 +303,69 @@ static int _sni_select_cb(SSL* s, int* al, void* arg) {
     return 0;
 }
 
-static SSL_CTX* _ctx_create(cdk_tls_conf_t* tlsconf) {
+/**
+ * A DTLS cookie is an HMAC of the peer address, so the server can check that
+ * a ClientHello really comes from the address it claims without keeping any
+ * state for it. The address is the one attached by tls_dgram_peer_set.
+ */
+static bool _cookie_compute(SSL* ssl, unsigned char* cookie, size_t* len) {
+    struct sockaddr_storage* ss = SSL_get_app_data(ssl);
+    const void*              addr = NULL;
+    size_t                   addrlen = 0;
+
+    if (!ss) {
+        return false;
+    }
+    if (ss->ss_family == AF_INET) {
+        addr = ss;
+        addrlen = sizeof(struct sockaddr_in);
+    } else if (ss->ss_family == AF_INET6) {
+        addr = ss;
+        addrlen = sizeof(struct sockaddr_in6);
+    } else {
+        return false;
+    }
+    return EVP_Q_mac(
+               NULL,
+               "HMAC",
+               NULL,
+               "SHA256",
+               NULL,
+               cookie_secret,
+               sizeof(cookie_secret),
+               addr,
+               addrlen,
+               cookie,
+               DTLS1_COOKIE_LENGTH,
+               len) != NULL;
+}
+
+static int _cookie_generate_cb(
+    SSL* ssl, unsigned char* cookie, unsigned int* cookie_len) {
+    size_t len = 0;
+    if (!_cookie_compute(ssl, cookie, &len)) {
+        return 0;
+    }
+    *cookie_len = (unsigned int)len;
+    return 1;
+}
+
+static int _cookie_verify_cb(
+    SSL* ssl, const unsigned char* cookie, unsigned int cookie_len) {
+    unsigned char expected[DTLS1_COOKIE_LENGTH];
+    size_t        len = 0;
+
+    if (!_cookie_compute(ssl, expected, &len)) {
+        return 0;
+    }
+    return (len == cookie_len) && !CRYPTO_memcmp(expected, cookie, len);
+}
+
+static SSL_CTX* _ctx_create(cdk_tls_conf_t* tlsconf, bool dtls) {
     SSL_CTX* ctx = NULL;
 
     OPENSSL_init_ssl(OPENSSL_INIT_SSL_DEFAULT, NULL);
-    ctx = SSL_CTX_new(TLS_method());
+    ctx = SSL_CTX_new(dtls ? DTLS_method() : TLS_method());
     if (!ctx) {
         return NULL;
     }
@@ -92,6 +407,20 @@ static SSL_CTX* _ctx_create(cdk_tls_conf_t* tlsconf) {
      */
     SSL_CTX_set_mode(
         ctx, SSL_CTX_get_mode(ctx) | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    if (tlsconf->lowmem) {
+        SSL_CTX_set_mode(
+            ctx, SSL_CTX_get_mode(ctx) | SSL_MODE_RELEASE_BUFFERS);
+    }
+    /**
+     * OpenSSL only tries to install the negotiated keys into the kernel when
+     * the handshake completes, and keeps doing the crypto in userspace if
+     * that fails. Whether transmission got offloaded is queried by tls_ktls_tx,
+     * reception keeps going through SSL_read, which takes care of the
+     * non-application records the kernel hands back.
+     */
+    if (tlsconf->ktls && !tlsconf->membio && !dtls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
     SSL_CTX_set_verify(
         ctx,
         tlsconf->verifypeer ? SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT
@@ -99,7 +428,36 @@ static SSL_CTX* _ctx_create(cdk_tls_conf_t* tlsconf) {
         NULL);
 
     if (tlsconf->side == SIDE_SERVER) {
-        
+        /**
+         * TLS 1.2 resumes from the session cache or a ticket, TLS 1.3 only
+         * from tickets. The cache lives in the context, which is shared by
+         * the accepting channels of all pollers. It also backs the replay
+         * protection of early data, since OpenSSL then makes tickets single
+         * use.
+         */
+        if (!_session_id_context_set(ctx, tlsconf)) {
+            SSL_CTX_free(ctx);
+            return NULL;
+        }
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, _ticket_key_cb);
+        if (tlsconf->earlydata && !dtls) {
+            SSL_CTX_set_max_early_data(ctx, MAX_EARLY_DATA_SIZE);
+        }
+        if (dtls) {
+            SSL_CTX_set_cookie_generate_cb(ctx, _cookie_generate_cb);
+            SSL_CTX_set_cookie_verify_cb(ctx, _cookie_verify_cb);
+        }
+    }
+    if (tlsconf->side == SIDE_CLIENT) {
+        /**
+         * OpenSSL never looks sessions up on the client side, they are kept
+         * in session_store and handed back by tls_ssl_session_resume.
+         */
+        SSL_CTX_set_session_cache_mode(
+            ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, _new_session_cb);
     }
     return ctx;
 }
@@ -164,37 +522,246 @@ char* tls_error2string(int err) {
     return buffer;
 }
 
-cdk_tls_ctx_t* tls_ctx_create(cdk_tls_conf_t* conf) {
+static bool _string_equal(const char* s1, const char* s2) {
+    if (!s1 || !s2) {
+        return s1 == s2;
+    }
+    return !strcmp(s1, s2);
+}
+
+static const char* _string_copy(const char* str) {
+    if (!str) {
+        return NULL;
+    }
+    char* copy = malloc(strlen(str) + 1);
+    if (copy) {
+        memcpy(copy, str, strlen(str) + 1);
+    }
+    return copy;
+}
+
+static bool _conf_equal(cdk_tls_conf_t* conf1, cdk_tls_conf_t* conf2) {
+    return _string_equal(conf1->cafile, conf2->cafile) &&
+           _string_equal(conf1->capath, conf2->capath) &&
+           _string_equal(conf1->crtfile, conf2->crtfile) &&
+           _string_equal(conf1->keyfile, conf2->keyfile) &&
+           conf1->verifypeer == conf2->verifypeer &&
+           conf1->side == conf2->side && conf1->ktls == conf2->ktls &&
+           conf1->earlydata == conf2->earlydata &&
+           conf1->offload == conf2->offload &&
+           conf1->membio == conf2->membio &&
+           conf1->lowmem == conf2->lowmem;
+}
+
+/**
+ * The strings of the user's configuration may not outlive the call, the
+ * cache keeps its own copy.
+ */
+static void _conf_copy(cdk_tls_conf_t* dst, cdk_tls_conf_t* src) {
+    *dst = *src;
+    dst->cafile = _string_copy(src->cafile);
+    dst->capath = _string_copy(src->capath);
+    dst->crtfile = _string_copy(src->crtfile);
+    dst->keyfile = _string_copy(src->keyfile);
+}
+
+static void _conf_free(cdk_tls_conf_t* conf) {
+    free((char*)conf->cafile);
+    free((char*)conf->capath);
+    free((char*)conf->crtfile);
+    free((char*)conf->keyfile);
+}
+
+/**
+ * Names the configuration of an entry for the client session store, entries
+ * come and go with their channels but the fingerprint of a configuration
+ * stays the same. DTLS sessions are kept apart from TLS ones.
+ */
+static void _fingerprint_set(tls_ctx_entry_t* e) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int  mdlen = 0;
+
+    e->fingerprint[0] = '\0';
+    if (!_conf_digest(&e->conf, md, &mdlen)) {
+        return;
+    }
+    md[0] ^= e->dtls;
+    for (int i = 0; i < CONF_FINGERPRINT_LENGTH; i++) {
+        snprintf(&e->fingerprint[2 * i], 3, "%02x", md[i]);
+    }
+}
+
+static tls_ctx_entry_t* _ctx_cache_find(cdk_tls_conf_t* conf, bool dtls) {
+    for (cdk_list_node_t* n = cdk_list_head(&ctx_cache.entries);
+         n != cdk_list_sentinel(&ctx_cache.entries);
+         n = cdk_list_next(n)) {
+        tls_ctx_entry_t* e = cdk_list_data(n, tls_ctx_entry_t, node);
+        if (e->dtls == dtls && _conf_equal(&e->conf, conf)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+cdk_tls_ctx_t* tls_ctx_create(cdk_tls_conf_t* conf, bool dtls) {
     if (!conf) {
         return NULL;
     }
     if (!conf->cafile && !conf->capath && !conf->crtfile) {
         return NULL;
     }
-    SSL_CTX* ctx = _ctx_create(conf);
+    call_once(&tls_once, _tls_init);
+
+    mtx_lock(&ctx_cache.mtx);
+    tls_ctx_entry_t* e = _ctx_cache_find(conf, dtls);
+    if (e) {
+        e->refs++;
+        mtx_unlock(&ctx_cache.mtx);
+        return e;
+    }
+    mtx_unlock(&ctx_cache.mtx);
+    /**
+     * Loading certificates and keys is slow, do it without holding the lock
+     * and drop the result if another thread got there first.
+     */
+    SSL_CTX* ctx = _ctx_create(conf, dtls);
     if (!ctx) {
         return NULL;
     }
-    return ctx;
+    mtx_lock(&ctx_cache.mtx);
+    e = _ctx_cache_find(conf, dtls);
+    if (e) {
+        e->refs++;
+        mtx_unlock(&ctx_cache.mtx);
+        SSL_CTX_free(ctx);
+        return e;
+    }
+    e = malloc(sizeof(tls_ctx_entry_t));
+    if (!e) {
+        mtx_unlock(&ctx_cache.mtx);
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    _conf_copy(&e->conf, conf);
+    e->dtls = dtls;
+    e->ctx = ctx;
+    e->refs = 1;
+    _fingerprint_set(e);
+    cdk_list_insert_tail(&ctx_cache.entries, &e->node);
+    mtx_unlock(&ctx_cache.mtx);
+    return e;
+}
+
+cdk_tls_ctx_t* tls_ctx_ref(cdk_tls_ctx_t* ctx) {
+    tls_ctx_entry_t* e = ctx;
+    if (e) {
+        mtx_lock(&ctx_cache.mtx);
+        e->refs++;
+        mtx_unlock(&ctx_cache.mtx);
+    }
+    return e;
 }
 
 void tls_ctx_destroy(cdk_tls_ctx_t* ctx) {
-    if ((SSL_CTX*)ctx) {
-        SSL_CTX_free((SSL_CTX*)ctx);
-        ctx = NULL;
+    tls_ctx_entry_t* e = ctx;
+    if (!e) {
+        return;
+    }
+    mtx_lock(&ctx_cache.mtx);
+    if (--e->refs) {
+        mtx_unlock(&ctx_cache.mtx);
+        return;
+    }
+    cdk_list_remove(&e->node);
+    mtx_unlock(&ctx_cache.mtx);
+    /**
+     * SSL objects hold their own reference, the SSL_CTX stays alive until
+     * the last connection built from it is gone.
+     */
+    SSL_CTX_free(e->ctx);
+    _conf_free(&e->conf);
+    free(e);
+}
+
+bool tls_ctx_reload(cdk_tls_conf_t* conf) {
+    if (!conf) {
+        return false;
+    }
+    call_once(&tls_once, _tls_init);
+    /**
+     * The same configuration may back both TLS and DTLS channels.
+     */
+    for (int dtls = 0; dtls < 2; dtls++) {
+        SSL_CTX* ctx = _ctx_create(conf, dtls);
+        if (!ctx) {
+            return false;
+        }
+        mtx_lock(&ctx_cache.mtx);
+        tls_ctx_entry_t* e = _ctx_cache_find(conf, dtls);
+        if (!e) {
+            mtx_unlock(&ctx_cache.mtx);
+            SSL_CTX_free(ctx);
+            continue;
+        }
+        SSL_CTX* old = e->ctx;
+        e->ctx = ctx;
+        mtx_unlock(&ctx_cache.mtx);
+
+        SSL_CTX_free(old);
+    }
+    return true;
+}
+
+/**
+ * Put the SSL on a pair of memory BIOs, a read on an empty rbio asks for
+ * more input instead of reporting EOF.
+ */
+static bool _membio_attach(SSL* ssl) {
+    BIO* rbio = BIO_new(BIO_s_mem());
+    BIO* wbio = BIO_new(BIO_s_mem());
+    if (!rbio || !wbio) {
+        BIO_free(rbio);
+        BIO_free(wbio);
+        return false;
+    }
+    BIO_set_mem_eof_return(rbio, -1);
+    BIO_set_mem_eof_return(wbio, -1);
+    SSL_set_bio(ssl, rbio, wbio);
+    return true;
+}
+
+/**
+ * Bind the SSL to the socket, unless it runs over memory BIOs.
+ */
+static void _fd_bind(SSL* ssl, int fd) {
+    BIO* rbio = SSL_get_rbio(ssl);
+    if (rbio && BIO_method_type(rbio) == BIO_TYPE_MEM) {
+        return;
+    }
+    if (SSL_get_fd(ssl) != fd) {
+        SSL_set_fd(ssl, fd);
     }
 }
 
 cdk_tls_ssl_t* tls_ssl_create(cdk_tls_ctx_t* ctx) {
-    SSL* ssl = SSL_new((SSL_CTX*)ctx);
+    tls_ctx_entry_t* e = ctx;
+
+    mtx_lock(&ctx_cache.mtx);
+    SSL* ssl = SSL_new(e->ctx);
+    mtx_unlock(&ctx_cache.mtx);
     if (!ssl) {
         return NULL;
     }
+    if (e->conf.membio && !e->dtls && !_membio_attach(ssl)) {
+        SSL_free(ssl);
+        return NULL;
+    }
     return ssl;
 }
 
 void tls_ssl_destroy(cdk_tls_ssl_t* ssl) {
     if (ssl) {
+        free(SSL_get_ex_data((SSL*)ssl, session_store.index));
         SSL_shutdown((SSL*)ssl);
         SSL_free((SSL*)ssl);
         ssl = NULL;
@@ -202,7 +769,7 @@ void tls_ssl_destroy(cdk_tls_ssl_t* ssl) {
 }
 
 int tls_connect(cdk_tls_ssl_t* ssl, int fd, int* error) {
-    SSL_set_fd((SSL*)ssl, fd);
+    _fd_bind((SSL*)ssl, fd);
 
     int ret = SSL_connect((SSL*)ssl);
     if (ret <= 0) {
@@ -217,7 +784,7 @@ int tls_connect(cdk_tls_ssl_t* ssl, int fd, int* error) {
 }
 
 int tls_accept(cdk_tls_ssl_t* ssl, int fd, int* error) {
-    SSL_set_fd((SSL*)ssl, fd);
+    _fd_bind((SSL*)ssl, fd);
 
     int ret = SSL_accept((SSL*)ssl);
     if (ret <= 0) {
@@ -231,7 +798,29 @@ int tls_accept(cdk_tls_ssl_t* ssl, int fd, int* error) {
     return ret;
 }
 
+int tls_read_early_data(
+    cdk_tls_ssl_t* ssl, int fd, void* buf, int size, bool* finished, int* error) {
+    size_t nread = 0;
+
+    _fd_bind((SSL*)ssl, fd);
+
+    int ret = SSL_read_early_data((SSL*)ssl, buf, size, &nread);
+    if (ret == SSL_READ_EARLY_DATA_ERROR) {
+        int err = SSL_get_error((SSL*)ssl, ret);
+        *error = err;
+        if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE)) {
+            return 0;
+        }
+        return -1;
+    }
+    if (ret == SSL_READ_EARLY_DATA_FINISH) {
+        *finished = true;
+    }
+    return (int)nread;
+}
+
 int tls_ssl_read(cdk_tls_ssl_t* ssl, void* buf, int size, int* error) {
+    ERR_clear_error();
     int n = SSL_read((SSL*)ssl, buf, size);
     if (n <= 0) {
         int err = SSL_get_error((SSL*)ssl, n);
@@ -244,7 +833,12 @@ int tls_ssl_read(cdk_tls_ssl_t* ssl, void* buf, int size, int* error) {
     return n;
 }
 
+bool tls_ssl_pending(cdk_tls_ssl_t* ssl) {
+    return SSL_pending((SSL*)ssl) > 0 || SSL_has_pending((SSL*)ssl);
+}
+
 int tls_ssl_write(cdk_tls_ssl_t* ssl, void* buf, int size, int* error) {
+    ERR_clear_error();
     int n = SSL_write((SSL*)ssl, buf, size);
     if (n <= 0) {
         int err = SSL_get_error((SSL*)ssl, n);
@@ -257,6 +851,282 @@ int tls_ssl_write(cdk_tls_ssl_t* ssl, void* buf, int size, int* error) {
     return n;
 }
 
+bool tls_ktls_tx(cdk_tls_ssl_t* ssl) {
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio((SSL*)ssl)) > 0;
+#else
+    (void)(ssl);
+    return false;
+#endif
+}
+
+bool tls_want_write(int error) {
+    return error == SSL_ERROR_WANT_WRITE;
+}
+
+bool tls_early_data_enabled(cdk_tls_ctx_t* ctx) {
+    return ((tls_ctx_entry_t*)ctx)->conf.earlydata;
+}
+
+bool tls_offload_enabled(cdk_tls_ctx_t* ctx) {
+    return ((tls_ctx_entry_t*)ctx)->conf.offload;
+}
+
+void tls_ssl_session_resume(
+    cdk_tls_ctx_t* ctx,
+    cdk_tls_ssl_t* ssl,
+    const char*    host,
+    const char*    port) {
+    /**
+     * A session is only offered back to the configuration it was negotiated
+     * with, never to one trusting other CAs or presenting another client
+     * certificate.
+     */
+    const char* fingerprint = ((tls_ctx_entry_t*)ctx)->fingerprint;
+    if (!fingerprint[0]) {
+        return;
+    }
+    size_t len = strlen(fingerprint) + strlen(host) + strlen(port) + 3;
+    char*  dest = malloc(len);
+    if (!dest) {
+        return;
+    }
+    snprintf(dest, len, "%s/%s:%s", fingerprint, host, port);
+    /**
+     * Remember the destination, so that the tickets received during the
+     * handshake are filed under it by _new_session_cb.
+     */
+    SSL_set_ex_data((SSL*)ssl, session_store.index, dest);
+
+    mtx_lock(&session_store.mtx);
+    cdk_rbtree_node_t* node = cdk_rbtree_find(
+        &session_store.tree, (cdk_rbtree_key_t){.str = dest});
+    if (node) {
+        tls_session_t* s = cdk_rbtree_data(node, tls_session_t, node);
+        SSL_set_session((SSL*)ssl, s->session);
+        cdk_list_remove(&s->lru);
+        cdk_list_insert_head(&session_store.lru, &s->lru);
+    }
+    mtx_unlock(&session_store.mtx);
+}
+
+void tls_session_store_clear(void) {
+    call_once(&tls_once, _tls_init);
+
+    mtx_lock(&session_store.mtx);
+    while (!cdk_rbtree_empty(&session_store.tree)) {
+        tls_session_t* s = cdk_rbtree_data(
+            cdk_rbtree_first(&session_store.tree), tls_session_t, node);
+        cdk_rbtree_erase(&session_store.tree, &s->node);
+        cdk_list_remove(&s->lru);
+        SSL_SESSION_free(s->session);
+        free(s);
+    }
+    session_store.count = 0;
+    mtx_unlock(&session_store.mtx);
+}
+
+/**
+ * DTLS runs over memory BIOs: datagrams received by the channel are fed to
+ * rbio one at a time and the records OpenSSL produces are collected from wbio
+ * by tls_dgram_next, so all socket I/O keeps going through the channel.
+ */
+cdk_tls_ssl_t* tls_dgram_ssl_create(
+    cdk_tls_ctx_t* ctx, cdk_side_t side, struct sockaddr_storage* peer) {
+    SSL* ssl = tls_ssl_create(ctx);
+    if (!ssl) {
+        return NULL;
+    }
+    if (!_membio_attach(ssl)) {
+        SSL_free(ssl);
+        return NULL;
+    }
+    /**
+     * There is no socket for OpenSSL to query the path MTU from, handshake
+     * messages are fragmented to fit DTLS_MTU instead.
+     */
+    SSL_set_options(ssl, SSL_OP_NO_QUERY_MTU);
+    SSL_set_mtu(ssl, DTLS_MTU);
+    SSL_set_app_data(ssl, peer);
+    if (side == SIDE_CLIENT) {
+        SSL_set_connect_state(ssl);
+    } else {
+        SSL_set_accept_state(ssl);
+    }
+    return ssl;
+}
+
+void tls_dgram_peer_set(cdk_tls_ssl_t* ssl, struct sockaddr_storage* peer) {
+    SSL_set_app_data((SSL*)ssl, peer);
+}
+
+void tls_membio_feed(cdk_tls_ssl_t* ssl, void* data, size_t size) {
+    BIO_write(SSL_get_rbio((SSL*)ssl), data, (int)size);
+}
+
+int tls_membio_fill(
+    cdk_tls_ssl_t* ssl, int fd, void* buf, int size, int* error) {
+    ssize_t n = platform_socket_recv(fd, buf, size);
+    if (n == PLATFORM_SO_ERROR_SOCKET_ERROR) {
+        if ((platform_socket_lasterror() == PLATFORM_SO_ERROR_EAGAIN) ||
+            (platform_socket_lasterror() == PLATFORM_SO_ERROR_EWOULDBLOCK)) {
+            return 0;
+        }
+        *error = SSL_ERROR_SYSCALL;
+        return -1;
+    }
+    /**
+     * The peer closed the connection, let OpenSSL see the EOF once it has
+     * consumed what is left, exactly as it would on the socket.
+     */
+    if (n == 0) {
+        BIO_set_mem_eof_return(SSL_get_rbio((SSL*)ssl), 0);
+        return 0;
+    }
+    BIO_write(SSL_get_rbio((SSL*)ssl), buf, (int)n);
+    return (int)n;
+}
+
+size_t tls_membio_peek(cdk_tls_ssl_t* ssl, void** data) {
+    char* ptr = NULL;
+    long  len = BIO_get_mem_data(SSL_get_wbio((SSL*)ssl), &ptr);
+    *data = ptr;
+    return (len > 0) ? (size_t)len : 0;
+}
+
+void tls_membio_reset(cdk_tls_ssl_t* ssl) {
+    (void)BIO_reset(SSL_get_wbio((SSL*)ssl));
+}
+
+void tls_membio_shutdown(cdk_tls_ssl_t* ssl, int fd) {
+    void* data = NULL;
+
+    SSL_shutdown((SSL*)ssl);
+    /**
+     * Best effort, like SSL_shutdown on the socket: a peer that misses the
+     * close_notify takes the EOF as a truncation and drops the session.
+     */
+    size_t len = tls_membio_peek(ssl, &data);
+    if (len) {
+        platform_socket_send(fd, data, (int)len);
+        tls_membio_reset(ssl);
+    }
+}
+
+bool tls_lowmem_enabled(cdk_tls_ctx_t* ctx) {
+    return ((tls_ctx_entry_t*)ctx)->conf.lowmem;
+}
+
+/**
+ * OpenSSL does not tell how much an SSL holds, this counts what sits in its
+ * memory BIOs plus the record buffers, which dominate and are assumed to be
+ * allocated unless they get released while idle.
+ */
+size_t tls_ssl_memory(cdk_tls_ssl_t* ssl) {
+    size_t size = 0;
+
+    if (!ssl) {
+        return 0;
+    }
+    BIO* rbio = SSL_get_rbio((SSL*)ssl);
+    BIO* wbio = SSL_get_wbio((SSL*)ssl);
+    if (rbio && BIO_method_type(rbio) == BIO_TYPE_MEM) {
+        size += BIO_ctrl_pending(rbio);
+    }
+    if (wbio && BIO_method_type(wbio) == BIO_TYPE_MEM) {
+        size += BIO_ctrl_pending(wbio);
+    }
+    if (!(SSL_get_mode((SSL*)ssl) & SSL_MODE_RELEASE_BUFFERS) ||
+        SSL_in_init((SSL*)ssl) || tls_ssl_pending(ssl)) {
+        size += TLS_RECORD_BUFFERS_SIZE;
+    }
+    return size;
+}
+
+bool tls_membio_enabled(cdk_tls_ctx_t* ctx) {
+    return ((tls_ctx_entry_t*)ctx)->conf.membio;
+}
+
+int tls_dgram_listen(cdk_tls_ssl_t* ssl) {
+    BIO_ADDR* client = BIO_ADDR_new();
+    if (!client) {
+        return -1;
+    }
+    int ret = DTLSv1_listen((SSL*)ssl, client);
+    BIO_ADDR_free(client);
+    /**
+     * Whatever could not be parsed as a ClientHello is dropped, along with
+     * the errors it raised, which would otherwise be picked up by the next
+     * SSL_get_error on this thread.
+     */
+    (void)BIO_reset(SSL_get_rbio((SSL*)ssl));
+    ERR_clear_error();
+    return ret;
+}
+
+int tls_dgram_handshake(cdk_tls_ssl_t* ssl, int* error) {
+    ERR_clear_error();
+    int ret = SSL_do_handshake((SSL*)ssl);
+    if (ret <= 0) {
+        int err = SSL_get_error((SSL*)ssl, ret);
+        *error = err;
+        if ((err == SSL_ERROR_WANT_READ) || (err == SSL_ERROR_WANT_WRITE)) {
+            return 0;
+        }
+        return -1;
+    }
+    return ret;
+}
+
+int tls_dgram_next(cdk_tls_ssl_t* ssl, void* buf, int size) {
+    BIO*  wbio = SSL_get_wbio((SSL*)ssl);
+    char* data = NULL;
+    long  len = BIO_get_mem_data(wbio, &data);
+    long  off = 0;
+
+    if (len <= 0) {
+        return 0;
+    }
+    /**
+     * Pack as many whole records as fit into DTLS_MTU, a record larger than
+     * that (application data written in one piece) travels alone.
+     */
+    while (off + DTLS_RECORD_HEADER_LENGTH <= len) {
+        long rlen = DTLS_RECORD_HEADER_LENGTH +
+                    (((unsigned char)data[off + 11] << 8) |
+                     (unsigned char)data[off + 12]);
+        if (off + rlen > len || off + rlen > size) {
+            break;
+        }
+        if (off && off + rlen > DTLS_MTU) {
+            break;
+        }
+        off += rlen;
+    }
+    if (!off) {
+        off = (len < size) ? len : size;
+    }
+    return BIO_read(wbio, buf, (int)off);
+}
+
+int tls_dgram_timeout(cdk_tls_ssl_t* ssl) {
+    struct timeval tv;
+    if (DTLSv1_get_timeout((SSL*)ssl, &tv) <= 0) {
+        return -1;
+    }
+    return (int)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+}
+
+int tls_dgram_handle_timeout(cdk_tls_ssl_t* ssl) {
+    return DTLSv1_handle_timeout((SSL*)ssl);
+}
+
+void tls_dgram_shutdown(cdk_tls_ssl_t* ssl) {
+    if (SSL_is_init_finished((SSL*)ssl)) {
+        SSL_shutdown((SSL*)ssl);
+    }
+}
+
 void tls_ssl_sni_set(cdk_tls_ssl_t* ssl, const char* sni) {
     /* used by client side, support tls, dtls */
     SSL_set_tlsext_host_name((SSL*)ssl, sni);
@@ -264,7 +1134,8 @@ void tls_ssl_sni_set(cdk_tls_ssl_t* ssl, const char* sni) {
 
 void tls_ctx_sni_set(cdk_tls_ctx_t* ctx) {
     /* used by server side, support tls, dtls */
-    SSL_CTX_set_tlsext_servername_callback(ctx, _sni_select_cb);
+    SSL_CTX_set_tlsext_servername_callback(
+        ((tls_ctx_entry_t*)ctx)->ctx, _sni_select_cb);
 }
 
 void tls_ctx_alpn_set(
@@ -273,11 +1144,18 @@ void tls_ctx_alpn_set(
     unsigned int         protos_len,
     cdk_side_t   side) {
     /* used by dual side, support tls, dtls */
+    SSL_CTX* sslctx = ((tls_ctx_entry_t*)ctx)->ctx;
     if (side == SIDE_CLIENT) {
-        SSL_CTX_set_alpn_protos((SSL_CTX*)ctx, protos, protos_len);
+        SSL_CTX_set_alpn_protos(sslctx, protos, protos_len);
     }
     if (side == SIDE_SERVER) {
-        SSL_CTX_set_alpn_select_cb(
-            (SSL_CTX*)ctx, _alpn_select_cb, (void*)protos);
+        SSL_CTX_set_alpn_select_cb(sslctx, _alpn_select_cb, (void*)protos);
     }
 }
+
+/**
+ * Randomness that must not be guessable, from the generator of OpenSSL.
+ */
+bool tls_rand_bytes(void* buf, size_t len) {
+    return RAND_bytes((unsigned char*)buf, (int)len) > 0;
+}
@@ -23,15 +23,50 @@ _Pragma("once")
 
 #include "cdk/cdk-types.h"
 
-extern cdk_tls_ctx_t* tls_ctx_create(cdk_tls_conf_t* conf);
+#define DTLS_MTU 1200
+
+extern cdk_tls_ctx_t* tls_ctx_create(cdk_tls_conf_t* conf, bool dtls);
 extern cdk_tls_ssl_t* tls_ssl_create(cdk_tls_ctx_t* ctx);
+extern cdk_tls_ctx_t* tls_ctx_ref(cdk_tls_ctx_t* ctx);
 extern void           tls_ctx_destroy(cdk_tls_ctx_t* ctx);
+extern bool           tls_ctx_reload(cdk_tls_conf_t* conf);
 extern void           tls_ssl_destroy(cdk_tls_ssl_t* ssl);
 extern char*    tls_error2string(int err);
 extern int            tls_connect(cdk_tls_ssl_t* ssl, int fd, int* error);
 extern int            tls_accept(cdk_tls_ssl_t* ssl, int fd, int* error);
+extern int            tls_read_early_data(
+    cdk_tls_ssl_t* ssl, int fd, void* buf, int size, bool* finished, int* error);
 extern int  tls_ssl_read(cdk_tls_ssl_t* ssl, void* buf, int size, int* error);
+extern bool tls_ssl_pending(cdk_tls_ssl_t* ssl);
 extern int  tls_ssl_write(cdk_tls_ssl_t* ssl, void* buf, int size, int* error);
+extern bool tls_ktls_tx(cdk_tls_ssl_t* ssl);
+extern bool tls_want_write(int error);
+extern bool tls_early_data_enabled(cdk_tls_ctx_t* ctx);
+extern bool tls_offload_enabled(cdk_tls_ctx_t* ctx);
+extern void tls_ssl_session_resume(
+    cdk_tls_ctx_t* ctx,
+    cdk_tls_ssl_t* ssl,
+    const char*    host,
+    const char*    port);
+extern void tls_session_store_clear(void);
+extern cdk_tls_ssl_t* tls_dgram_ssl_create(
+    cdk_tls_ctx_t* ctx, cdk_side_t side, struct sockaddr_storage* peer);
+extern void tls_dgram_peer_set(cdk_tls_ssl_t* ssl, struct sockaddr_storage* peer);
+extern int  tls_dgram_listen(cdk_tls_ssl_t* ssl);
+extern int  tls_dgram_handshake(cdk_tls_ssl_t* ssl, int* error);
+extern int  tls_dgram_next(cdk_tls_ssl_t* ssl, void* buf, int size);
+extern int  tls_dgram_timeout(cdk_tls_ssl_t* ssl);
+extern int  tls_dgram_handle_timeout(cdk_tls_ssl_t* ssl);
+extern void tls_dgram_shutdown(cdk_tls_ssl_t* ssl);
+extern void   tls_membio_feed(cdk_tls_ssl_t* ssl, void* data, size_t size);
+extern int    tls_membio_fill(cdk_tls_ssl_t* ssl, int fd, void* buf, int size, int* error);
+extern size_t tls_membio_peek(cdk_tls_ssl_t* ssl, void** data);
+extern void   tls_membio_reset(cdk_tls_ssl_t* ssl);
+extern void   tls_membio_shutdown(cdk_tls_ssl_t* ssl, int fd);
+extern bool   tls_membio_enabled(cdk_tls_ctx_t* ctx);
+extern bool   tls_lowmem_enabled(cdk_tls_ctx_t* ctx);
+extern size_t tls_ssl_memory(cdk_tls_ssl_t* ssl);
+extern bool   tls_rand_bytes(void* buf, size_t len);
 extern void tls_ssl_sni_set(cdk_tls_ssl_t* ssl, const char* sni);
 extern void tls_ctx_sni_set(cdk_tls_ctx_t* ctx);
 extern void tls_ctx_alpn_set(
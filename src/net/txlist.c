@@ -22,34 +22,51 @@
 #include "txlist.h"
 #include "cdk/container/cdk-list.h"
 
-void txlist_create(cdk_list_t *list) { cdk_list_init(list); }
+void txlist_create(cdk_txlist_t *list) {
+    cdk_list_init(&list->list);
+    atomic_init(&list->depth, 0);
+}
 
-void txlist_destroy(cdk_list_t *list) {
+void txlist_destroy(cdk_txlist_t *list) {
     while (!txlist_empty(list)) {
         txlist_node_t *node =
-            cdk_list_data(cdk_list_head(list), txlist_node_t, n);
-        txlist_remove(node);
+            cdk_list_data(cdk_list_head(&list->list), txlist_node_t, n);
+        txlist_remove(list, node);
     }
 }
 
-void txlist_insert(cdk_list_t *list, void *data, size_t size, bool totail) {
+txlist_node_t *txlist_insert(cdk_txlist_t *list, void *data, size_t size, bool totail) {
     txlist_node_t *node = malloc(sizeof(txlist_node_t) + size);
     if (node) {
         memset(node, 0, sizeof(txlist_node_t) + size);
         memcpy(node->buf, data, size);
         node->len = size;
         if (totail) {
-            cdk_list_insert_tail(list, &(node->n));
+            cdk_list_insert_tail(&list->list, &(node->n));
         } else {
-            cdk_list_insert_head(list, &(node->n));
+            cdk_list_insert_head(&list->list, &(node->n));
         }
+        atomic_fetch_add(&list->depth, 1);
     }
+    return node;
 }
 
-void txlist_remove(txlist_node_t *node) {
+void txlist_remove(cdk_txlist_t *list, txlist_node_t *node) {
     cdk_list_remove(&(node->n));
+    atomic_fetch_sub(&list->depth, 1);
     free(node);
     node = NULL;
 }
 
-bool txlist_empty(cdk_list_t *list) { return cdk_list_empty(list); }
\ No newline at end of file
+bool txlist_empty(cdk_txlist_t *list) { return cdk_list_empty(&list->list); }
+
+size_t txlist_size(cdk_txlist_t *list) {
+    size_t size = 0;
+    for (cdk_list_node_t *node = cdk_list_head(&list->list);
+         node != cdk_list_sentinel(&list->list); node = cdk_list_next(node)) {
+        size += sizeof(txlist_node_t) + cdk_list_data(node, txlist_node_t, n)->len;
+    }
+    return size;
+}
+
+size_t txlist_depth(cdk_txlist_t *list) { return atomic_load(&list->depth); }
\ No newline at end of file
@@ -26,11 +26,14 @@ _Pragma("once")
 typedef struct txlist_node_s {
 	cdk_list_node_t n;
 	size_t len;
+	int segsize;
 	char buf[];
 }txlist_node_t;
 
-extern void txlist_create(cdk_list_t* list);
-extern void txlist_destroy(cdk_list_t* list);
-extern void txlist_insert(cdk_list_t* list, void* data, size_t size, bool totail);
-extern void txlist_remove(txlist_node_t* node);
-extern bool txlist_empty(cdk_list_t* list);
+extern void txlist_create(cdk_txlist_t* list);
+extern void txlist_destroy(cdk_txlist_t* list);
+extern txlist_node_t* txlist_insert(cdk_txlist_t* list, void* data, size_t size, bool totail);
+extern void txlist_remove(cdk_txlist_t* list, txlist_node_t* node);
+extern bool txlist_empty(cdk_txlist_t* list);
+extern size_t txlist_size(cdk_txlist_t* list);
+extern size_t txlist_depth(cdk_txlist_t* list);
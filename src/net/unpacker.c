@@ -22,8 +22,56 @@
 #include "cdk/cdk-types.h"
 #include "cdk/cdk-utils.h"
 #include "cdk/encoding/cdk-varint.h"
+#include "cdk/encoding/cdk-resp.h"
+#include "cdk/encoding/cdk-mqtt.h"
+#include "simd.h"
+#include "http1.h"
+#include "websocket.h"
+#include "rpc.h"
+
+#define MAX_BATCH_FRAMES 64
+
+typedef struct unpacker_batch_s {
+	cdk_frame_t frames[MAX_BATCH_FRAMES];
+	size_t      count;
+} unpacker_batch_t;
+
+/**
+ * Hand the collected frames to on_read_batch. Returns false if the channel
+ * got closed meanwhile, its receive buffer is then gone.
+ */
+static inline bool _batch_flush(cdk_channel_t* channel, unpacker_batch_t* batch) {
+	if (!batch->count) {
+		return true;
+	}
+	channel->handler->on_read_batch(channel, batch->frames, batch->count);
+	batch->count = 0;
+	return !atomic_load(&channel->closing);
+}
+
+/**
+ * Deliver a frame through on_read, or collect it for on_read_batch. Returns
+ * false if the channel got closed meanwhile, its receive buffer is then gone.
+ */
+static inline bool _frame_deliver(cdk_channel_t* channel, unpacker_batch_t* batch, char* buf, size_t len) {
+	if (channel->handler->on_read_batch) {
+		batch->frames[batch->count].buf = buf;
+		batch->frames[batch->count].len = len;
+		if (++batch->count == MAX_BATCH_FRAMES) {
+			return _batch_flush(channel, batch);
+		}
+		return true;
+	}
+	if (channel->handler->on_read) {
+		channel->handler->on_read(channel, buf, len);
+	}
+	return !atomic_load(&channel->closing);
+}
 
 static inline bool _fixedlen_unpack(cdk_channel_t* channel) {
+	unpacker_batch_t batch;
+	batch.count = 0;
+
 	char* head = channel->rxbuf.buf;
 	char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
 	char* tmp = head;
@@ -36,12 +84,15 @@ static inline bool _fixedlen_unpack(cdk_channel_t* channel) {
         if (channel->handler->unpacker->fixedlen.len > channel->rxbuf.len) {
             return false;
 		}
-		if (channel->handler->on_read) {
-			channel->handler->on_read(channel, tmp, channel->handler->unpacker->fixedlen.len);
+		if (!_frame_deliver(channel, &batch, tmp, channel->handler->unpacker->fixedlen.len)) {
+			return true;
 		}
 		tmp += channel->handler->unpacker->fixedlen.len;
 		accumulated -= channel->handler->unpacker->fixedlen.len;
 	}
+	if (!_batch_flush(channel, &batch)) {
+		return true;
+	}
 	if (tmp == head) {
 		return true;
 	}
@@ -52,60 +103,63 @@ static inline bool _fixedlen_unpack(cdk_channel_t* channel) {
     return true;
 }
 
+/**
+ * Find the first occurrence of the delimiter: candidates for its first byte
+ * are located with simd_memchr and only those are compared in full.
+ */
+static inline char* _delimiter_find(
+    char* buf, size_t len, const char* delimiter, size_t dlen) {
+    char* end = buf + len;
+
+    while ((size_t)(end - buf) >= dlen) {
+        buf = (char*)simd_memchr(buf, delimiter[0], (end - buf) - dlen + 1);
+        if (!buf) {
+            return NULL;
+        }
+        if (!memcmp(buf + 1, delimiter + 1, dlen - 1)) {
+            return buf;
+        }
+        buf++;
+    }
+    return NULL;
+}
+
 static inline bool _delimiter_unpack(cdk_channel_t* channel) {
+	unpacker_batch_t batch;
+	batch.count = 0;
+
 	char* head = channel->rxbuf.buf;
 	char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
 	char* tmp = head;
 
-	size_t dlen = strlen(channel->handler->unpacker->delimiter.delimiter);
-
-	uint32_t accumulated = (uint32_t)(tail - head);
-	if (accumulated < dlen) {
-		return true;
+	const char* delimiter = channel->handler->unpacker->delimiter.delimiter;
+	size_t      dlen = channel->unpacker.dlen;
+	if (!dlen) {
+		return false;
 	}
 	/**
-	 * for performance, thus split buffer by KMP.
+	 * What the previous reads searched in vain is skipped, the search only
+	 * goes back dlen - 1 bytes for a delimiter split across two reads.
 	 */
-	int* next = malloc(dlen * sizeof(int));
-    if (!next) {
-        return false;
-	}
-	memset(next, 0, dlen * sizeof(int));
-	int j = 0;
-	for (int i = 1; i < dlen; i++) {
-
-		while (j > 0 && channel->handler->unpacker->delimiter.delimiter[i] != channel->handler->unpacker->delimiter.delimiter[j]) {
-			j = next[j - 1];
+	char* from = head + channel->unpacker.scanned;
+	while (true) {
+		char* found = _delimiter_find(from, tail - from, delimiter, dlen);
+		if (!found) {
+			break;
 		}
-		if (channel->handler->unpacker->delimiter.delimiter[i] == channel->handler->unpacker->delimiter.delimiter[j]) {
-			j++;
+		size_t fs = (found + dlen) - tmp;
+		if (!_frame_deliver(channel, &batch, tmp, fs)) {
+			return true;
 		}
-		next[i] = j;
+		tmp += fs;
+		from = tmp;
 	}
-	j = 0;
-	for (uint32_t i = 0; i < accumulated; i++) {
-		while (j > 0 && tmp[i] != channel->handler->unpacker->delimiter.delimiter[j]) {
-			j = next[j - 1];
-		}
-		if (tmp[i] == channel->handler->unpacker->delimiter.delimiter[j]) {
-			j++;
-		}
-		if (j == dlen) {
-            if (((i - dlen + 1) + dlen) > channel->rxbuf.len) {
-                return false;
-            }
-			if (channel->handler->on_read) {
-				channel->handler->on_read(channel, tmp, ((i - dlen + 1) + dlen));
-			}
-			tmp += (i - dlen + 1) + dlen;
-			accumulated -= (uint32_t)((i - dlen + 1) + dlen);
-
-			i = -1;
-			j = 0;
-		}
+	if (!_batch_flush(channel, &batch)) {
+		return true;
 	}
-	free(next);
-	next = NULL;
+	uint32_t accumulated = (uint32_t)(tail - tmp);
+	channel->unpacker.scanned =
+		(accumulated >= dlen) ? (accumulated - (dlen - 1)) : 0;
 	if (tmp == head) {
 		return true;
 	}
@@ -121,50 +175,234 @@ static inline bool _lengthfield_unpack(cdk_channel_t* channel) {
 	uint32_t hs; /* header size  */
 	uint32_t ps; /* payload size */
 
+	unpacker_batch_t batch;
+	batch.count = 0;
+
 	char* head = channel->rxbuf.buf;
 	char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
 	char* tmp = head;
 
 	uint32_t accumulated = (uint32_t)(tail - head);
 	while (true) {
-		if (accumulated < channel->handler->unpacker->lengthfield.payload) {
-			break;
+		if (channel->unpacker.left) {
+			if (!accumulated) {
+				break;
+			}
+			uint32_t n = (accumulated < channel->unpacker.left) ? accumulated : channel->unpacker.left;
+			channel->handler->on_stream_chunk(channel, tmp, n);
+			if (atomic_load(&channel->closing)) {
+				return true;
+			}
+			tmp += n;
+			accumulated -= n;
+			channel->unpacker.left -= n;
+			if (!channel->unpacker.left && channel->handler->on_stream_end) {
+				channel->handler->on_stream_end(channel);
+				if (atomic_load(&channel->closing)) {
+					return true;
+				}
+			}
+			continue;
 		}
-		hs = channel->handler->unpacker->lengthfield.payload;
-		ps = 0;
-		if (channel->handler->unpacker->lengthfield.coding == MODE_FIXEDINT) {
+		/**
+		 * The header of a frame is decoded once, the following reads only
+		 * wait for the rest of it.
+		 */
+		if (!channel->unpacker.fs) {
+			if (accumulated < channel->handler->unpacker->lengthfield.payload) {
+				break;
+			}
+			hs = channel->handler->unpacker->lengthfield.payload;
+			ps = 0;
+			if (channel->handler->unpacker->lengthfield.coding == MODE_FIXEDINT) {
+
+				ps = *((uint32_t*)(tmp + channel->handler->unpacker->lengthfield.offset));
+				//1 means little-endian, 0 means big-endian.
+				if (cdk_utils_byteorder()) {
+					ps = ntohl(ps);
+				}
+			}
+			if (channel->handler->unpacker->lengthfield.coding == MODE_VARINT) {
+				/**
+				 * A varint is decoded as it is, least significant group
+				 * first, and only once its last byte is in.
+				 */
+				char* field = tmp + channel->handler->unpacker->lengthfield.offset;
+				int   avail = (int)(tail - field);
+				int   flexible = 0;
+				while (flexible < avail && flexible < 5 && (field[flexible] & 0x80)) {
+					flexible++;
+				}
+				if (flexible == 5) {
+					return false;
+				}
+				if (flexible == avail) {
+					break;
+				}
+				flexible = 0;
+				ps = (uint32_t)cdk_varint_decode(field, &flexible);
 
-			ps = *((uint32_t*)(tmp + channel->handler->unpacker->lengthfield.offset));
-			//1 means little-endian, 0 means big-endian.
-			if (cdk_utils_byteorder()) {
-				ps = ntohl(ps);
+				hs = channel->handler->unpacker->lengthfield.payload + flexible - channel->handler->unpacker->lengthfield.size;
 			}
+			fs = hs + ps + channel->handler->unpacker->lengthfield.adj;
+
+			if (fs > channel->rxbuf.len) {
+				if (!channel->handler->on_stream_chunk) {
+					return false;
+				}
+				/**
+				 * Too large to be buffered, only the header is, the rest is
+				 * handed over as it arrives.
+				 */
+				if (accumulated < hs) {
+					break;
+				}
+				if (!_batch_flush(channel, &batch)) {
+					return true;
+				}
+				if (channel->handler->on_stream_begin) {
+					channel->handler->on_stream_begin(channel, tmp, hs, fs);
+					if (atomic_load(&channel->closing)) {
+						return true;
+					}
+				}
+				tmp += hs;
+				accumulated -= hs;
+				channel->unpacker.left = fs - hs;
+				continue;
+			}
+			channel->unpacker.fs = fs;
+		}
+		fs = channel->unpacker.fs;
+		if (accumulated < fs) {
+			break;
+		}
+		channel->unpacker.fs = 0;
+		if (!_frame_deliver(channel, &batch, tmp, fs)) {
+			return true;
 		}
-		if (channel->handler->unpacker->lengthfield.coding == MODE_VARINT) {
+		tmp += fs;
+		accumulated -= fs;
+	}
+	if (!_batch_flush(channel, &batch)) {
+		return true;
+	}
+	if (tmp == head) {
+		return true;
+	}
+	channel->rxbuf.off = accumulated;
+	if (accumulated) {
+		memmove(channel->rxbuf.buf, tmp, accumulated);
+	}
+	return true;
+}
 
-			int flexible = (int)(tail - (tmp + channel->handler->unpacker->lengthfield.offset));
+/**
+ * A reply is complete once every value it announced is in: each one decoded
+ * takes one off the count still due and adds its own elements, except for
+ * an attribute, which only adds them. The values are decoded once, scanned
+ * keeps the offset of the next one across reads.
+ */
+static inline bool _resp_unpack(cdk_channel_t* channel) {
+	unpacker_batch_t batch;
+	batch.count = 0;
 
-			ps = (uint32_t)cdk_varint_decode(tmp + channel->handler->unpacker->lengthfield.offset, &flexible);
+	char* head = channel->rxbuf.buf;
+	char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
+	char* tmp = head;
 
-			if (cdk_utils_byteorder()) {
-				ps = ntohl(ps);
+	while (tmp < tail) {
+		if (!channel->unpacker.resp) {
+			channel->unpacker.resp = 1;
+			channel->unpacker.scanned = 0;
+		}
+		while (channel->unpacker.resp) {
+			cdk_resp_t value;
+			char*      from = tmp + channel->unpacker.scanned;
+			int        n = cdk_resp_decode(from, tail - from, &value);
+			if (n < 0) {
+				return false;
 			}
-			hs = channel->handler->unpacker->lengthfield.payload + flexible - channel->handler->unpacker->lengthfield.size;
+			if (!n) {
+				break;
+			}
+			if (channel->unpacker.resp + value.count >
+				(size_t)channel->rxbuf.len) {
+				return false;
+			}
+			channel->unpacker.scanned += n;
+			if (value.type != RESP_TYPE_ATTRIBUTE) {
+				channel->unpacker.resp--;
+			}
+			channel->unpacker.resp += (uint32_t)value.count;
 		}
-		fs = hs + ps + channel->handler->unpacker->lengthfield.adj;
+		if (channel->unpacker.resp) {
+			break;
+		}
+		size_t fs = channel->unpacker.scanned;
+		channel->unpacker.scanned = 0;
+		if (!_frame_deliver(channel, &batch, tmp, fs)) {
+			return true;
+		}
+		tmp += fs;
+	}
+	if (!_batch_flush(channel, &batch)) {
+		return true;
+	}
+	if (tmp == head) {
+		return true;
+	}
+	uint32_t accumulated = (uint32_t)(tail - tmp);
+	channel->rxbuf.off = accumulated;
+	if (accumulated) {
+		memmove(channel->rxbuf.buf, tmp, accumulated);
+	}
+	return true;
+}
 
-		if (fs > channel->rxbuf.len) {
-            return false;
+static inline bool _mqtt_unpack(cdk_channel_t* channel) {
+	unpacker_batch_t batch;
+	batch.count = 0;
+
+	char* head = channel->rxbuf.buf;
+	char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
+	char* tmp = head;
+
+	uint32_t accumulated = (uint32_t)(tail - head);
+	while (true) {
+		/**
+		 * The fixed header is decoded once, the following reads only wait
+		 * for the rest of the packet.
+		 */
+		if (!channel->unpacker.fs) {
+			uint8_t  type;
+			uint32_t remaining;
+			int      hs = cdk_mqtt_header_decode(tmp, accumulated, &type, &remaining);
+			if (hs < 0) {
+				return false;
+			}
+			if (!hs) {
+				break;
+			}
+			if (hs + remaining > channel->rxbuf.len) {
+				return false;
+			}
+			channel->unpacker.fs = hs + remaining;
 		}
+		uint32_t fs = channel->unpacker.fs;
 		if (accumulated < fs) {
 			break;
 		}
-		if (channel->handler->on_read) {
-			channel->handler->on_read(channel, tmp, fs);
+		channel->unpacker.fs = 0;
+		if (!_frame_deliver(channel, &batch, tmp, fs)) {
+			return true;
 		}
 		tmp += fs;
 		accumulated -= fs;
 	}
+	if (!_batch_flush(channel, &batch)) {
+		return true;
+	}
 	if (tmp == head) {
 		return true;
 	}
@@ -179,6 +417,22 @@ static bool _userdefined_unpack(cdk_channel_t* channel) {
 	return channel->handler->unpacker->userdefined.unpack(channel);
 }
 
+/**
+ * Work out once per channel what the unpacker needs on every read, the
+ * unpacker itself is shared by the channels of all the pollers.
+ */
+void unpacker_init(cdk_channel_t* channel) {
+    cdk_unpacker_t* unpacker = channel->handler->unpacker;
+
+    if (unpacker && unpacker->type == UNPACKER_TYPE_DELIMITER) {
+        channel->unpacker.dlen = strnlen(
+            unpacker->delimiter.delimiter, sizeof(unpacker->delimiter.delimiter));
+    }
+    if (unpacker && unpacker->type == UNPACKER_TYPE_RPC) {
+        rpc_init(channel);
+    }
+}
+
 bool unpacker_unpack(cdk_channel_t* channel) {
 	switch (channel->handler->unpacker->type)
 	{
@@ -194,6 +448,21 @@ bool unpacker_unpack(cdk_channel_t* channel) {
     case UNPACKER_TYPE_USERDEFINED: {
         return _userdefined_unpack(channel);
 	}
+    case UNPACKER_TYPE_HTTP1: {
+        return http1_unpack(channel);
+	}
+    case UNPACKER_TYPE_WEBSOCKET: {
+        return websocket_unpack(channel);
+	}
+    case UNPACKER_TYPE_RESP: {
+        return _resp_unpack(channel);
+	}
+    case UNPACKER_TYPE_MQTT: {
+        return _mqtt_unpack(channel);
+	}
+    case UNPACKER_TYPE_RPC: {
+        return rpc_unpack(channel);
+	}
 	default:
         return false;
 	}
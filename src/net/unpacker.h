@@ -23,4 +23,5 @@ _Pragma("once")
 
 #include "cdk/cdk-types.h"
 
+extern void unpacker_init(cdk_channel_t* channel);
 extern bool unpacker_unpack(cdk_channel_t* channel);
\ No newline at end of file
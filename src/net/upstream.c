@@ -0,0 +1,434 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "upstream.h"
+#include "channel.h"
+#include "cdk/cdk-time.h"
+#include "cdk/cdk-timer.h"
+#include "cdk/cdk-utils.h"
+#include "cdk/container/cdk-list.h"
+#include "cdk/net/cdk-net.h"
+#include "txlist.h"
+
+#define UPSTREAM_RING_REPLICAS 100
+#define UPSTREAM_REDIAL_DELAY  100
+#define UPSTREAM_MAX_EJECTIONS 5 /* doublings of ejecttime */
+
+static inline cdk_endpoint_t* _endpoint_of(cdk_channel_t* channel) {
+    return cdk_list_data(channel->handler, cdk_endpoint_t, handler);
+}
+
+static uint64_t _hash(const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint64_t       h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    /* FNV-1a mixes the tail poorly, finish it off for the ring. */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool _endpoint_parse(const char* str, cdk_endpoint_t* endpoint) {
+    const char* colon = strrchr(str, ':');
+    const char* host = str;
+    size_t      hlen;
+
+    if (!colon) {
+        return false;
+    }
+    hlen = colon - str;
+    if (hlen >= 2 && host[0] == '[' && host[hlen - 1] == ']') {
+        host++;
+        hlen -= 2;
+    }
+    if (!hlen || hlen >= sizeof(endpoint->host) ||
+        strlen(colon + 1) >= sizeof(endpoint->port)) {
+        return false;
+    }
+    memcpy(endpoint->host, host, hlen);
+    endpoint->host[hlen] = '\0';
+    strcpy(endpoint->port, colon + 1);
+    return true;
+}
+
+static int _ring_cmp(const void* a, const void* b) {
+    uint64_t ha = *(const uint64_t*)a;
+    uint64_t hb = *(const uint64_t*)b;
+    return (ha > hb) - (ha < hb);
+}
+
+static bool _ring_build(cdk_upstream_t* upstream) {
+    upstream->ringsize = (size_t)upstream->count * UPSTREAM_RING_REPLICAS;
+    upstream->ring = malloc(upstream->ringsize * sizeof(*upstream->ring));
+    if (!upstream->ring) {
+        return false;
+    }
+    size_t n = 0;
+    for (int i = 0; i < upstream->count; i++) {
+        cdk_endpoint_t* endpoint = &upstream->endpoints[i];
+        for (int r = 0; r < UPSTREAM_RING_REPLICAS; r++) {
+            char vnode[NI_MAXHOST + 32];
+            int  len = snprintf(
+                vnode,
+                sizeof(vnode),
+                "%s:%s#%d",
+                endpoint->host,
+                endpoint->port,
+                r);
+            upstream->ring[n].hash = _hash(vnode, len);
+            upstream->ring[n].endpoint = i;
+            n++;
+        }
+    }
+    qsort(
+        upstream->ring, upstream->ringsize, sizeof(*upstream->ring), _ring_cmp);
+    return true;
+}
+
+static void _upstream_free_cb(void* param) {
+    cdk_upstream_t* upstream = param;
+
+    free(upstream->ring);
+    free(upstream->endpoints);
+    free(upstream);
+}
+
+/**
+ * The endpoint has no channel nor redial left. Channels of the upstream
+ * may still be on their way down, it is freed as late as they are. The
+ * timer goes to the poller the endpoint retires on: that one may be going
+ * down with the engine, whose round-robin then has no poller left to offer
+ * and would wait forever.
+ */
+static void _endpoint_retire(cdk_endpoint_t* endpoint, cdk_poller_t* poller) {
+    cdk_upstream_t* upstream = endpoint->upstream;
+
+    if (atomic_fetch_sub(&upstream->refs, 1) == 1) {
+        cdk_timer_add(
+            poller->timermgr,
+            _upstream_free_cb,
+            upstream,
+            CHANNEL_DELAYED_DESTROY_TIME,
+            false);
+    }
+}
+
+static void _endpoint_dial(cdk_endpoint_t* endpoint) {
+    cdk_net_dial("tcp", endpoint->host, endpoint->port, &endpoint->handler);
+}
+
+static void _redial_cb(void* param) {
+    cdk_endpoint_t* endpoint = param;
+    cdk_upstream_t* upstream = endpoint->upstream;
+
+    if (endpoint->ejected) {
+        endpoint->ejected = false;
+        atomic_fetch_sub(&upstream->nejected, 1);
+    }
+    if (atomic_load(&upstream->destroyed)) {
+        _endpoint_retire(endpoint, endpoint->poller);
+        return;
+    }
+    /* fired by poller_destroy, the engine is going down. */
+    if (!endpoint->poller->active) {
+        return;
+    }
+    _endpoint_dial(endpoint);
+}
+
+/**
+ * Errors that say something about the peer, a close asked for by the user
+ * or the poller going away don't count against it.
+ */
+static bool _error_is_failure(cdk_channel_error_t error) {
+    switch (error.code) {
+    case CHANNEL_ERROR_WR_TIMEOUT:
+    case CHANNEL_ERROR_RD_TIMEOUT:
+    case CHANNEL_ERROR_CONN_TIMEOUT:
+    case CHANNEL_ERROR_SYSCALL_FAIL:
+    case CHANNEL_ERROR_TLS_FAIL:
+    case CHANNEL_ERROR_BUFFER_OVERFLOW:
+    case CHANNEL_ERROR_RESOLVE_FAIL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Eject the endpoint after ejectafter consecutive failures, for ejecttime
+ * doubled by each ejection since it last connected, unless that would take
+ * out more than half of the upstream.
+ */
+static int _outlier_check(cdk_endpoint_t* endpoint) {
+    cdk_upstream_t* upstream = endpoint->upstream;
+
+    if (!upstream->ejectafter || endpoint->failures < upstream->ejectafter) {
+        return 0;
+    }
+    int nejected = atomic_fetch_add(&upstream->nejected, 1);
+    if ((nejected + 1) * 2 > upstream->count) {
+        atomic_fetch_sub(&upstream->nejected, 1);
+        return 0;
+    }
+    int shift = endpoint->ejections < UPSTREAM_MAX_EJECTIONS
+                    ? endpoint->ejections
+                    : UPSTREAM_MAX_EJECTIONS;
+    endpoint->ejected = true;
+    endpoint->ejections++;
+    endpoint->failures = 0;
+    return upstream->ejecttime << shift;
+}
+
+static void _upstream_on_connect(cdk_channel_t* channel) {
+    cdk_endpoint_t* endpoint = _endpoint_of(channel);
+
+    endpoint->failures = 0;
+    endpoint->ejections = 0;
+    atomic_store(&endpoint->channel, channel);
+
+    if (endpoint->upstream->user->on_connect) {
+        endpoint->upstream->user->on_connect(channel);
+    }
+    /* dialed before the upstream was destroyed, missed by it. */
+    if (atomic_load(&endpoint->upstream->destroyed)) {
+        cdk_net_close(channel);
+    }
+}
+
+static void
+_upstream_on_close(cdk_channel_t* channel, cdk_channel_error_t error) {
+    cdk_endpoint_t* endpoint = _endpoint_of(channel);
+    cdk_upstream_t* upstream = endpoint->upstream;
+    cdk_channel_t*  expected = channel;
+
+    atomic_compare_exchange_strong(&endpoint->channel, &expected, NULL);
+
+    if (upstream->user->on_close) {
+        upstream->user->on_close(channel, error);
+    }
+    if (atomic_load(&upstream->destroyed)) {
+        _endpoint_retire(endpoint, channel->poller);
+        return;
+    }
+    int delay = 0;
+    if (_error_is_failure(error)) {
+        endpoint->failures++;
+        delay = _outlier_check(endpoint);
+        if (!delay) {
+            delay = UPSTREAM_REDIAL_DELAY * endpoint->failures;
+        }
+    }
+    endpoint->poller = channel->poller;
+    cdk_timer_add(
+        channel->poller->timermgr, _redial_cb, endpoint, delay, false);
+}
+
+/**
+ * The writes queued on the channel, counted as they are queued, so that a
+ * backend whose socket stopped draining shows up as loaded right away.
+ */
+static inline size_t _channel_load(cdk_channel_t* channel) {
+    size_t load = txlist_depth(&channel->txlist);
+    if (channel->handler->unpacker &&
+        channel->handler->unpacker->type == UNPACKER_TYPE_RPC) {
+        load += atomic_load(&channel->tcp.rpc.inflight);
+    }
+    return load;
+}
+
+static cdk_channel_t* _roundrobin(cdk_upstream_t* upstream) {
+    size_t start = atomic_fetch_add(&upstream->next, 1);
+
+    for (int i = 0; i < upstream->count; i++) {
+        cdk_endpoint_t* endpoint =
+            &upstream->endpoints[(start + i) % upstream->count];
+        cdk_channel_t* channel = atomic_load(&endpoint->channel);
+        if (channel) {
+            return channel;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The scan starts at the round-robin cursor so that ties don't all land on
+ * the first endpoint.
+ */
+static cdk_channel_t* _leastoutstanding(cdk_upstream_t* upstream) {
+    size_t         start = atomic_fetch_add(&upstream->next, 1);
+    cdk_channel_t* best = NULL;
+    size_t         bestload = SIZE_MAX;
+
+    for (int i = 0; i < upstream->count; i++) {
+        cdk_endpoint_t* endpoint =
+            &upstream->endpoints[(start + i) % upstream->count];
+        cdk_channel_t* channel = atomic_load(&endpoint->channel);
+        if (!channel) {
+            continue;
+        }
+        size_t load = _channel_load(channel);
+        if (load < bestload) {
+            best = channel;
+            bestload = load;
+        }
+    }
+    return best;
+}
+
+static cdk_channel_t* _p2c(cdk_upstream_t* upstream) {
+    if (upstream->count < 2) {
+        return _roundrobin(upstream);
+    }
+    int a = cdk_utils_rand(0, upstream->count - 1);
+    int b = cdk_utils_rand(0, upstream->count - 2);
+    if (b >= a) {
+        b++;
+    }
+    cdk_endpoint_t* ea = &upstream->endpoints[a];
+    cdk_endpoint_t* eb = &upstream->endpoints[b];
+    cdk_channel_t*  ca = atomic_load(&ea->channel);
+    cdk_channel_t*  cb = atomic_load(&eb->channel);
+
+    if (ca && cb) {
+        return _channel_load(cb) < _channel_load(ca) ? cb : ca;
+    }
+    if (ca || cb) {
+        return ca ? ca : cb;
+    }
+    /* both are down, don't fail while others are up. */
+    return _leastoutstanding(upstream);
+}
+
+/**
+ * The key goes to the first endpoint clockwise on the ring that is up, so
+ * only the keys of an endpoint going down move, and they come back to it.
+ */
+static cdk_channel_t* _consistenthash(
+    cdk_upstream_t* upstream, const void* key, size_t keylen) {
+    uint64_t h = _hash(key, keylen);
+    size_t   lo = 0;
+    size_t   hi = upstream->ringsize;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (upstream->ring[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (size_t i = 0; i < upstream->ringsize; i++) {
+        int idx = upstream->ring[(lo + i) % upstream->ringsize].endpoint;
+        cdk_channel_t* channel = atomic_load(&upstream->endpoints[idx].channel);
+        if (channel) {
+            return channel;
+        }
+    }
+    return NULL;
+}
+
+cdk_upstream_t*
+upstream_create(cdk_upstream_conf_t* conf, cdk_handler_t* handler) {
+    if (conf->count <= 0 || conf->balancer <= BALANCER_BGN ||
+        conf->balancer >= BALANCER_END) {
+        return NULL;
+    }
+    cdk_upstream_t* upstream = malloc(sizeof(cdk_upstream_t));
+    if (!upstream) {
+        return NULL;
+    }
+    memset(upstream, 0, sizeof(cdk_upstream_t));
+    upstream->endpoints = malloc(conf->count * sizeof(cdk_endpoint_t));
+    if (!upstream->endpoints) {
+        free(upstream);
+        return NULL;
+    }
+    memset(upstream->endpoints, 0, conf->count * sizeof(cdk_endpoint_t));
+    upstream->count = conf->count;
+    upstream->balancer = conf->balancer;
+    upstream->user = handler;
+    upstream->ejectafter = conf->ejectafter;
+    upstream->ejecttime = conf->ejecttime;
+
+    for (int i = 0; i < conf->count; i++) {
+        cdk_endpoint_t* endpoint = &upstream->endpoints[i];
+        if (!_endpoint_parse(conf->endpoints[i], endpoint)) {
+            free(upstream->endpoints);
+            free(upstream);
+            return NULL;
+        }
+        endpoint->upstream = upstream;
+        endpoint->handler = *handler;
+        endpoint->handler.on_connect = _upstream_on_connect;
+        endpoint->handler.on_close = _upstream_on_close;
+        atomic_init(&endpoint->channel, NULL);
+    }
+    if (upstream->balancer == BALANCER_CONSISTENTHASH &&
+        !_ring_build(upstream)) {
+        free(upstream->endpoints);
+        free(upstream);
+        return NULL;
+    }
+    atomic_init(&upstream->refs, upstream->count);
+    for (int i = 0; i < upstream->count; i++) {
+        _endpoint_dial(&upstream->endpoints[i]);
+    }
+    return upstream;
+}
+
+/**
+ * Endpoints waiting to be redialed retire when their timer fires, the
+ * others once their channel has closed.
+ */
+void upstream_destroy(cdk_upstream_t* upstream) {
+    atomic_store(&upstream->destroyed, true);
+
+    for (int i = 0; i < upstream->count; i++) {
+        cdk_channel_t* channel = atomic_load(&upstream->endpoints[i].channel);
+        if (channel) {
+            cdk_net_close(channel);
+        }
+    }
+}
+
+cdk_channel_t* upstream_select(
+    cdk_upstream_t* upstream, const void* key, size_t keylen) {
+    if (atomic_load(&upstream->destroyed)) {
+        return NULL;
+    }
+    switch (upstream->balancer) {
+    case BALANCER_ROUNDROBIN:
+        return _roundrobin(upstream);
+    case BALANCER_LEASTOUTSTANDING:
+        return _leastoutstanding(upstream);
+    case BALANCER_P2C:
+        return _p2c(upstream);
+    case BALANCER_CONSISTENTHASH:
+        return _consistenthash(upstream, key, keylen);
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,406 @@
+/** Copyright (c), Wu Jin <wujin.developer@gmail.com>
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "websocket.h"
+#include "channel.h"
+#include "http1.h"
+#include "simd.h"
+#include "tls.h"
+#include "platform/platform-socket.h"
+#include "cdk/crypto/cdk-sha1.h"
+#include "cdk/encoding/cdk-base64.h"
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/**
+ * Sec-WebSocket-Accept for a Sec-WebSocket-Key: the base64 of the SHA-1 of
+ * the key followed by the GUID, 28 characters.
+ */
+static void _accept_make(const char* key, size_t klen, char accept[32]) {
+    cdk_sha1_t sha1;
+    uint8_t    digest[20];
+    size_t     len = 0;
+
+    cdk_sha1_init(&sha1);
+    cdk_sha1_update(&sha1, (uint8_t*)key, klen);
+    cdk_sha1_update(&sha1, (uint8_t*)WEBSOCKET_GUID, sizeof(WEBSOCKET_GUID) - 1);
+    cdk_sha1_final(&sha1, digest);
+
+    cdk_base64_encode(digest, sizeof(digest), (uint8_t*)accept, &len);
+    accept[len] = '\0';
+}
+
+static inline bool _frame_is(cdk_frame_t* frame, const char* str) {
+    return frame && frame->len == strlen(str) && !memcmp(frame->buf, str, frame->len);
+}
+
+static void _channel_fail(cdk_channel_t* channel, int code, char* codestr) {
+    cdk_channel_error_t error = {.code = code, .codestr = codestr};
+
+    channel_error_update(channel, error);
+    channel_destroy(channel);
+}
+
+/**
+ * Close the channel for a peer breaking the protocol. The receive buffer is
+ * gone afterwards, so this is what websocket_unpack returns.
+ */
+static bool _protocol_fail(cdk_channel_t* channel) {
+    _channel_fail(
+        channel, CHANNEL_ERROR_PROTOCOL_FAIL, CHANNEL_ERROR_PROTOCOL_FAIL_STR);
+    return true;
+}
+
+/**
+ * Write the frame header and return its size, the masking key is appended
+ * when mask is given.
+ */
+static size_t _header_encode(
+    uint8_t* hdr, cdk_websocket_opcode_t opcode, size_t size, const uint8_t* mask) {
+    size_t hs = 2;
+
+    hdr[0] = 0x80 | (uint8_t)opcode;
+    if (size < 126) {
+        hdr[1] = (uint8_t)size;
+    } else if (size <= UINT16_MAX) {
+        hdr[1] = 126;
+        hdr[2] = (uint8_t)(size >> 8);
+        hdr[3] = (uint8_t)size;
+        hs += 2;
+    } else {
+        hdr[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            hdr[2 + i] = (uint8_t)((uint64_t)size >> (56 - 8 * i));
+        }
+        hs += 8;
+    }
+    if (mask) {
+        hdr[1] |= 0x80;
+        memcpy(hdr + hs, mask, 4);
+        hs += 4;
+    }
+    return hs;
+}
+
+/**
+ * Frames from a server go out as header and payload in one gathered write,
+ * the payload untouched. A client has to mask it, so it works on a copy.
+ */
+void websocket_send(
+    cdk_channel_t* channel, cdk_websocket_opcode_t opcode, void* data, size_t size) {
+    uint8_t hdr[WEBSOCKET_MAX_HEADER];
+
+    if (atomic_load(&channel->closing) || channel->unpacker.websocket.closesent) {
+        return;
+    }
+    if (opcode == WEBSOCKET_OPCODE_CLOSE) {
+        channel->unpacker.websocket.closesent = true;
+    }
+    if (channel->side == SIDE_SERVER) {
+        size_t hs = _header_encode(hdr, opcode, size, NULL);
+        void*  bufs[2] = {hdr, data};
+        size_t lens[2] = {hs, size};
+
+        channel_explicit_sendv(channel, bufs, lens, size ? 2 : 1);
+        return;
+    }
+    /* RFC 6455 wants masks the peer cannot predict. */
+    uint8_t mask[4];
+    if (!tls_rand_bytes(mask, sizeof(mask))) {
+        _channel_fail(
+            channel,
+            CHANNEL_ERROR_SYSCALL_FAIL,
+            platform_socket_error2string(EIO));
+        return;
+    }
+    size_t hs = _header_encode(hdr, opcode, size, mask);
+    char*  frame = malloc(hs + size);
+    if (!frame) {
+        _channel_fail(
+            channel,
+            CHANNEL_ERROR_SYSCALL_FAIL,
+            platform_socket_error2string(ENOMEM));
+        return;
+    }
+    memcpy(frame, hdr, hs);
+    memcpy(frame + hs, data, size);
+    simd_xormask(frame + hs, size, mask);
+
+    channel_explicit_send(channel, frame, hs + size);
+    free(frame);
+}
+
+/**
+ * Send the upgrade request of a client, the key is kept as the accept value
+ * the server has to answer with.
+ */
+void websocket_upgrade(cdk_channel_t* channel) {
+    cdk_unpacker_t* unpacker = channel->handler->unpacker;
+    uint8_t         nonce[16];
+    char            key[32];
+    size_t          klen = 0;
+    char            request[1024];
+
+    if (!tls_rand_bytes(nonce, sizeof(nonce))) {
+        _channel_fail(
+            channel,
+            CHANNEL_ERROR_SYSCALL_FAIL,
+            platform_socket_error2string(EIO));
+        return;
+    }
+    cdk_base64_encode(nonce, sizeof(nonce), (uint8_t*)key, &klen);
+    key[klen] = '\0';
+    _accept_make(key, klen, channel->unpacker.websocket.accept);
+
+    int n = snprintf(
+        request,
+        sizeof(request),
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: %s\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n",
+        unpacker->websocket.path ? unpacker->websocket.path : "/",
+        unpacker->websocket.host ? unpacker->websocket.host : "localhost",
+        key);
+    if (n < 0 || n >= (int)sizeof(request)) {
+        _channel_fail(
+            channel,
+            CHANNEL_ERROR_BUFFER_OVERFLOW,
+            CHANNEL_ERROR_BUFFER_OVERFLOW_STR);
+        return;
+    }
+    channel_explicit_send(channel, request, n);
+}
+
+/**
+ * Check the upgrade request or response at the head of the receive buffer,
+ * answering the request on the server side, with 400 Bad Request if it is
+ * not one. Returns false if it does not upgrade the connection.
+ */
+static bool _handshake(cdk_channel_t* channel, char* buf, size_t hlen) {
+    static const char   badrequest[] = "HTTP/1.1 400 Bad Request\r\n"
+                                       "Connection: close\r\n"
+                                       "Content-Length: 0\r\n\r\n";
+    cdk_http1_message_t msg;
+    char                response[256];
+
+    if (channel->side == SIDE_CLIENT) {
+        return http1_head_parse(buf, hlen, &msg) && !msg.request &&
+               msg.status == 101 &&
+               _frame_is(http1_header_find(&msg, "sec-websocket-accept"),
+                         channel->unpacker.websocket.accept);
+    }
+    if (!http1_head_parse(buf, hlen, &msg)) {
+        channel_explicit_send(channel, (void*)badrequest, sizeof(badrequest) - 1);
+        return false;
+    }
+    cdk_frame_t* upgrade = http1_header_find(&msg, "upgrade");
+    cdk_frame_t* connection = http1_header_find(&msg, "connection");
+    cdk_frame_t* key = http1_header_find(&msg, "sec-websocket-key");
+    if (!msg.request || !_frame_is(&msg.method, "GET") || !upgrade ||
+        !http1_token_has(upgrade, "websocket", false) || !connection ||
+        !http1_token_has(connection, "upgrade", false) || !key ||
+        key->len != 24 ||
+        !_frame_is(http1_header_find(&msg, "sec-websocket-version"), "13")) {
+        channel_explicit_send(channel, (void*)badrequest, sizeof(badrequest) - 1);
+        return false;
+    }
+    char accept[32];
+    _accept_make(key->buf, key->len, accept);
+
+    int n = snprintf(
+        response,
+        sizeof(response),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n",
+        accept);
+    channel_explicit_send(channel, response, n);
+    return true;
+}
+
+/**
+ * Hand a message to on_read and answer the control frames. Returns false if
+ * the channel got closed meanwhile, its receive buffer is then gone.
+ */
+static bool _message_deliver(
+    cdk_channel_t* channel, cdk_websocket_opcode_t opcode, char* buf, size_t len) {
+    cdk_websocket_message_t msg = {
+        .opcode = opcode, .payload = {.buf = buf, .len = len}};
+
+    if (channel->handler->on_read) {
+        channel->handler->on_read(channel, &msg, sizeof(cdk_websocket_message_t));
+        if (atomic_load(&channel->closing)) {
+            return false;
+        }
+    }
+    if (opcode == WEBSOCKET_OPCODE_PING) {
+        websocket_send(channel, WEBSOCKET_OPCODE_PONG, buf, len);
+    }
+    if (opcode == WEBSOCKET_OPCODE_CLOSE) {
+        /* echo the status code only, as RFC 6455 suggests. */
+        websocket_send(channel, WEBSOCKET_OPCODE_CLOSE, buf, (len < 2) ? len : 2);
+        cdk_channel_error_t error = {
+            .code = CHANNEL_ERROR_USER_CLOSE,
+            .codestr = CHANNEL_ERROR_USER_CLOSE_STR};
+        channel_error_update(channel, error);
+        channel_destroy(channel);
+    }
+    return !atomic_load(&channel->closing);
+}
+
+bool websocket_unpack(cdk_channel_t* channel) {
+    char* head = channel->rxbuf.buf;
+    char* tail = (char*)channel->rxbuf.buf + channel->rxbuf.off;
+    char* tmp = head;
+
+    if (!channel->unpacker.websocket.upgraded) {
+        size_t hlen = http1_head_find(tmp, tail - tmp, &channel->unpacker.scanned);
+        if (!hlen) {
+            return true;
+        }
+        if (!_handshake(channel, tmp, hlen)) {
+            return _protocol_fail(channel);
+        }
+        if (atomic_load(&channel->closing)) {
+            return true;
+        }
+        channel->unpacker.websocket.upgraded = true;
+        tmp += hlen;
+
+        if (channel->side == SIDE_SERVER) {
+            if (channel->handler->on_accept) {
+                channel->handler->on_accept(channel);
+            }
+        } else {
+            if (channel->handler->on_connect) {
+                channel->handler->on_connect(channel);
+            }
+        }
+        if (atomic_load(&channel->closing)) {
+            return true;
+        }
+    }
+    /**
+     * A fragmented message is assembled at tmp, the frames still to come
+     * follow it from rpos on. Frames are only looked at once complete.
+     */
+    while (true) {
+        uint8_t* f = (uint8_t*)tmp + channel->unpacker.websocket.rpos;
+        size_t   avail = (uint8_t*)tail - f;
+        if (avail < 2) {
+            break;
+        }
+        bool     fin = f[0] & 0x80;
+        uint8_t  opcode = f[0] & 0x0f;
+        bool     masked = f[1] & 0x80;
+        uint64_t plen = f[1] & 0x7f;
+        size_t   hs = 2 + ((plen == 126) ? 2 : (plen == 127) ? 8 : 0) + (masked ? 4 : 0);
+
+        /* no extension is negotiated, the RSV bits must be clear. */
+        if ((f[0] & 0x70) || masked != (channel->side == SIDE_SERVER)) {
+            return _protocol_fail(channel);
+        }
+        if (avail < hs) {
+            break;
+        }
+        if (plen == 126) {
+            plen = ((uint64_t)f[2] << 8) | f[3];
+        } else if (plen == 127) {
+            plen = 0;
+            for (int i = 0; i < 8; i++) {
+                plen = (plen << 8) | f[2 + i];
+            }
+        }
+        if (opcode >= WEBSOCKET_OPCODE_CLOSE) {
+            if (!fin || plen > 125 || opcode > WEBSOCKET_OPCODE_PONG) {
+                return _protocol_fail(channel);
+            }
+        } else if (opcode > WEBSOCKET_OPCODE_BINARY ||
+                   (opcode == WEBSOCKET_OPCODE_CONTINUATION) != (channel->unpacker.websocket.opcode != 0)) {
+            return _protocol_fail(channel);
+        }
+        if (plen > (uint64_t)channel->rxbuf.len ||
+            channel->unpacker.websocket.rpos + hs + plen >
+                (uint64_t)channel->rxbuf.len) {
+            return false;
+        }
+        if (avail < hs + plen) {
+            break;
+        }
+        char* payload = (char*)f + hs;
+        if (masked) {
+            simd_xormask(payload, (size_t)plen, f + hs - 4);
+        }
+        size_t fs = hs + (size_t)plen;
+
+        if (opcode >= WEBSOCKET_OPCODE_CLOSE) {
+            if (!_message_deliver(channel, opcode, payload, (size_t)plen)) {
+                return true;
+            }
+        } else if (fin && opcode != WEBSOCKET_OPCODE_CONTINUATION) {
+            /* an unfragmented message is handed over where it lies. */
+            if (!_message_deliver(channel, opcode, payload, (size_t)plen)) {
+                return true;
+            }
+        } else {
+            memmove(tmp + channel->unpacker.websocket.mlen, payload, (size_t)plen);
+            channel->unpacker.websocket.mlen += (uint32_t)plen;
+            if (opcode != WEBSOCKET_OPCODE_CONTINUATION) {
+                channel->unpacker.websocket.opcode = opcode;
+            }
+            channel->unpacker.websocket.rpos += (uint32_t)fs;
+            if (fin) {
+                size_t mlen = channel->unpacker.websocket.mlen;
+                opcode = channel->unpacker.websocket.opcode;
+                fs = channel->unpacker.websocket.rpos;
+                channel->unpacker.websocket.opcode = 0;
+                channel->unpacker.websocket.mlen = 0;
+                channel->unpacker.websocket.rpos = 0;
+                if (!_message_deliver(channel, opcode, tmp, mlen)) {
+                    return true;
+                }
+                tmp += fs;
+            }
+            continue;
+        }
+        if (channel->unpacker.websocket.opcode) {
+            channel->unpacker.websocket.rpos += (uint32_t)fs;
+        } else {
+            tmp += fs;
+        }
+    }
+    if (tmp == head) {
+        return true;
+    }
+    uint32_t accumulated = (uint32_t)(tail - tmp);
+    channel->rxbuf.off = accumulated;
+    if (accumulated) {
+        memmove(channel->rxbuf.buf, tmp, accumulated);
+    }
+    return true;
+}
@@ -32,6 +32,8 @@ _Pragma("once")
 #define PLATFORM_SO_ERROR_SOCKET_ERROR -1
 #endif
 
+#define PLATFORM_SENDV_MAX 64
+
 #if defined(_WIN32)
 #define PLATFORM_SO_ERROR_EAGAIN WSAEWOULDBLOCK
 #define PLATFORM_SO_ERROR_EWOULDBLOCK WSAEWOULDBLOCK
@@ -53,21 +55,26 @@ extern void       platform_socket_maxseg(cdk_sock_t sock);
 extern void       platform_socket_nonblock(cdk_sock_t sock);
 extern void       platform_socket_reuse_addr(cdk_sock_t sock);
 extern void       platform_socket_reuse_port(cdk_sock_t sock);
+extern void       platform_socket_gro(cdk_sock_t sock, bool on);
 extern int        platform_socket_extract_family(cdk_sock_t sock);
 extern void       platform_socket_startup(void);
 extern void       platform_socket_cleanup(void);
 extern cdk_sock_t platform_socket_accept(cdk_sock_t sock, bool nonblocking);
-extern cdk_sock_t platform_socket_listen(const char* restrict host, const char* restrict port, int protocol, int idx, int cores, bool nonblocking);
-extern cdk_sock_t platform_socket_dial(const char* restrict host, const char* restrict port, int protocol, bool* connected, bool nonblocking);
+extern int        platform_socket_resolve(const char* restrict host, const char* restrict port, int protocol, bool passive, struct sockaddr_storage* addrs, socklen_t* lens, int max);
+extern bool       platform_socket_unix_address(const char* restrict path, struct sockaddr_storage* ss, socklen_t* len);
+extern cdk_sock_t platform_socket_listen(struct sockaddr_storage* ss, socklen_t len, int protocol, int idx, int cores, bool nonblocking);
+extern cdk_sock_t platform_socket_dial(struct sockaddr_storage* ss, socklen_t len, int protocol, bool* connected, bool nonblocking);
 extern void       platform_socket_close(cdk_sock_t sock);
+extern void       platform_socket_unix_unlink(cdk_sock_t sock);
 extern int        platform_socket_getaddrfamily(cdk_sock_t sock);
 extern int        platform_socket_getsocktype(cdk_sock_t sock);
 extern ssize_t    platform_socket_recv(cdk_sock_t sock, void* buf, int size);
 extern ssize_t    platform_socket_send(cdk_sock_t sock, void* buf, int size);
+extern ssize_t    platform_socket_sendv(cdk_sock_t sock, void** bufs, size_t* lens, int count);
 extern ssize_t    platform_socket_recvall(cdk_sock_t sock, void* buf, int size);
 extern ssize_t    platform_socket_sendall(cdk_sock_t sock, void* buf, int size);
-extern ssize_t    platform_socket_recvfrom(cdk_sock_t sock, void* buf, int size, struct sockaddr_storage* ss, socklen_t* lenptr);
-extern ssize_t    platform_socket_sendto(cdk_sock_t sock, void* buf, int size, struct sockaddr_storage* ss, socklen_t len);
+extern ssize_t    platform_socket_recvfrom(cdk_sock_t sock, void* buf, int size, struct sockaddr_storage* ss, socklen_t* lenptr, int* segsize);
+extern ssize_t    platform_socket_sendto(cdk_sock_t sock, void* buf, int size, struct sockaddr_storage* ss, socklen_t len, int segsize, bool* nogso);
 extern int          platform_socket_socketpair(int domain, int type, int protocol, cdk_sock_t socks[2]);
 extern char*  platform_socket_error2string(int error);
 extern int          platform_socket_lasterror(void);
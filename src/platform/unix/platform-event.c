@@ -91,14 +91,15 @@ void platform_event_add(cdk_pollfd_t pfd, cdk_sock_t sfd, int events, void* ud)
 
 void platform_event_mod(cdk_pollfd_t pfd, cdk_sock_t sfd, int events, void* ud) {
     struct kevent ke = {0};
-	if (events & EVENT_RD) {
-		EV_SET(&ke, sfd, EVFILT_READ, EV_ADD, 0, 0, ud);
-		kevent(pfd, &ke, 1, NULL, 0, NULL);
-	}
-	if (events & EVENT_WR) {
-		EV_SET(&ke, sfd, EVFILT_WRITE, EV_ADD, 0, 0, ud);
-		kevent(pfd, &ke, 1, NULL, 0, NULL);
-	}
+	/**
+	 * Unlike EPOLL_CTL_MOD, filters are independent in kqueue, the ones no
+	 * longer wanted have to be deleted explicitly.
+	 */
+	EV_SET(&ke, sfd, EVFILT_READ, (events & EVENT_RD) ? EV_ADD : EV_DELETE, 0, 0, ud);
+	kevent(pfd, &ke, 1, NULL, 0, NULL);
+
+	EV_SET(&ke, sfd, EVFILT_WRITE, (events & EVENT_WR) ? EV_ADD : EV_DELETE, 0, 0, ud);
+	kevent(pfd, &ke, 1, NULL, 0, NULL);
 }
 
 void platform_event_del(cdk_pollfd_t pfd, cdk_sock_t sfd) {
@@ -20,10 +20,21 @@
  */
 
 #include "cdk/cdk-types.h"
+#include "platform/platform-socket.h"
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #define TCPv4_MSS 536
 #define TCPv6_MSS 1220
 
+/**
+ * The kernel accepts at most 64 segments per UDP_SEGMENT send, and the whole
+ * super-datagram must still fit in a single UDP payload.
+ */
+#define UDP_MAX_GSO_SEGMENTS 64
+#define UDP_MAX_GSO_BYTES 65507
+
 void platform_socket_nonblock(cdk_sock_t sock) {
     int flag = fcntl(sock, F_GETFL, 0);
     if (flag == -1) {
@@ -215,79 +226,169 @@ void platform_socket_reuse_port(cdk_sock_t sock) {
     setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const void*)&on, sizeof(on));
 }
 
-cdk_sock_t platform_socket_listen(
+int platform_socket_resolve(
     const char* restrict host,
     const char* restrict port,
-    int  protocol,
-    int  idx,
-    int  cores,
-    bool nonblocking) {
-    cdk_sock_t       sock;
+    int                      protocol,
+    bool                     passive,
+    struct sockaddr_storage* addrs,
+    socklen_t*               lens,
+    int                      max) {
     struct addrinfo  hints;
     struct addrinfo* res;
     struct addrinfo* rp;
+    int              n = 0;
 
     memset(&hints, 0, sizeof(struct addrinfo));
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = protocol;
-    hints.ai_flags = AI_PASSIVE;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
     hints.ai_protocol = 0;
     hints.ai_canonname = NULL;
     hints.ai_addr = NULL;
     hints.ai_next = NULL;
 
     if (getaddrinfo(host, port, &hints, &res)) {
-        abort();
+        return 0;
+    }
+    for (rp = res; rp != NULL && n < max; rp = rp->ai_next) {
+        memcpy(&addrs[n], rp->ai_addr, rp->ai_addrlen);
+        lens[n] = rp->ai_addrlen;
+        n++;
     }
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
+    freeaddrinfo(res);
+    return n;
+}
 
-        sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (sock == -1) {
-            continue;
-        }
-        if (rp->ai_family == AF_INET6) {
-            platform_socket_v6only(sock, false);
+/**
+ * A path starting with '@' names a socket in the Linux abstract namespace,
+ * it has no file and its name isn't NUL-terminated.
+ */
+bool platform_socket_unix_address(
+    const char* restrict path, struct sockaddr_storage* ss, socklen_t* len) {
+    struct sockaddr_un* su = (struct sockaddr_un*)ss;
+    size_t              plen = strlen(path);
+
+    if (!plen || plen >= sizeof(su->sun_path)) {
+        return false;
+    }
+    memset(ss, 0, sizeof(struct sockaddr_storage));
+    su->sun_family = AF_UNIX;
+    memcpy(su->sun_path, path, plen);
+#if defined(__linux__)
+    if (path[0] == '@') {
+        su->sun_path[0] = '\0';
+        *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + plen);
+        return true;
+    }
+#endif
+    *len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + plen + 1);
+    return true;
+}
+
+/**
+ * Free the path of a local socket for bind. Only a socket file nobody is
+ * listening on any more is removed, anything else at the path fails the
+ * listen with EADDRINUSE instead of being taken over.
+ */
+static bool
+_unix_path_reclaim(struct sockaddr_un* su, socklen_t len, int protocol) {
+    struct stat st;
+
+    if (lstat(su->sun_path, &st) == -1) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        errno = EADDRINUSE;
+        return false;
+    }
+    cdk_sock_t probe = socket(AF_UNIX, protocol, 0);
+    if (probe == -1) {
+        return false;
+    }
+    int ret = connect(probe, (struct sockaddr*)su, len);
+    int err = errno;
+    close(probe);
+    if (!ret || err != ECONNREFUSED) {
+        errno = EADDRINUSE;
+        return false;
+    }
+    return !unlink(su->sun_path) || errno == ENOENT;
+}
+
+void platform_socket_unix_unlink(cdk_sock_t sock) {
+    struct sockaddr_un su;
+    socklen_t          len = sizeof(su);
+
+    memset(&su, 0, sizeof(su));
+    if (getsockname(sock, (struct sockaddr*)&su, &len) == -1) {
+        return;
+    }
+    if (su.sun_family == AF_UNIX && su.sun_path[0]) {
+        unlink(su.sun_path);
+    }
+}
+
+cdk_sock_t platform_socket_listen(
+    struct sockaddr_storage* ss,
+    socklen_t                len,
+    int                      protocol,
+    int                      idx,
+    int                      cores,
+    bool                     nonblocking) {
+    bool       local = (ss->ss_family == AF_UNIX);
+    cdk_sock_t sock = socket(ss->ss_family, protocol, 0);
+    if (sock == -1) {
+        return PLATFORM_SO_ERROR_INVALID_SOCKET;
+    }
+    if (ss->ss_family == AF_INET6) {
+        platform_socket_v6only(sock, false);
+    }
+    if (local) {
+        /* a socket file left behind by a dead server would make bind fail. */
+        struct sockaddr_un* su = (struct sockaddr_un*)ss;
+        if (su->sun_path[0] && !_unix_path_reclaim(su, len, protocol)) {
+            platform_socket_close(sock);
+            return PLATFORM_SO_ERROR_INVALID_SOCKET;
         }
+    } else {
         platform_socket_reuse_addr(sock);
         platform_socket_reuse_port(sock);
-        if (protocol == SOCK_DGRAM) {
-            platform_socket_setrecvbuf(sock, INT32_MAX);
-            if (nonblocking) {
-                platform_socket_rss(sock, idx, cores);
-            }
+    }
+    if (protocol == SOCK_DGRAM) {
+        platform_socket_setrecvbuf(sock, INT32_MAX);
+        if (nonblocking && !local) {
+            platform_socket_rss(sock, idx, cores);
         }
-        if (bind(sock, rp->ai_addr, rp->ai_addrlen) == -1) {
+    }
+    if (bind(sock, (struct sockaddr*)ss, len) == -1) {
+        platform_socket_close(sock);
+        return PLATFORM_SO_ERROR_INVALID_SOCKET;
+    }
+    /**
+     * these options inherited by connection-socket.
+     */
+    if (protocol == SOCK_STREAM) {
+        if (listen(sock, SOMAXCONN) == -1) {
             platform_socket_close(sock);
-            continue;
-        }
-        /**
-         * these options inherited by connection-socket.
-         */
-        if (protocol == SOCK_STREAM) {
-            if (listen(sock, SOMAXCONN) == -1) {
-                platform_socket_close(sock);
-                continue;
-            }
-            platform_socket_maxseg(sock);
-            /**
-             * must be after _tcp_maxseg. due to _tcp_maxseg set TCP_NOOPT on
-             * macos.
-             */
-            platform_socket_nodelay(sock, true);
-            platform_socket_keepalive(sock);
+            return PLATFORM_SO_ERROR_INVALID_SOCKET;
         }
+    }
+    if (protocol == SOCK_STREAM && !local) {
+        platform_socket_maxseg(sock);
         /**
-         * this option not inherited by connection-socket.
+         * must be after _tcp_maxseg. due to _tcp_maxseg set TCP_NOOPT on
+         * macos.
          */
-        if (nonblocking) {
-            platform_socket_nonblock(sock);
-        }
-        break;
+        platform_socket_nodelay(sock, true);
+        platform_socket_keepalive(sock);
     }
-    if (rp == NULL) {
-        abort();
+    /**
+     * this option not inherited by connection-socket.
+     */
+    if (nonblocking) {
+        platform_socket_nonblock(sock);
     }
-    freeaddrinfo(res);
     return sock;
 }
 
@@ -296,61 +397,48 @@ void platform_socket_startup(void) {}
 void platform_socket_cleanup(void) {}
 
 cdk_sock_t platform_socket_dial(
-    const char* restrict host,
-    const char* restrict port,
-    int   protocol,
-    bool* connected,
-    bool  nonblocking) {
-    int              ret;
-    cdk_sock_t       sock;
-    struct addrinfo  hints;
-    struct addrinfo* res;
-    struct addrinfo* rp;
-
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = protocol;
-    hints.ai_flags = 0;
-    hints.ai_protocol = 0;
-    hints.ai_canonname = NULL;
-    hints.ai_addr = NULL;
-    hints.ai_next = NULL;
-    if (getaddrinfo(host, port, &hints, &res)) {
-        abort();
+    struct sockaddr_storage* ss,
+    socklen_t                len,
+    int                      protocol,
+    bool*                    connected,
+    bool                     nonblocking) {
+    int        ret;
+    cdk_sock_t sock = socket(ss->ss_family, protocol, 0);
+    if (sock == -1) {
+        return PLATFORM_SO_ERROR_INVALID_SOCKET;
     }
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
-        sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (sock == -1) {
-            continue;
-        }
-        if (nonblocking) {
-            platform_socket_nonblock(sock);
-        }
-        if (protocol == SOCK_STREAM) {
-            platform_socket_maxseg(sock);
-            platform_socket_nodelay(sock, true);
-            platform_socket_keepalive(sock);
-        }
-        do {
-            ret = connect(sock, rp->ai_addr, rp->ai_addrlen);
-        } while (ret == -1 && errno == EINTR);
-        if (ret == -1) {
-            if (errno != EINPROGRESS) {
-                platform_socket_close(sock);
-                continue;
-            }
-            if (errno == EINPROGRESS) {
-                break;
-            }
-        } else {
-            *connected = true;
+    if (nonblocking) {
+        platform_socket_nonblock(sock);
+    }
+    if (protocol == SOCK_STREAM && ss->ss_family != AF_UNIX) {
+        platform_socket_maxseg(sock);
+        platform_socket_nodelay(sock, true);
+        platform_socket_keepalive(sock);
+    }
+#if defined(__linux__)
+    /**
+     * An unbound datagram socket has no address to be answered at, have
+     * the kernel give it a unique abstract one.
+     */
+    if (protocol == SOCK_DGRAM && ss->ss_family == AF_UNIX) {
+        sa_family_t family = AF_UNIX;
+        if (bind(sock, (struct sockaddr*)&family, sizeof(sa_family_t)) == -1) {
+            platform_socket_close(sock);
+            return PLATFORM_SO_ERROR_INVALID_SOCKET;
         }
-        break;
     }
-    if (rp == NULL) {
-        abort();
+#endif
+    do {
+        ret = connect(sock, (struct sockaddr*)ss, len);
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1) {
+        if (errno != EINPROGRESS) {
+            platform_socket_close(sock);
+            return PLATFORM_SO_ERROR_INVALID_SOCKET;
+        }
+    } else {
+        *connected = true;
     }
-    freeaddrinfo(res);
     return sock;
 }
 
@@ -385,6 +473,30 @@ ssize_t platform_socket_send(cdk_sock_t sock, void* buf, int size) {
     return n;
 }
 
+ssize_t platform_socket_sendv(
+    cdk_sock_t sock, void** bufs, size_t* lens, int count) {
+    struct iovec  iov[PLATFORM_SENDV_MAX];
+    struct msghdr msg = {0};
+    ssize_t       n;
+
+    if (count > PLATFORM_SENDV_MAX) {
+        count = PLATFORM_SENDV_MAX;
+    }
+    for (int i = 0; i < count; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = lens[i];
+    }
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    do {
+        n = sendmsg(sock, &msg, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        return SOCKET_ERROR;
+    }
+    return n;
+}
+
 ssize_t platform_socket_recvall(cdk_sock_t sock, void* buf, int size) {
     ssize_t off = 0;
     while (off < size) {
@@ -418,19 +530,162 @@ ssize_t platform_socket_sendall(cdk_sock_t sock, void* buf, int size) {
     return off;
 }
 
+static ssize_t _sendto_segments(
+    cdk_sock_t               sock,
+    char*                    buf,
+    int                      size,
+    struct sockaddr_storage* ss,
+    socklen_t                len,
+    int                      segsize) {
+    ssize_t off = 0;
+    while (off < size) {
+        ssize_t n;
+        int     seg = (size - off) < segsize ? (int)(size - off) : segsize;
+        do {
+            n = sendto(sock, buf + off, seg, 0, (struct sockaddr*)ss, len);
+        } while (n == -1 && errno == EINTR);
+        if (n == -1) {
+            return off ? off : SOCKET_ERROR;
+        }
+        off += n;
+    }
+    return off;
+}
+
+#if defined(__linux__)
+static ssize_t _sendto_gso(
+    cdk_sock_t               sock,
+    char*                    buf,
+    int                      size,
+    struct sockaddr_storage* ss,
+    socklen_t                len,
+    int                      segsize,
+    bool*                    nogso) {
+    ssize_t off = 0;
+    int     nsegs = UDP_MAX_GSO_BYTES / segsize;
+    if (nsegs > UDP_MAX_GSO_SEGMENTS) {
+        nsegs = UDP_MAX_GSO_SEGMENTS;
+    }
+    if (nsegs < 1) {
+        nsegs = 1;
+    }
+    while (off < size) {
+        ssize_t n;
+        int     chunk = (size - off) < (nsegs * segsize) ? (int)(size - off)
+                                                         : (nsegs * segsize);
+        char    control[CMSG_SPACE(sizeof(uint16_t))] = {0};
+        struct iovec  iov = {.iov_base = buf + off, .iov_len = chunk};
+        struct msghdr msg = {0};
+
+        msg.msg_name = ss;
+        msg.msg_namelen = ss ? len : 0;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (chunk > segsize) {
+            uint16_t        gso = (uint16_t)segsize;
+            struct cmsghdr* cm;
+
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            cm = CMSG_FIRSTHDR(&msg);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cm), &gso, sizeof(uint16_t));
+        }
+        do {
+            n = sendmsg(sock, &msg, 0);
+        } while (n == -1 && errno == EINTR);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return off ? off : SOCKET_ERROR;
+            }
+            /**
+             * Kernels without UDP_SEGMENT, or devices without checksum
+             * offload, reject the request. Segment in userspace instead,
+             * now and for the next sends on this socket.
+             */
+            if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ||
+                errno == EOPNOTSUPP) {
+                if (nogso) {
+                    *nogso = true;
+                }
+                n = _sendto_segments(
+                    sock, buf + off, (int)(size - off), ss, len, segsize);
+                if (n == SOCKET_ERROR) {
+                    return off ? off : SOCKET_ERROR;
+                }
+                return off + n;
+            }
+            return off ? off : SOCKET_ERROR;
+        }
+        off += n;
+    }
+    return off;
+}
+
+void platform_socket_gro(cdk_sock_t sock, bool on) {
+    int val = on ? 1 : 0;
+    setsockopt(sock, SOL_UDP, UDP_GRO, (const void*)&val, sizeof(int));
+}
+#endif
+
+#if defined(__APPLE__)
+void platform_socket_gro(cdk_sock_t sock, bool on) {
+    (void)(sock);
+    (void)(on);
+}
+#endif
+
 ssize_t platform_socket_recvfrom(
     cdk_sock_t               sock,
     void*                    buf,
     int                      size,
     struct sockaddr_storage* ss,
-    socklen_t*               lenptr) {
+    socklen_t*               lenptr,
+    int*                     segsize) {
     ssize_t n;
+#if defined(__linux__)
+    char          control[CMSG_SPACE(sizeof(int))] = {0};
+    struct iovec  iov = {.iov_base = buf, .iov_len = size};
+    struct msghdr msg = {0};
+
+    msg.msg_name = ss;
+    msg.msg_namelen = lenptr ? *lenptr : 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    do {
+        n = recvmsg(sock, &msg, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n == -1) {
+        return SOCKET_ERROR;
+    }
+    if (lenptr) {
+        *lenptr = msg.msg_namelen;
+    }
+    if (segsize) {
+        *segsize = 0;
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                memcpy(segsize, CMSG_DATA(cm), sizeof(int));
+                break;
+            }
+        }
+    }
+#else
     do {
         n = recvfrom(sock, buf, size, 0, (struct sockaddr*)ss, lenptr);
     } while (n == -1 && errno == EINTR);
     if (n == -1) {
         return SOCKET_ERROR;
     }
+    if (segsize) {
+        *segsize = 0;
+    }
+#endif
     return n;
 }
 
@@ -439,8 +694,21 @@ ssize_t platform_socket_sendto(
     void*                    buf,
     int                      size,
     struct sockaddr_storage* ss,
-    socklen_t                len) {
+    socklen_t                len,
+    int                      segsize,
+    bool*                    nogso) {
     ssize_t n;
+    if (segsize > 0 && size > segsize) {
+#if defined(__linux__)
+        if (!nogso || !*nogso) {
+            return _sendto_gso(sock, buf, size, ss, len, segsize, nogso);
+        }
+        return _sendto_segments(sock, buf, size, ss, len, segsize);
+#else
+        (void)(nogso);
+        return _sendto_segments(sock, buf, size, ss, len, segsize);
+#endif
+    }
     do {
         n = sendto(sock, buf, size, 0, (struct sockaddr*)ss, len);
     } while (n == -1 && errno == EINTR);
@@ -452,6 +720,8 @@ ssize_t platform_socket_sendto(
 
 int platform_socket_socketpair(
     int domain, int type, int protocol, cdk_sock_t socks[2]) {
+    /* callers ask for AF_INET, which only the win32 emulation is made of. */
+    (void)(domain);
     return socketpair(AF_LOCAL, type, protocol, socks);
 }
 
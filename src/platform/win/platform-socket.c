@@ -20,6 +20,7 @@
  */
 
 #include "cdk/cdk-types.h"
+#include "platform/platform-socket.h"
 #include "wepoll/wepoll.h"
 
 static atomic_flag initialized = ATOMIC_FLAG_INIT;
@@ -132,64 +133,85 @@ int platform_socket_extract_family(cdk_sock_t sock) {
     return info.iAddressFamily;
 }
 
-cdk_sock_t platform_socket_listen(const char *restrict host,
-                                  const char *restrict port, int protocol,
-                                  int idx, int cores, bool nonblocking) {
-    cdk_sock_t sock;
+int platform_socket_resolve(const char *restrict host,
+                            const char *restrict port, int protocol,
+                            bool passive, struct sockaddr_storage *addrs,
+                            socklen_t *lens, int max) {
     struct addrinfo hints;
     struct addrinfo *res;
     struct addrinfo *rp;
+    int n = 0;
 
     memset(&hints, 0, sizeof(struct addrinfo));
     hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = protocol;
-    hints.ai_flags = AI_PASSIVE;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
     hints.ai_protocol = 0;
     hints.ai_canonname = NULL;
     hints.ai_addr = NULL;
     hints.ai_next = NULL;
 
     if (getaddrinfo(host, port, &hints, &res)) {
-        abort();
+        return 0;
     }
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
-        sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (sock == INVALID_SOCKET) {
-            continue;
-        }
-        platform_socket_v6only(sock, false);
-        if (protocol == SOCK_STREAM) {
-            platform_socket_reuse_addr(sock);
-        }
-        if (protocol == SOCK_DGRAM) {
-            _disable_udp_connreset(sock);
-            platform_socket_setrecvbuf(sock, INT32_MAX);
-            if (nonblocking) {
-                platform_socket_rss(sock, (uint16_t)idx, cores);
-            }
+    for (rp = res; rp != NULL && n < max; rp = rp->ai_next) {
+        memcpy(&addrs[n], rp->ai_addr, rp->ai_addrlen);
+        lens[n] = (socklen_t)rp->ai_addrlen;
+        n++;
+    }
+    freeaddrinfo(res);
+    return n;
+}
+
+bool platform_socket_unix_address(const char *restrict path,
+                                  struct sockaddr_storage *ss,
+                                  socklen_t *len) {
+    /* AF_UNIX is not offered on this platform, the name doesn't resolve. */
+    (void)(path);
+    (void)(ss);
+    (void)(len);
+    return false;
+}
+
+void platform_socket_unix_unlink(cdk_sock_t sock) {
+    /* no AF_UNIX listener is ever made here. */
+    (void)(sock);
+}
+
+cdk_sock_t platform_socket_listen(struct sockaddr_storage *ss, socklen_t len,
+                                  int protocol, int idx, int cores,
+                                  bool nonblocking) {
+    cdk_sock_t sock = socket(ss->ss_family, protocol, 0);
+    if (sock == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    platform_socket_v6only(sock, false);
+    if (protocol == SOCK_STREAM) {
+        platform_socket_reuse_addr(sock);
+    }
+    if (protocol == SOCK_DGRAM) {
+        _disable_udp_connreset(sock);
+        platform_socket_setrecvbuf(sock, INT32_MAX);
+        if (nonblocking) {
+            platform_socket_rss(sock, (uint16_t)idx, cores);
         }
-        if (bind(sock, rp->ai_addr, (int)rp->ai_addrlen) == SOCKET_ERROR) {
+    }
+    if (bind(sock, (struct sockaddr *)ss, len) == SOCKET_ERROR) {
+        platform_socket_close(sock);
+        return INVALID_SOCKET;
+    }
+    if (protocol == SOCK_STREAM) {
+        if (listen(sock, SOMAXCONN) == SOCKET_ERROR) {
             platform_socket_close(sock);
-            continue;
+            return INVALID_SOCKET;
         }
-        if (protocol == SOCK_STREAM) {
-            if (listen(sock, SOMAXCONN) == SOCKET_ERROR) {
-                platform_socket_close(sock);
-                continue;
-            }
-            platform_socket_maxseg(sock);
-            platform_socket_nodelay(sock, true);
-            platform_socket_keepalive(sock);
-        }
-        if (nonblocking) {
-            platform_socket_nonblock(sock);
-        }
-        break;
+        platform_socket_maxseg(sock);
+        platform_socket_nodelay(sock, true);
+        platform_socket_keepalive(sock);
     }
-    if (rp == NULL) {
-        abort();
+    if (nonblocking) {
+        platform_socket_nonblock(sock);
     }
-    freeaddrinfo(res);
     return sock;
 }
 
@@ -209,58 +231,32 @@ void platform_socket_cleanup(void) {
     }
 }
 
-cdk_sock_t platform_socket_dial(const char *restrict host,
-                                const char *restrict port, int protocol,
-                                bool *connected, bool nonblocking) {
-    cdk_sock_t sock;
-    struct addrinfo hints;
-    struct addrinfo *res;
-    struct addrinfo *rp;
-
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = protocol;
-    hints.ai_flags = 0;
-    hints.ai_protocol = 0;
-    hints.ai_canonname = NULL;
-    hints.ai_addr = NULL;
-    hints.ai_next = NULL;
-    if (getaddrinfo(host, port, &hints, &res)) {
-        abort();
+cdk_sock_t platform_socket_dial(struct sockaddr_storage *ss, socklen_t len,
+                                int protocol, bool *connected,
+                                bool nonblocking) {
+    cdk_sock_t sock = socket(ss->ss_family, protocol, 0);
+    if (sock == INVALID_SOCKET) {
+        return INVALID_SOCKET;
     }
-    for (rp = res; rp != NULL; rp = rp->ai_next) {
-        sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-        if (sock == INVALID_SOCKET) {
-            continue;
-        }
-        if (nonblocking) {
-            platform_socket_nonblock(sock);
-        }
-        if (protocol == SOCK_STREAM) {
-            platform_socket_maxseg(sock);
-            platform_socket_nodelay(sock, true);
-            platform_socket_keepalive(sock);
-        }
-        if (protocol == SOCK_DGRAM) {
-            _disable_udp_connreset(sock);
-        }
-        if (connect(sock, rp->ai_addr, (int)rp->ai_addrlen)) {
-            if (WSAGetLastError() != WSAEWOULDBLOCK) {
-                platform_socket_close(sock);
-                continue;
-            }
-            if (WSAGetLastError() == WSAEWOULDBLOCK) {
-                break;
-            }
-        } else {
-            *connected = true;
-        }
-        break;
+    if (nonblocking) {
+        platform_socket_nonblock(sock);
     }
-    if (rp == NULL) {
-        abort();
+    if (protocol == SOCK_STREAM) {
+        platform_socket_maxseg(sock);
+        platform_socket_nodelay(sock, true);
+        platform_socket_keepalive(sock);
+    }
+    if (protocol == SOCK_DGRAM) {
+        _disable_udp_connreset(sock);
+    }
+    if (connect(sock, (struct sockaddr *)ss, len)) {
+        if (WSAGetLastError() != WSAEWOULDBLOCK) {
+            platform_socket_close(sock);
+            return INVALID_SOCKET;
+        }
+    } else {
+        *connected = true;
     }
-    freeaddrinfo(res);
     return sock;
 }
 
@@ -289,6 +285,24 @@ ssize_t platform_socket_send(cdk_sock_t sock, void *buf, int size) {
     return send(sock, buf, size, 0);
 }
 
+ssize_t platform_socket_sendv(cdk_sock_t sock, void **bufs, size_t *lens,
+                              int count) {
+    WSABUF wsabufs[PLATFORM_SENDV_MAX];
+    DWORD  n = 0;
+
+    if (count > PLATFORM_SENDV_MAX) {
+        count = PLATFORM_SENDV_MAX;
+    }
+    for (int i = 0; i < count; i++) {
+        wsabufs[i].buf = bufs[i];
+        wsabufs[i].len = (ULONG)lens[i];
+    }
+    if (WSASend(sock, wsabufs, count, &n, 0, NULL, NULL) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+    return n;
+}
+
 ssize_t platform_socket_recvall(cdk_sock_t sock, void *buf, int size) {
     ssize_t off = 0;
     while (off < size) {
@@ -319,15 +333,38 @@ ssize_t platform_socket_sendall(cdk_sock_t sock, void *buf, int size) {
 
 ssize_t platform_socket_recvfrom(cdk_sock_t sock, void *buf, int size,
                                  struct sockaddr_storage *ss,
-                                 socklen_t *sslen) {
+                                 socklen_t *sslen, int *segsize) {
+    if (segsize) {
+        *segsize = 0;
+    }
     return recvfrom(sock, buf, size, 0, (struct sockaddr *)ss, sslen);
 }
 
 ssize_t platform_socket_sendto(cdk_sock_t sock, void *buf, int size,
-                               struct sockaddr_storage *ss, socklen_t sslen) {
+                               struct sockaddr_storage *ss, socklen_t sslen,
+                               int segsize, bool *nogso) {
+    (void)(nogso);
+    if (segsize > 0 && size > segsize) {
+        ssize_t off = 0;
+        while (off < size) {
+            int seg = (size - off) < segsize ? (int)(size - off) : segsize;
+            ssize_t n = sendto(sock, (const char *)buf + off, seg, 0,
+                               (struct sockaddr *)ss, sslen);
+            if (n == SOCKET_ERROR) {
+                return off ? off : SOCKET_ERROR;
+            }
+            off += n;
+        }
+        return off;
+    }
     return sendto(sock, buf, size, 0, (struct sockaddr *)ss, sslen);
 }
 
+void platform_socket_gro(cdk_sock_t sock, bool on) {
+    (void)(sock);
+    (void)(on);
+}
+
 int platform_socket_socketpair(int domain, int type, int protocol,
                                cdk_sock_t socks[2]) {
     SOCKADDR_IN addr;
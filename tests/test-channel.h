@@ -0,0 +1,53 @@
+_Pragma("once")
+
+/* the checks are asserts, keep them in release builds too */
+#undef NDEBUG
+#include <assert.h>
+
+#include "cdk.h"
+#include "net/unpacker.h"
+
+/**
+ * A channel with no socket and no poller, enough to drive an unpacker: the
+ * bytes a read would bring are appended to its receive buffer by
+ * test_channel_feed, which then runs the unpacker as the read path does.
+ */
+static inline cdk_channel_t* test_channel_create(
+    cdk_handler_t* handler, size_t rxlen, cdk_side_t side) {
+    cdk_channel_t* channel = calloc(1, sizeof(cdk_channel_t));
+    assert(channel);
+
+    channel->handler = handler;
+    channel->side = side;
+    channel->rxbuf.buf = malloc(rxlen);
+    channel->rxbuf.len = (ssize_t)rxlen;
+    channel->rxbuf.off = 0;
+    assert(channel->rxbuf.buf);
+    atomic_init(&channel->closing, false);
+    unpacker_init(channel);
+    return channel;
+}
+
+static inline bool
+test_channel_feed(cdk_channel_t* channel, const void* data, size_t len) {
+    assert((size_t)channel->rxbuf.off + len <= (size_t)channel->rxbuf.len);
+    memcpy((char*)channel->rxbuf.buf + channel->rxbuf.off, data, len);
+    channel->rxbuf.off += (ssize_t)len;
+    return unpacker_unpack(channel);
+}
+
+/* the same bytes, one read per byte */
+static inline bool
+test_channel_trickle(cdk_channel_t* channel, const void* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (!test_channel_feed(channel, (const char*)data + i, 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline void test_channel_destroy(cdk_channel_t* channel) {
+    free(channel->rxbuf.buf);
+    free(channel);
+}
@@ -0,0 +1,155 @@
+#include "test-channel.h"
+#include "net/http1.h"
+
+static int    nmessages;
+static char   target[64];
+static char   body[64];
+static size_t bodylen;
+static int    status;
+static bool   keepalive;
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_http1_message_t* msg = buf;
+
+    assert(len == sizeof(cdk_http1_message_t));
+    assert(msg->target.len < sizeof(target) && msg->body.len <= sizeof(body));
+    memcpy(target, msg->target.buf, msg->target.len);
+    target[msg->target.len] = '\0';
+    memcpy(body, msg->body.buf, msg->body.len);
+    bodylen = msg->body.len;
+    status = msg->status;
+    keepalive = msg->keepalive;
+    nmessages++;
+}
+
+static cdk_frame_t _frame(const char* str) {
+    return (cdk_frame_t){.buf = (void*)str, .len = strlen(str)};
+}
+
+static bool _frame_is(cdk_frame_t* frame, const char* str) {
+    return frame->len == strlen(str) && !memcmp(frame->buf, str, frame->len);
+}
+
+static void _head_find_test(void) {
+    char   buf[] = "GET / HTTP/1.1\r\nHost: a\r\n\r\nbody";
+    size_t scanned = 0;
+
+    assert(!http1_head_find(buf, 20, &scanned));
+    assert(scanned == 20);
+    assert(http1_head_find(buf, sizeof(buf) - 1, &scanned) == 27);
+    assert(scanned == 0);
+
+    char lf[] = "GET / HTTP/1.1\nHost: a\n\n";
+    assert(http1_head_find(lf, sizeof(lf) - 1, &scanned) == sizeof(lf) - 1);
+}
+
+static void _head_parse_test(void) {
+    cdk_http1_message_t msg;
+    char req[] = "POST /submit?x=1 HTTP/1.1\r\n"
+                 "Host: example.com\r\n"
+                 "X-Padded:   value  \r\n"
+                 "\r\n";
+
+    assert(http1_head_parse(req, sizeof(req) - 1, &msg));
+    assert(msg.request);
+    assert(_frame_is(&msg.method, "POST"));
+    assert(_frame_is(&msg.target, "/submit?x=1"));
+    assert(_frame_is(&msg.version, "HTTP/1.1"));
+    assert(msg.nheaders == 2);
+    assert(_frame_is(&msg.headers[1].value, "value"));
+    assert(_frame_is(http1_header_find(&msg, "host"), "example.com"));
+    assert(!http1_header_find(&msg, "content-length"));
+
+    char rsp[] = "HTTP/1.1 404 Not Found\r\n\r\n";
+    assert(http1_head_parse(rsp, sizeof(rsp) - 1, &msg));
+    assert(!msg.request && msg.status == 404);
+    assert(_frame_is(&msg.reason, "Not Found"));
+
+    char folded[] = "GET / HTTP/1.1\r\nA: b\r\n c\r\n\r\n";
+    assert(!http1_head_parse(folded, sizeof(folded) - 1, &msg));
+    char nocolon[] = "GET / HTTP/1.1\r\nHost\r\n\r\n";
+    assert(!http1_head_parse(nocolon, sizeof(nocolon) - 1, &msg));
+    char spaced[] = "GET / HTTP/1.1\r\nHost : a\r\n\r\n";
+    assert(!http1_head_parse(spaced, sizeof(spaced) - 1, &msg));
+    char badstatus[] = "HTTP/1.1 2x0 OK\r\n\r\n";
+    assert(!http1_head_parse(badstatus, sizeof(badstatus) - 1, &msg));
+}
+
+static void _token_test(void) {
+    cdk_frame_t value = _frame("keep-alive, Upgrade");
+
+    assert(http1_token_has(&value, "upgrade", false));
+    assert(http1_token_has(&value, "keep-alive", false));
+    assert(!http1_token_has(&value, "keep", false));
+
+    value = _frame("gzip, chunked");
+    assert(http1_token_has(&value, "chunked", true));
+    assert(!http1_token_has(&value, "gzip", true));
+}
+
+static void _unpack_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_HTTP1};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 512, SIDE_SERVER);
+
+    /* a body split over reads, one byte each */
+    const char* post = "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+    nmessages = 0;
+    assert(test_channel_trickle(channel, post, strlen(post)));
+    assert(nmessages == 1 && !strcmp(target, "/a"));
+    assert(bodylen == 5 && !memcmp(body, "hello", 5) && keepalive);
+    assert(channel->rxbuf.off == 0);
+
+    /* pipelined, the second one without a body and not persistent */
+    const char* pipelined = "GET /b HTTP/1.1\r\nHost: x\r\n\r\n"
+                            "GET /c HTTP/1.0\r\n\r\n"
+                            "GET /d HTTP/1.1\r\n";
+    nmessages = 0;
+    assert(test_channel_feed(channel, pipelined, strlen(pipelined)));
+    assert(nmessages == 2 && !strcmp(target, "/c") && !bodylen && !keepalive);
+    assert(test_channel_feed(channel, "Connection: close\r\n\r\n", 21));
+    assert(nmessages == 3 && !strcmp(target, "/d") && !keepalive);
+
+    /* a chunked body is decoded in place, trailers included */
+    const char* chunked = "POST /e HTTP/1.1\r\n"
+                          "Transfer-Encoding: chunked\r\n\r\n"
+                          "4\r\nWiki\r\n"
+                          "a;ext=1\r\npedia is t\r\n"
+                          "0\r\nX-Trailer: 1\r\n\r\n";
+    nmessages = 0;
+    assert(test_channel_trickle(channel, chunked, strlen(chunked)));
+    assert(nmessages == 1 && !strcmp(target, "/e"));
+    assert(bodylen == 14 && !memcmp(body, "Wikipedia is t", 14));
+    assert(channel->rxbuf.off == 0);
+
+    const char* rsp = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    nmessages = 0;
+    assert(test_channel_feed(channel, rsp, strlen(rsp)));
+    assert(nmessages == 1 && status == 200 && bodylen == 2);
+    test_channel_destroy(channel);
+
+    /* framing it can't tell or can't hold */
+    const char* bad[] = {
+        "POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 4096\r\n\r\n",
+        "HTTP/1.1 200 OK\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        channel = test_channel_create(&handler, 512, SIDE_SERVER);
+        nmessages = 0;
+        assert(!test_channel_feed(channel, bad[i], strlen(bad[i])));
+        assert(nmessages == 0);
+        test_channel_destroy(channel);
+    }
+}
+
+int main(void) {
+    _head_find_test();
+    _head_parse_test();
+    _token_test();
+    _unpack_test();
+    return 0;
+}
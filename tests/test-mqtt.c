@@ -0,0 +1,77 @@
+#include "test-channel.h"
+
+static int    npackets;
+static size_t lens[8];
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    assert(npackets < 8);
+    lens[npackets++] = len;
+}
+
+static void _header_test(void) {
+    uint32_t remainings[] = {0, 127, 128, 16383, 16384, 2097152, 268435455};
+    int      sizes[] = {2, 2, 3, 3, 4, 5, 5};
+    char     buf[MQTT_MAX_HEADER];
+    uint8_t  type;
+    uint32_t remaining;
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int n = cdk_mqtt_header_encode(0x32, remainings[i], buf);
+        assert(n == sizes[i]);
+        assert(cdk_mqtt_header_decode(buf, n, &type, &remaining) == n);
+        assert(type == 0x32 && remaining == remainings[i]);
+        /* short of its last byte */
+        assert(!cdk_mqtt_header_decode(buf, n - 1, &type, &remaining));
+    }
+    assert(cdk_mqtt_header_encode(0x30, 268435456, buf) == -1);
+
+    memset(buf, 0xff, sizeof(buf));
+    assert(cdk_mqtt_header_decode(buf, sizeof(buf), &type, &remaining) == -1);
+
+    char str[6];
+    assert(cdk_mqtt_string_encode("MQTT", 4, str) == 6);
+    assert(str[0] == 0 && str[1] == 4 && !memcmp(str + 2, "MQTT", 4));
+}
+
+static void _unpack_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_MQTT};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 512, SIDE_SERVER);
+    char           buf[512];
+    size_t         len;
+
+    /* a PUBLISH with a 2 byte remaining length, one byte per read */
+    len = cdk_mqtt_header_encode(0x30, 200, buf);
+    memset(buf + len, 'x', 200);
+    len += 200;
+    npackets = 0;
+    assert(test_channel_trickle(channel, buf, len));
+    assert(npackets == 1 && lens[0] == 203);
+    assert(channel->rxbuf.off == 0);
+
+    /* PINGREQ, DISCONNECT and half a CONNACK in one read */
+    memcpy(buf, "\xc0\x00\xe0\x00\x20\x02\x00", 7);
+    npackets = 0;
+    assert(test_channel_feed(channel, buf, 7));
+    assert(npackets == 2 && lens[0] == 2 && lens[1] == 2);
+    assert(channel->rxbuf.off == 3);
+    assert(test_channel_feed(channel, "\x00", 1));
+    assert(npackets == 3 && lens[2] == 4);
+    test_channel_destroy(channel);
+
+    /* too large for the buffer, and a remaining length running over */
+    channel = test_channel_create(&handler, 512, SIDE_SERVER);
+    len = cdk_mqtt_header_encode(0x30, 1000, buf);
+    assert(!test_channel_feed(channel, buf, len));
+    test_channel_destroy(channel);
+
+    channel = test_channel_create(&handler, 512, SIDE_SERVER);
+    assert(!test_channel_feed(channel, "\x30\xff\xff\xff\xff", 5));
+    test_channel_destroy(channel);
+}
+
+int main(void) {
+    _header_test();
+    _unpack_test();
+    return 0;
+}
@@ -0,0 +1,74 @@
+/* the checks are asserts, keep them in release builds too */
+#undef NDEBUG
+#include <assert.h>
+
+#include "cdk.h"
+#include "net/poller.h"
+
+/* far more wakeups than the socket pair can buffer */
+#define FLOOD_EVENTS (1 << 20)
+
+static cdk_poller_t* _Atomic poller;
+static atomic_bool   done;
+static atomic_int    ran;
+static int           late;
+
+static void _count_cb(void* arg) {
+    atomic_fetch_add(&ran, 1);
+}
+
+static void _exit_cb(void* arg) {
+    ((cdk_poller_t*)arg)->active = false;
+}
+
+static void _late_cb(void* arg) {
+    late++;
+}
+
+/**
+ * Posted from the poller thread itself, so a post that blocks on a full
+ * socket pair would never return.
+ */
+static void _flood_cb(void* arg) {
+    cdk_poller_t* p = arg;
+
+    for (int i = 0; i < FLOOD_EVENTS; i++) {
+        cdk_net_post_event(p, _count_cb, NULL, true);
+    }
+    /* queued behind the exit, left to poller_destroy */
+    cdk_net_post_event(p, _exit_cb, p, true);
+    cdk_net_post_event(p, _late_cb, NULL, true);
+}
+
+static int _poller_thread(void* arg) {
+    cdk_poller_t* p = poller_create();
+    assert(p);
+
+    atomic_store(&poller, p);
+    poller_poll(p);
+    atomic_store(&done, true);
+    return 0;
+}
+
+int main(void) {
+    thrd_t tid;
+
+    assert(thrd_create(&tid, _poller_thread, NULL) == thrd_success);
+    while (!atomic_load(&poller)) {
+        cdk_time_sleep(1);
+    }
+    cdk_poller_t* p = atomic_load(&poller);
+    cdk_net_post_event(p, _flood_cb, p, true);
+
+    for (int i = 0; i < 30000 && !atomic_load(&done); i++) {
+        cdk_time_sleep(1);
+    }
+    assert(atomic_load(&done));
+    thrd_join(tid, NULL);
+    assert(atomic_load(&ran) == FLOOD_EVENTS);
+    assert(late == 0);
+
+    poller_destroy(p);
+    assert(late == 1);
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include "test-channel.h"
+
+static int    nreplies;
+static size_t lens[8];
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    assert(nreplies < 8);
+    lens[nreplies++] = len;
+}
+
+static int _decode(const char* str, cdk_resp_t* value) {
+    return cdk_resp_decode((char*)str, strlen(str), value);
+}
+
+static bool _str_is(cdk_resp_t* value, const char* str) {
+    return value->str.len == strlen(str) &&
+           !memcmp(value->str.buf, str, value->str.len);
+}
+
+static void _decode_test(void) {
+    cdk_resp_t value;
+
+    assert(_decode("+OK\r\n", &value) == 5);
+    assert(value.type == RESP_TYPE_SIMPLE_STRING && _str_is(&value, "OK"));
+    assert(_decode("-ERR bad\r\n", &value) == 10);
+    assert(value.type == RESP_TYPE_ERROR && _str_is(&value, "ERR bad"));
+    assert(_decode(":-42\r\n", &value) == 6);
+    assert(value.type == RESP_TYPE_INTEGER && value.integer == -42);
+    assert(_decode("$5\r\nhe\r\no\r\n", &value) == 11);
+    assert(value.type == RESP_TYPE_BULK_STRING && _str_is(&value, "he\r\no"));
+    assert(_decode("$-1\r\n", &value) == 5 && value.type == RESP_TYPE_NULL);
+    assert(_decode("*3\r\n", &value) == 4);
+    assert(value.type == RESP_TYPE_ARRAY && value.count == 3);
+    assert(_decode("%2\r\n", &value) == 4);
+    assert(value.type == RESP_TYPE_MAP && value.count == 4);
+    assert(_decode("#t\r\n", &value) == 4);
+    assert(value.type == RESP_TYPE_BOOLEAN && value.integer == 1);
+    assert(_decode("_\r\n", &value) == 3 && value.type == RESP_TYPE_NULL);
+    assert(_decode(",3.14\r\n", &value) == 7);
+    assert(value.type == RESP_TYPE_DOUBLE && _str_is(&value, "3.14"));
+    assert(_decode("=8\r\ntxt:text\r\n", &value) == 14);
+    assert(value.type == RESP_TYPE_VERBATIM_STRING);
+
+    /* incomplete */
+    assert(_decode("+OK", &value) == 0);
+    assert(_decode("$5\r\nhel", &value) == 0);
+    assert(_decode("", &value) == 0);
+
+    /* malformed */
+    assert(_decode("?x\r\n", &value) == -1);
+    assert(_decode(":4x\r\n", &value) == -1);
+    assert(_decode("$3\r\nabcd\r\n", &value) == -1);
+    assert(_decode("$-2\r\n", &value) == -1);
+    assert(_decode("#x\r\n", &value) == -1);
+    assert(_decode("_x\r\n", &value) == -1);
+}
+
+static void _encode_test(void) {
+    const char* argv[] = {"SET", "key", "a b"};
+    size_t      argvlen[] = {3, 3, 3};
+    const char* expected = "*3\r\n$3\r\nSET\r\n$3\r\nkey\r\n$3\r\na b\r\n";
+    char        buf[64];
+
+    size_t len = cdk_resp_encode(3, argv, argvlen, NULL);
+    assert(len == strlen(expected));
+    assert(cdk_resp_encode(3, argv, argvlen, buf) == len);
+    assert(!memcmp(buf, expected, len));
+}
+
+static void _unpack_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RESP};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 256, SIDE_CLIENT);
+
+    /* a nested reply, one byte per read */
+    const char* nested = "*2\r\n*2\r\n:1\r\n$1\r\na\r\n%1\r\n+k\r\n_\r\n";
+    nreplies = 0;
+    assert(test_channel_trickle(channel, nested, strlen(nested)));
+    assert(nreplies == 1 && lens[0] == strlen(nested));
+    assert(channel->rxbuf.off == 0);
+
+    /* pipelined replies, an attribute belongs to the value after it */
+    const char* pipelined = "+OK\r\n"
+                            "|1\r\n+ttl\r\n:10\r\n$2\r\nhi\r\n"
+                            "*0\r\n"
+                            "*1\r\n";
+    nreplies = 0;
+    assert(test_channel_feed(channel, pipelined, strlen(pipelined)));
+    assert(nreplies == 3 && lens[0] == 5 && lens[1] == 23 && lens[2] == 4);
+    assert(channel->rxbuf.off == 4);
+    assert(test_channel_feed(channel, "$-1\r\n", 5));
+    assert(nreplies == 4 && lens[3] == 9);
+    assert(channel->rxbuf.off == 0);
+    test_channel_destroy(channel);
+
+    /* malformed, or announcing more values than the buffer could hold */
+    const char* bad[] = {"?\r\n", "*2\r\n:x\r\n", "*1000\r\n"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        channel = test_channel_create(&handler, 256, SIDE_CLIENT);
+        nreplies = 0;
+        assert(!test_channel_feed(channel, bad[i], strlen(bad[i])));
+        assert(nreplies == 0);
+        test_channel_destroy(channel);
+    }
+}
+
+int main(void) {
+    _decode_test();
+    _encode_test();
+    _unpack_test();
+    return 0;
+}
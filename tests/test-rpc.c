@@ -0,0 +1,200 @@
+#include "test-channel.h"
+#include "cdk/cdk-timer.h"
+#include "net/rpc.h"
+#include "net/txlist.h"
+#include "platform/platform-socket.h"
+
+static int      nrequests;
+static uint64_t ids[4];
+static char     payload[64];
+static size_t   payloadlen;
+
+static void
+_request_cb(cdk_channel_t* channel, uint64_t id, void* buf, size_t len) {
+    assert(nrequests < 4 && len <= sizeof(payload));
+    ids[nrequests++] = id;
+    memcpy(payload, buf, len);
+    payloadlen = len;
+}
+
+/* a 4 byte length of what follows, the 8 byte id, the kind, the payload */
+static size_t
+_message_make(char* buf, uint64_t id, uint8_t kind, const char* data) {
+    size_t   len = strlen(data);
+    uint32_t size = (uint32_t)(RPC_HEADER_SIZE - 4 + len);
+
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (char)(size >> (24 - 8 * i));
+    }
+    for (int i = 0; i < 8; i++) {
+        buf[4 + i] = (char)(id >> (56 - 8 * i));
+    }
+    buf[12] = (char)kind;
+    memcpy(buf + RPC_HEADER_SIZE, data, len);
+    return RPC_HEADER_SIZE + len;
+}
+
+static int              ncompleted;
+static intptr_t         args[8];
+static cdk_rpc_status_t statuses[8];
+static char             results[8][16];
+
+static void _complete_cb(
+    cdk_channel_t*   channel,
+    cdk_rpc_status_t status,
+    void*            buf,
+    size_t           len,
+    void*            arg) {
+    assert(ncompleted < 8 && len < sizeof(results[0]));
+    args[ncompleted] = (intptr_t)arg;
+    statuses[ncompleted] = status;
+    memcpy(results[ncompleted], buf, len);
+    results[ncompleted++][len] = '\0';
+}
+
+/* the id of the next request written to the peer's end of the socket */
+static uint64_t _request_read(cdk_sock_t sock) {
+    uint8_t  hdr[RPC_HEADER_SIZE];
+    uint64_t id = 0;
+    char     payload[16];
+
+    assert(platform_socket_recvall(sock, hdr, RPC_HEADER_SIZE) ==
+           RPC_HEADER_SIZE);
+    assert(hdr[12] == 0);
+    for (int i = 0; i < 8; i++) {
+        id = (id << 8) | hdr[4 + i];
+    }
+    int len = ((hdr[2] << 8) | hdr[3]) - (RPC_HEADER_SIZE - 4);
+    assert(len >= 0 && len <= (int)sizeof(payload));
+    if (len) {
+        assert(platform_socket_recvall(sock, payload, len) == len);
+    }
+    return id;
+}
+
+/**
+ * Calls go out through a socket pair, their deadlines are kept by a timer
+ * manager that nothing runs, so a timeout only fires when the test says so.
+ */
+static void _call_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RPC};
+    cdk_handler_t  handler = {.unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 128, SIDE_CLIENT);
+    cdk_poller_t   poller = {0};
+    cdk_sock_t     socks[2];
+    uint64_t       callids[5];
+    char           buf[128];
+    size_t         len;
+
+    assert(!platform_socket_socketpair(AF_INET, SOCK_STREAM, 0, socks));
+    poller.timermgr = cdk_timer_manager_create();
+    channel->poller = &poller;
+    channel->fd = socks[0];
+    channel->type = SOCK_STREAM;
+    txlist_create(&channel->txlist);
+
+    ncompleted = 0;
+    for (intptr_t i = 0; i < 3; i++) {
+        assert(rpc_call(channel, "req", 3, 0, _complete_cb, (void*)i));
+        callids[i] = _request_read(socks[1]);
+    }
+    assert(callids[0] != callids[1] && callids[1] != callids[2]);
+    assert(callids[0] != callids[2]);
+    assert(atomic_load(&channel->tcp.rpc.inflight) == 3);
+
+    /* responses out of order reach the calls they answer */
+    len = _message_make(buf, callids[2], 1, "two");
+    len += _message_make(buf + len, callids[0], 1, "zero");
+    assert(test_channel_feed(channel, buf, len));
+    assert(ncompleted == 2);
+    assert(args[0] == 2 && statuses[0] == RPC_STATUS_OK);
+    assert(!strcmp(results[0], "two"));
+    assert(args[1] == 0 && statuses[1] == RPC_STATUS_OK);
+    assert(!strcmp(results[1], "zero"));
+    assert(atomic_load(&channel->tcp.rpc.inflight) == 1);
+
+    /* a call that times out, then its response, which is dropped */
+    assert(rpc_call(channel, "", 0, 10, _complete_cb, (void*)3));
+    callids[3] = _request_read(socks[1]);
+    assert(!cdk_timer_empty(poller.timermgr));
+    cdk_timer_t* timer = cdk_timer_min(poller.timermgr);
+    timer->routine(timer->param);
+    cdk_timer_del(poller.timermgr, timer);
+    assert(ncompleted == 3);
+    assert(args[2] == 3 && statuses[2] == RPC_STATUS_TIMEOUT);
+    len = _message_make(buf, callids[3], 1, "late");
+    assert(test_channel_feed(channel, buf, len));
+    assert(ncompleted == 3 && channel->rxbuf.off == 0);
+
+    /* the calls in flight when the channel goes away, as its release does */
+    assert(rpc_call(channel, "", 0, 1000, _complete_cb, (void*)4));
+    callids[4] = _request_read(socks[1]);
+    assert(atomic_load(&channel->tcp.rpc.inflight) == 2);
+    rpc_abort_all(channel);
+    assert(ncompleted == 5);
+    assert(args[3] == 1 && statuses[3] == RPC_STATUS_CLOSED);
+    assert(args[4] == 4 && statuses[4] == RPC_STATUS_CLOSED);
+    assert(atomic_load(&channel->tcp.rpc.inflight) == 0);
+    assert(cdk_timer_empty(poller.timermgr));
+
+    platform_socket_close(socks[0]);
+    platform_socket_close(socks[1]);
+    txlist_destroy(&channel->txlist);
+    cdk_timer_manager_destroy(poller.timermgr);
+    test_channel_destroy(channel);
+}
+
+static void _unpack_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_RPC};
+    cdk_handler_t  handler = {
+        .on_rpc_request = _request_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 128, SIDE_SERVER);
+    char           buf[128];
+    size_t         len;
+
+    /* a request, one byte per read */
+    len = _message_make(buf, 0x0102030405060708ULL, 0, "ping");
+    nrequests = 0;
+    assert(test_channel_trickle(channel, buf, len));
+    assert(nrequests == 1 && ids[0] == 0x0102030405060708ULL);
+    assert(payloadlen == 4 && !memcmp(payload, "ping", 4));
+    assert(channel->rxbuf.off == 0);
+
+    /**
+     * An empty request, a response to a call that isn't in flight, which
+     * is dropped, and the start of another request.
+     */
+    len = _message_make(buf, 7, 0, "");
+    len += _message_make(buf + len, 8, 1, "late");
+    len += _message_make(buf + len, 9, 0, "next");
+    nrequests = 0;
+    assert(test_channel_feed(channel, buf, len - 2));
+    assert(nrequests == 1 && ids[0] == 7 && payloadlen == 0);
+    assert(channel->rxbuf.off == RPC_HEADER_SIZE + 2);
+    assert(test_channel_feed(channel, buf + len - 2, 2));
+    assert(nrequests == 2 && ids[1] == 9);
+    assert(payloadlen == 4 && !memcmp(payload, "next", 4));
+    assert(channel->rxbuf.off == 0);
+    test_channel_destroy(channel);
+
+    /* an unknown kind, a length short of the header, one over the buffer */
+    char bad[3][RPC_HEADER_SIZE];
+    _message_make(bad[0], 1, 2, "");
+    _message_make(bad[1], 1, 0, "");
+    bad[1][3] = 8;
+    _message_make(bad[2], 1, 0, "");
+    bad[2][2] = 1;
+    for (int i = 0; i < 3; i++) {
+        channel = test_channel_create(&handler, 128, SIDE_SERVER);
+        nrequests = 0;
+        assert(!test_channel_feed(channel, bad[i], RPC_HEADER_SIZE));
+        assert(nrequests == 0);
+        test_channel_destroy(channel);
+    }
+}
+
+int main(void) {
+    _unpack_test();
+    _call_test();
+    return 0;
+}
@@ -0,0 +1,315 @@
+#include "test-channel.h"
+#include "net/simd.h"
+
+static char   frames[8][256];
+static size_t lens[8];
+static int    nframes;
+static int    nbatches;
+static size_t streamed;
+static size_t streamsize;
+static bool   streamend;
+
+static void _reset(void) {
+    nframes = 0;
+    nbatches = 0;
+    streamed = 0;
+    streamsize = 0;
+    streamend = false;
+}
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    assert(nframes < 8 && len <= sizeof(frames[0]));
+    memcpy(frames[nframes], buf, len);
+    lens[nframes++] = len;
+}
+
+static void
+_read_batch_cb(cdk_channel_t* channel, cdk_frame_t* batch, size_t count) {
+    nbatches++;
+    for (size_t i = 0; i < count; i++) {
+        _read_cb(channel, batch[i].buf, batch[i].len);
+    }
+}
+
+static void _stream_begin_cb(
+    cdk_channel_t* channel, void* header, size_t hlen, size_t flen) {
+    assert(hlen == 4);
+    streamsize = flen;
+}
+
+static void _stream_chunk_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        assert(((uint8_t*)buf)[i] == (uint8_t)(streamed + i));
+    }
+    streamed += len;
+}
+
+static void _stream_end_cb(cdk_channel_t* channel) {
+    streamend = true;
+}
+
+/* a 4 byte big-endian payload length, then the payload */
+static size_t _frame_make(char* buf, const char* payload) {
+    uint32_t len = (uint32_t)strlen(payload);
+    uint32_t field = htonl(len);
+
+    memcpy(buf, &field, 4);
+    memcpy(buf + 4, payload, len);
+    return 4 + len;
+}
+
+static void _fixedint_test(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_LENGTHFIELD,
+        .lengthfield.coding = MODE_FIXEDINT,
+        .lengthfield.offset = 0,
+        .lengthfield.payload = 4,
+        .lengthfield.size = 4};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 64, SIDE_SERVER);
+    char           buf[64];
+    size_t         len;
+
+    /* two frames and a half in one read */
+    _reset();
+    len = _frame_make(buf, "hello");
+    len += _frame_make(buf + len, "");
+    len += _frame_make(buf + len, "world");
+    assert(test_channel_feed(channel, buf, len - 3));
+    assert(nframes == 2);
+    assert(lens[0] == 9 && !memcmp(frames[0] + 4, "hello", 5));
+    assert(lens[1] == 4);
+    assert(channel->rxbuf.off == 6);
+    assert(test_channel_feed(channel, buf + len - 3, 3));
+    assert(nframes == 3 && lens[2] == 9);
+    assert(!memcmp(frames[2] + 4, "world", 5));
+    assert(channel->rxbuf.off == 0);
+
+    /* one byte per read */
+    _reset();
+    len = _frame_make(buf, "trickle");
+    assert(test_channel_trickle(channel, buf, len));
+    assert(nframes == 1 && lens[0] == len);
+    assert(channel->rxbuf.off == 0);
+
+    /* larger than the receive buffer and nowhere to stream it to */
+    _reset();
+    uint32_t field = htonl(100);
+    assert(!test_channel_feed(channel, &field, 4));
+    assert(nframes == 0);
+
+    test_channel_destroy(channel);
+}
+
+static void _varint_test(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_LENGTHFIELD,
+        .lengthfield.coding = MODE_VARINT,
+        .lengthfield.offset = 1,
+        .lengthfield.payload = 2,
+        .lengthfield.size = 1};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 256, SIDE_SERVER);
+    char           buf[256];
+
+    /* a type byte, a 2 byte varint of 150, then the payload, byte by byte */
+    _reset();
+    buf[0] = 'T';
+    int n = cdk_varint_encode(150, buf + 1);
+    assert(n == 2);
+    for (int i = 0; i < 150; i++) {
+        buf[1 + n + i] = (char)i;
+    }
+    assert(test_channel_trickle(channel, buf, 1 + n + 150));
+    assert(nframes == 1 && lens[0] == 153);
+    assert(frames[0][0] == 'T' && frames[0][3] == 0);
+    assert((uint8_t)frames[0][152] == 149);
+
+    /* a 1 byte varint */
+    buf[0] = 'S';
+    buf[1] = 5;
+    memcpy(buf + 2, "short", 5);
+    assert(test_channel_feed(channel, buf, 7));
+    assert(nframes == 2 && lens[1] == 7);
+    assert(!memcmp(frames[1] + 2, "short", 5));
+    assert(channel->rxbuf.off == 0);
+
+    /* no uint32_t takes more than 5 groups */
+    memset(buf, 0x80, 8);
+    assert(!test_channel_feed(channel, buf, 8));
+    assert(nframes == 2);
+
+    test_channel_destroy(channel);
+}
+
+static void _stream_test(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_LENGTHFIELD,
+        .lengthfield.coding = MODE_FIXEDINT,
+        .lengthfield.offset = 0,
+        .lengthfield.payload = 4,
+        .lengthfield.size = 4};
+    cdk_handler_t  handler = {
+        .on_read = _read_cb,
+        .on_stream_begin = _stream_begin_cb,
+        .on_stream_chunk = _stream_chunk_cb,
+        .on_stream_end = _stream_end_cb,
+        .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 32, SIDE_SERVER);
+    char           buf[32];
+
+    /* 1000 bytes through a 32 byte buffer, then a frame that fits */
+    _reset();
+    uint32_t field = htonl(1000);
+    memcpy(buf, &field, 4);
+    for (int i = 0; i < 28; i++) {
+        buf[4 + i] = (char)i;
+    }
+    assert(test_channel_feed(channel, buf, 32));
+    size_t sent = 28;
+    while (sent < 1000) {
+        size_t n = (1000 - sent < 32) ? 1000 - sent : 32;
+        for (size_t i = 0; i < n; i++) {
+            buf[i] = (char)(sent + i);
+        }
+        assert(test_channel_feed(channel, buf, n));
+        sent += n;
+    }
+    assert(streamsize == 1004 && streamed == 1000 && streamend);
+    assert(nframes == 0);
+    size_t len = _frame_make(buf, "after");
+    assert(test_channel_feed(channel, buf, len));
+    assert(nframes == 1 && lens[0] == len);
+
+    test_channel_destroy(channel);
+}
+
+static void _batch_test(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_LENGTHFIELD,
+        .lengthfield.coding = MODE_FIXEDINT,
+        .lengthfield.offset = 0,
+        .lengthfield.payload = 4,
+        .lengthfield.size = 4};
+    cdk_handler_t  handler = {
+        .on_read = _read_cb,
+        .on_read_batch = _read_batch_cb,
+        .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 64, SIDE_SERVER);
+    char           buf[64];
+    size_t         len = 0;
+
+    _reset();
+    len += _frame_make(buf + len, "a");
+    len += _frame_make(buf + len, "bb");
+    len += _frame_make(buf + len, "ccc");
+    assert(test_channel_feed(channel, buf, len));
+    assert(nbatches == 1 && nframes == 3);
+    assert(lens[0] == 5 && lens[1] == 6 && lens[2] == 7);
+
+    test_channel_destroy(channel);
+}
+
+static void _delimiter_test(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_DELIMITER, .delimiter.delimiter = "\r\n\r\n"};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 64, SIDE_SERVER);
+    const char*    lines = "line one\r\n\r\nline two\r\n\r\n";
+
+    /* the delimiter split across two reads */
+    _reset();
+    assert(test_channel_feed(channel, "abc\r\n", 5));
+    assert(nframes == 0);
+    assert(test_channel_feed(channel, "\r\ndef", 5));
+    assert(nframes == 1 && lens[0] == 7 && !memcmp(frames[0], "abc", 3));
+    assert(channel->rxbuf.off == 3);
+    assert(test_channel_feed(channel, "\r\n\r\n", 4));
+    assert(nframes == 2 && lens[1] == 7 && !memcmp(frames[1], "def", 3));
+    assert(channel->rxbuf.off == 0);
+
+    /* one byte per read */
+    _reset();
+    assert(test_channel_trickle(channel, lines, strlen(lines)));
+    assert(nframes == 2 && lens[0] == 12 && lens[1] == 12);
+    assert(!memcmp(frames[1], "line two", 8));
+    assert(channel->rxbuf.off == 0);
+
+    test_channel_destroy(channel);
+}
+
+static void _delimiter_long_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_DELIMITER};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    const char*    data = "xyzABCDEFGABCDEFGH";
+
+    /* all 8 bytes used, no room for a NUL */
+    memcpy(unpacker.delimiter.delimiter, "ABCDEFGH", 8);
+    cdk_channel_t* channel = test_channel_create(&handler, 64, SIDE_SERVER);
+    assert(channel->unpacker.dlen == 8);
+
+    /* a near miss right before the delimiter */
+    _reset();
+    assert(test_channel_feed(channel, data, 10));
+    assert(nframes == 0);
+    assert(test_channel_feed(channel, data + 10, strlen(data) - 10));
+    assert(nframes == 1 && lens[0] == strlen(data));
+    assert(channel->rxbuf.off == 0);
+
+    test_channel_destroy(channel);
+}
+
+static void _delimiter_many_test(void) {
+    cdk_unpacker_t unpacker = {
+        .type = UNPACKER_TYPE_DELIMITER, .delimiter.delimiter = "|"};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = test_channel_create(&handler, 64, SIDE_SERVER);
+
+    /* several frames in one read, the rest kept for the next */
+    _reset();
+    assert(test_channel_feed(channel, "a|bb||ccc|dd", 12));
+    assert(nframes == 4);
+    assert(lens[0] == 2 && lens[1] == 3 && lens[2] == 1 && lens[3] == 4);
+    assert(!memcmp(frames[3], "ccc|", 4));
+    assert(channel->rxbuf.off == 2 && !memcmp(channel->rxbuf.buf, "dd", 2));
+
+    test_channel_destroy(channel);
+}
+
+/* lengths around the 16 and 32 byte vector widths */
+static void _memchr_test(void) {
+    size_t sizes[] = {0, 1, 15, 16, 17, 31, 32, 33, 64, 65};
+    char   buf[80];
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t n = sizes[i];
+        /* unaligned, and a match right past the end that must not count */
+        char* s = buf + 1;
+
+        memset(buf, 'a', sizeof(buf));
+        s[n] = 'x';
+        assert(simd_memchr(s, 'x', n) == NULL);
+        if (n) {
+            s[n - 1] = 'x';
+            assert(simd_memchr(s, 'x', n) == s + n - 1);
+            s[0] = 'x';
+            assert(simd_memchr(s, 'x', n) == s);
+        }
+    }
+    /* bytes above 0x7f */
+    memset(buf, 'a', sizeof(buf));
+    buf[40] = (char)0xff;
+    assert(simd_memchr(buf, (char)0xff, sizeof(buf)) == buf + 40);
+}
+
+int main(void) {
+    _fixedint_test();
+    _varint_test();
+    _stream_test();
+    _batch_test();
+    _delimiter_test();
+    _delimiter_long_test();
+    _delimiter_many_test();
+    _memchr_test();
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "test-channel.h"
+
+static int                    nmessages;
+static cdk_websocket_opcode_t opcodes[4];
+static char                   payload[256];
+static size_t                 payloadlen;
+
+static void _read_cb(cdk_channel_t* channel, void* buf, size_t len) {
+    cdk_websocket_message_t* msg = buf;
+
+    assert(len == sizeof(cdk_websocket_message_t) && nmessages < 4);
+    assert(msg->payload.len <= sizeof(payload));
+    opcodes[nmessages++] = msg->opcode;
+    memcpy(payload, msg->payload.buf, msg->payload.len);
+    payloadlen = msg->payload.len;
+}
+
+/* one frame, masked as a client sends it when masked is set */
+static size_t _frame_make(
+    char*       buf,
+    bool        fin,
+    uint8_t     opcode,
+    const char* data,
+    size_t      len,
+    bool        masked) {
+    static const uint8_t mask[4] = {0x11, 0x22, 0x33, 0x44};
+    uint8_t*             p = (uint8_t*)buf;
+
+    *p++ = (fin ? 0x80 : 0) | opcode;
+    if (len < 126) {
+        *p++ = (masked ? 0x80 : 0) | (uint8_t)len;
+    } else {
+        *p++ = (masked ? 0x80 : 0) | 126;
+        *p++ = (uint8_t)(len >> 8);
+        *p++ = (uint8_t)len;
+    }
+    if (masked) {
+        memcpy(p, mask, 4);
+        p += 4;
+    }
+    for (size_t i = 0; i < len; i++) {
+        *p++ = (uint8_t)data[i] ^ (masked ? mask[i % 4] : 0);
+    }
+    return (char*)p - buf;
+}
+
+static cdk_channel_t* _channel_create(cdk_handler_t* handler, cdk_side_t side) {
+    cdk_channel_t* channel = test_channel_create(handler, 512, side);
+
+    /* the upgrade handshake answers through the socket, skip it */
+    channel->unpacker.websocket.upgraded = true;
+    nmessages = 0;
+    return channel;
+}
+
+static void _frames_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_WEBSOCKET};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    cdk_channel_t* channel = _channel_create(&handler, SIDE_SERVER);
+    char           buf[512];
+    char           data[200];
+    size_t         len;
+
+    /* a masked text frame, one byte per read */
+    len = _frame_make(buf, true, WEBSOCKET_OPCODE_TEXT, "hello", 5, true);
+    assert(test_channel_trickle(channel, buf, len));
+    assert(nmessages == 1 && opcodes[0] == WEBSOCKET_OPCODE_TEXT);
+    assert(payloadlen == 5 && !memcmp(payload, "hello", 5));
+    assert(channel->rxbuf.off == 0);
+
+    /* fragmented, with a control frame in between */
+    nmessages = 0;
+    len = _frame_make(buf, false, WEBSOCKET_OPCODE_TEXT, "Hel", 3, true);
+    len += _frame_make(buf + len, true, WEBSOCKET_OPCODE_PONG, "p", 1, true);
+    len += _frame_make(
+        buf + len, false, WEBSOCKET_OPCODE_CONTINUATION, "lo, ", 4, true);
+    assert(test_channel_feed(channel, buf, len));
+    assert(nmessages == 1 && opcodes[0] == WEBSOCKET_OPCODE_PONG);
+    len = _frame_make(
+        buf, true, WEBSOCKET_OPCODE_CONTINUATION, "world", 5, true);
+    assert(test_channel_trickle(channel, buf, len));
+    assert(nmessages == 2 && opcodes[1] == WEBSOCKET_OPCODE_TEXT);
+    assert(payloadlen == 12 && !memcmp(payload, "Hello, world", 12));
+    assert(channel->rxbuf.off == 0);
+
+    /* a 16 bit length */
+    nmessages = 0;
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char)i;
+    }
+    len = _frame_make(
+        buf, true, WEBSOCKET_OPCODE_BINARY, data, sizeof(data), true);
+    assert(test_channel_feed(channel, buf, len));
+    assert(nmessages == 1 && opcodes[0] == WEBSOCKET_OPCODE_BINARY);
+    assert(payloadlen == sizeof(data) && !memcmp(payload, data, sizeof(data)));
+
+    /* more than the receive buffer holds */
+    buf[0] = (char)(0x80 | WEBSOCKET_OPCODE_BINARY);
+    buf[1] = (char)(0x80 | 126);
+    buf[2] = 0x10;
+    buf[3] = 0x00;
+    memset(buf + 4, 0, 4);
+    assert(!test_channel_feed(channel, buf, 8));
+    test_channel_destroy(channel);
+
+    /* what a client gets is not masked */
+    channel = _channel_create(&handler, SIDE_CLIENT);
+    len = _frame_make(buf, true, WEBSOCKET_OPCODE_TEXT, "plain", 5, false);
+    assert(test_channel_feed(channel, buf, len));
+    assert(nmessages == 1 && !memcmp(payload, "plain", 5));
+    test_channel_destroy(channel);
+}
+
+static void _violations_test(void) {
+    cdk_unpacker_t unpacker = {.type = UNPACKER_TYPE_WEBSOCKET};
+    cdk_handler_t  handler = {.on_read = _read_cb, .unpacker = &unpacker};
+    char           buf[512];
+    char           data[130] = {0};
+    size_t         len;
+
+    struct {
+        cdk_side_t side;
+        bool       fin;
+        uint8_t    opcode;
+        size_t     len;
+        bool       masked;
+    } cases[] = {
+        {SIDE_SERVER, true, WEBSOCKET_OPCODE_TEXT, 1, false},
+        {SIDE_CLIENT, true, WEBSOCKET_OPCODE_TEXT, 1, true},
+        {SIDE_SERVER, true, WEBSOCKET_OPCODE_CONTINUATION, 1, true},
+        {SIDE_SERVER, false, WEBSOCKET_OPCODE_PONG, 1, true},
+        {SIDE_SERVER, true, WEBSOCKET_OPCODE_PONG, 126, true},
+        {SIDE_SERVER, true, 0x3, 1, true},
+        {SIDE_SERVER, true, 0xB, 1, true},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        cdk_channel_t* channel = _channel_create(&handler, cases[i].side);
+        /**
+         * channel_destroy leaves a channel marked closing alone, so the
+         * error recorded for the violation can be looked at.
+         */
+        atomic_store(&channel->closing, true);
+        len = _frame_make(
+            buf, cases[i].fin, cases[i].opcode, data, cases[i].len,
+            cases[i].masked);
+        assert(test_channel_feed(channel, buf, len));
+        assert(nmessages == 0);
+        assert(channel->error.code == CHANNEL_ERROR_PROTOCOL_FAIL);
+        test_channel_destroy(channel);
+    }
+
+    /* the RSV bits without an extension */
+    cdk_channel_t* channel = _channel_create(&handler, SIDE_SERVER);
+    atomic_store(&channel->closing, true);
+    len = _frame_make(buf, true, WEBSOCKET_OPCODE_TEXT, data, 1, true);
+    buf[0] |= 0x40;
+    assert(test_channel_feed(channel, buf, len));
+    assert(channel->error.code == CHANNEL_ERROR_PROTOCOL_FAIL);
+    test_channel_destroy(channel);
+}
+
+int main(void) {
+    _frames_test();
+    _violations_test();
+    return 0;
+}